@@ -12,24 +12,35 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "CPLT_intern.h"
 
 /* graphics context */
 struct CPLT_gctx {
-   CPLT_funcn_t *dispatch; /* functions dispatch table */
+   const CPLT_funcn_t *dispatch; /* functions dispatch table */
    FILE *fp;               /* filepointer */
+   char *fpbuf;            /* fp's buffer, if not stdio's own */
+   CPLT_state_t state;     /* as set by the generic API */
+   CPLT_view_t view;       /* culled by the generic API */
+#ifdef CPLT_STATS
+   CPLT_stats_t stats;     /* counted by the generic API */
+#endif
+   int ntrans;             /* transforms pushed, not popped yet */
+   int insym;              /* if a symbol is being defined */
+   int symfont;            /* if a symbol sets the fontsize */
 };
 
 
 /* global constants */
 /* Type1-fontface used by string drawing */
 static char *fontface = "Helvetica";
+static const float _EPS = 1.0E-5;   /* epsilon to 0 */
 
 
 /* prototypes of internal helper functions */
 void _create_poly_EPS(CPLT_gc_t gc, int numpts, CPLT_point_t points[]);
-CPLT_funcn_t *_get_dispatchFuncs_EPS(void);
+void _set_state_EPS(CPLT_gc_t gc);
 
 /*
  *******************************************************************************
@@ -39,10 +50,10 @@ CPLT_funcn_t *_get_dispatchFuncs_EPS(void);
 
 CPLT_gc_t CPLT_init_graphics_EPS(const unsigned int pwidth,
                                  const unsigned int pheight,
-                                 char *plotfilename) {
-   /* Initializes graphics of pwidth x pheight [pix] in graphics file
-    * plotfilename, returns graphics-context pointer.
-    * here EPS: opens plotfile, writes EPS-header */
+                                 char *plotfilename, FILE *fp) {
+   /* Initializes graphics of pwidth x pheight [pix] named plotfilename,
+    * written to the opened fp, returns graphics-context pointer.
+    * here EPS: writes EPS-header */
 
    /* allocate memory for graphics context's data-struct */
    CPLT_gc_t gc = (CPLT_gc_t) malloc(sizeof(*gc));
@@ -50,21 +61,22 @@ CPLT_gc_t CPLT_init_graphics_EPS(const unsigned int pwidth,
       fprintf(stderr, " *** Not enough memory for graphics context!\n");
       return NULL;
    }
+   _unknown_state(&gc->state);
+   _init_view(&gc->view, pwidth, pheight);
 
-   /* open EPS-plotfile */
-   if ((gc->fp = fopen(plotfilename, "w")) == NULL) {
-      fprintf(stderr,
-              " *** Can't open output plotfile '%s'!\n", plotfilename);
-      return NULL;
-   }
+   gc->fp = fp;
+   gc->ntrans = 0;
+   gc->insym = 0;             /* not defining a symbol */
+   gc->symfont = 0;
 
    time_t now = time(NULL);
+   char date[32];          /* for ctime_r(), reentrant unlike ctime() */
 
    /* write EPS-preamble, define some useful procedures */
    fprintf(gc->fp, "%%!PS-Adobe-3.0 EPSF-3.0\n");
    fprintf(gc->fp, "%%%%Title: %s\n", plotfilename);
    fprintf(gc->fp, "%%%%Creator: CPlotter\n");
-   fprintf(gc->fp, "%%%%CreationDate: %s", ctime(&now));
+   fprintf(gc->fp, "%%%%CreationDate: %s", ctime_r(&now, date));
    fprintf(gc->fp, "%%%%BoundingBox: 0 0 %u %u\n", pwidth, pheight);
    fprintf(gc->fp, "%%%%Pages: 1\n");
    fprintf(gc->fp, "%%%%EndComments\n");
@@ -128,6 +140,23 @@ CPLT_gc_t CPLT_init_graphics_EPS(const unsigned int pwidth,
    fprintf(gc->fp, "     X Y m g P t A r\n");
    fprintf(gc->fp, "     B neg FH neg rm S show G} bind def\n");
    fprintf(gc->fp, "/w {setlinewidth} bind def\n");
+   fprintf(gc->fp, "/SG {n 4 2 roll m l s} bind def\n");
+   fprintf(gc->fp, "%%\n%% binary branching, see CPLT_draw_branching():\n");
+   fprintf(gc->fp, "%% j side B1 draws the branch of level j turned by "
+           "BA[side] and its subtree,\n");
+   fprintf(gc->fp, "%% in coords scaled to its length, the next level's "
+           "scaled by BF\n");
+   fprintf(gc->fp, "/B1 {matrix currentmatrix 3 1 roll\n");
+   fprintf(gc->fp, "   BA 1 index get r BC 2 index get exch get aload pop c\n");
+   fprintf(gc->fp, "   BW 1 index get w n 0 0 m 1 0 l s\n");
+   fprintf(gc->fp, "   dup BD lt {1 0 t BF dup scale 1 add dup 0 B1 1 B1} "
+           "{pop} ifelse\n");
+   fprintf(gc->fp, "   setmatrix} bind def\n");
+   fprintf(gc->fp, "/BR {/BC exch def /BW exch def /BD exch def "
+           "/BF exch def\n");
+   fprintf(gc->fp, "   /BA exch dup neg 2 array astore def /BL exch def "
+           "/A exch def\n");
+   fprintf(gc->fp, "   g t A r BL dup scale 0 0 B1 0 1 B1 G} bind def\n");
    fprintf(gc->fp, "%%\n%% calculate character height FH of current font\n");
    fprintf(gc->fp, "/calc_FH {g n 0 0 m\n");
    fprintf(gc->fp, "   (M) true charpath flattenpath pathbbox\n");
@@ -151,7 +180,7 @@ CPLT_gc_t CPLT_init_graphics_EPS(const unsigned int pwidth,
    fprintf(gc->fp, "%%%%Page: 1 1\n");
 
    /* register dispatch table of our functions for generic callers */
-   gc->dispatch = _get_dispatchFuncs_EPS();
+   gc->dispatch = &CPLT_dispatch_EPS;
 
    return gc;
 }
@@ -420,6 +449,7 @@ void CPLT_set_fontsize_EPS(CPLT_gc_t gc, const float fontsize) {
    fprintf(gc->fp,
            "/%s ISOfindfont %d scalefont setfont calc_FH\n",
            fontface, (int)fontsize);
+   if (gc->insym) gc->symfont = 1;
 
 }
 
@@ -486,20 +516,286 @@ void CPLT_set_linestyle_EPS(CPLT_gc_t gc, const CPLT_lnstyle_t s) {
 
 }
 
+/*
+ *******************************************************************************
+ */
+
+int CPLT_define_symbol_EPS(CPLT_gc_t gc, const int id) {
+   /* Starts the definition of symbol id, returns 0 or -1 on error.
+    * here EPS: opens the procedure Sym<id>, which the interpreter only
+    * executes when the symbol is placed. It starts with the attributes
+    * set so far, as the symbol is to be drawn with them, not with those
+    * current at its placement. */
+
+   if (gc == NULL) return -1;
+   if (gc->insym) {
+      fprintf(stderr, " *** CPlotter: symbols must not be nested!\n");
+      return -1;
+   }
+
+   fprintf(gc->fp, "/Sym%d {\n", id);
+   _set_state_EPS(gc);
+   gc->insym = 1;
+
+   return 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_end_symbol_EPS(CPLT_gc_t gc) {
+   /* Ends the definition of the current symbol.
+    * here EPS: closes and binds the procedure. Its definition didn't
+    * change the interpreter's state, so the attributes set last in it
+    * are set again, to stay current as they do in the other formats. */
+
+   if (gc == NULL || !gc->insym) return;
+
+   fprintf(gc->fp, "} bind def\n");
+   gc->insym = 0;
+   _set_state_EPS(gc);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_place_symbol_EPS(CPLT_gc_t gc, const int id,
+                           const float x, const float y,
+                           const float scale, const float angle) {
+   /* Plots symbol id with its reference point at x/y, scaled by scale
+    * and turned by angle degrees counterclockwise.
+    * here EPS: calls the procedure Sym<id> between gsave and grestore,
+    * in coords moved, turned and scaled to the placement, so the
+    * attributes it sets don't outlast it; but for the character height
+    * FH of the font, calculated anew if a symbol sets the fontsize */
+
+   if (gc == NULL) return;
+
+   fprintf(gc->fp, "g %.2lf %.2lf t", x, y);
+   if (fabs(angle) > _EPS) fprintf(gc->fp, " %.4lf r", angle);
+   if (fabs(scale - 1.) > _EPS) fprintf(gc->fp, " %.4lf dup scale", scale);
+   fprintf(gc->fp, " Sym%d G%s\n", id, gc->symfont ? " calc_FH" : "");
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+int CPLT_draw_branching_EPS(CPLT_gc_t gc, const float x, const float y,
+                            const float angle, const float len,
+                            const float step, const float scale,
+                            const int depth, const float widths[],
+                            const float colors[][2][3]) {
+   /* Plots a binary branching from x/y, depth+1 levels deep, see
+    * CPLT_draw_branching(), returns 0.
+    * here EPS: calls the recursive procedure BR of the prolog, with the
+    * linewidths and colors of the levels, so the plotfile only grows
+    * with the depth, not with the number of branches. The interpreter
+    * expands the branching in coords scaled to the branches' length,
+    * hence the linewidths are divided by it; the current color and
+    * linewidth are restored afterwards. */
+
+   int j;
+   double l = len;
+
+   if (gc == NULL) return -1;
+   if (depth < 0) return 0;
+
+   fprintf(gc->fp, "%.2lf %.2lf %.4lf %.4lf %.4lf %.4lf %d\n",
+           x, y, angle, len, step, scale, depth);
+   fprintf(gc->fp, "[");
+   for (j = 0; j <= depth; j++, l *= scale)
+      fprintf(gc->fp, "%s%.4lf", j % 8 ? " " : "\n", widths[j] / l);
+   fprintf(gc->fp, "]\n[");
+   for (j = 0; j <= depth; j++)
+      fprintf(gc->fp, "\n[[%.3lf %.3lf %.3lf] [%.3lf %.3lf %.3lf]]",
+              colors[j][0][0], colors[j][0][1], colors[j][0][2],
+              colors[j][1][0], colors[j][1][1], colors[j][1][2]);
+   fprintf(gc->fp, "]\nBR\n");
+
+   return 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_draw_segments_EPS(CPLT_gc_t gc, const int n,
+                            const CPLT_point_t segments[],
+                            const float widths[], const float colors[][3]) {
+   /* Plots n straight line segments at once, segment i from segments[2*i]
+    * to segments[2*i+1], with linewidth widths[i] [pix] and color
+    * colors[i] (RGB values [0,1]), or the current linewidth or color for
+    * all if widths or colors is NULL, and the current linestyle.
+    * The current color and linewidth are not changed.
+    * here EPS: one SG per segment inside gsave/grestore, color and
+    * linewidth are only set where they change */
+
+   int i;
+
+   if (gc == NULL) return;
+   if (n <= 0) return;
+
+   fprintf(gc->fp, "g\n");
+   for (i = 0; i < n; i++) {
+      if (colors != NULL &&
+          (i == 0 || !_same_color(colors[i], colors[i - 1]))) {
+         CPLT_set_color_EPS(gc, colors[i][0], colors[i][1], colors[i][2]);
+      }
+      if (widths != NULL && (i == 0 || widths[i] != widths[i - 1])) {
+         CPLT_set_linewidth_EPS(gc, widths[i]);
+      }
+      fprintf(gc->fp, "%.2lf %.2lf %.2lf %.2lf SG\n",
+              segments[2 * i].x, segments[2 * i].y,
+              segments[2 * i + 1].x, segments[2 * i + 1].y);
+   }
+   fprintf(gc->fp, "G\n");
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_begin_EPS(CPLT_gc_t gc) {
+   /* Begins a path, streamed point by point by CPLT_path_moveto() and
+    * CPLT_path_lineto() to the graphics format.
+    * here EPS: new path, built up by the interpreter */
+
+   if (gc == NULL) return;
+
+   fprintf(gc->fp, "n\n");
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_moveto_EPS(CPLT_gc_t gc, const float x, const float y) {
+   /* Begins a new subpath of the path at x/y. */
+
+   if (gc == NULL) return;
+
+   fprintf(gc->fp, "%.2lf %.2lf m\n", x, y);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_lineto_EPS(CPLT_gc_t gc, const float x, const float y) {
+   /* Appends a straight line from the current point to x/y to the
+    * subpath. */
+
+   if (gc == NULL) return;
+
+   fprintf(gc->fp, "%.2lf %.2lf l\n", x, y);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_stroke_EPS(CPLT_gc_t gc) {
+   /* Ends the path, drawn as lines with current color and
+    * linewidth/style. */
+
+   if (gc == NULL) return;
+
+   fprintf(gc->fp, "s\n");
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_fill_EPS(CPLT_gc_t gc) {
+   /* Ends the path: closes the current subpath, fills the area enclosed
+    * by all subpaths (nonzero winding) and strokes it, with current
+    * color.
+    * here EPS: as CPLT_draw_filledPolygon_EPS() */
+
+   if (gc == NULL) return;
+
+   fprintf(gc->fp, "p g f G s\n");
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_push_transform_EPS(CPLT_gc_t gc) {
+   /* Saves the current transform of the coords on a stack, to be
+    * restored by the matching CPLT_pop_transform().
+    * here EPS: the interpreter's current matrix is left on the operand
+    * stack, as by the branching's B1, since gsave would save (and
+    * grestore restore) the color, linewidth etc. too */
+
+   if (gc == NULL) return;
+
+   fprintf(gc->fp, "matrix currentmatrix\n");
+   gc->ntrans++;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_pop_transform_EPS(CPLT_gc_t gc) {
+   /* Restores the transform saved by the last CPLT_push_transform() not
+    * popped yet, if any.
+    * here EPS: sets the matrix left on the operand stack */
+
+   if (gc == NULL || gc->ntrans == 0) return;
+
+   fprintf(gc->fp, "setmatrix\n");
+   gc->ntrans--;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_concat_matrix_EPS(CPLT_gc_t gc, const float a, const float b,
+                            const float c, const float d,
+                            const float e, const float f) {
+   /* Concatenates the matrix [a b c d e f] to the current transform.
+    * here EPS: concatenated by the interpreter, whose coords are ours */
+
+   if (gc == NULL) return;
+
+   fprintf(gc->fp, "[%.6lf %.6lf %.6lf %.6lf %.2lf %.2lf] concat\n",
+           a, b, c, d, e, f);
+
+}
+
 /*
  *******************************************************************************
  */
 
 void CPLT_finish_graphics_EPS(CPLT_gc_t gc) {
    /* Finishes graphics, closes plotfile, destroys graphics context.
-    * here EPS: writes EPS-trailer to and closes plotfile */
+    * here EPS: writes EPS-trailer to plotfile, closed by the caller */
 
    if (gc == NULL) return;
 
+   /* leave the operand stack clean */
+   CPLT_end_symbol_EPS(gc);
+   while (gc->ntrans > 0) CPLT_pop_transform_EPS(gc);
+
    fprintf(gc->fp, "\nshowpage\n%%%%EOF\n");
-   fclose(gc->fp);
 
-   free(gc->dispatch);
    free(gc);
 
 }
@@ -524,38 +820,60 @@ void _create_poly_EPS(CPLT_gc_t gc, int numpts, CPLT_point_t points[]) {
 }
 
 /*
- *******************************************************************************
- * management function to assemble the dispatch table/struct
- * for the generic callers
  *******************************************************************************
  */
 
-CPLT_funcn_t *_get_dispatchFuncs_EPS(void) {
+void _set_state_EPS(CPLT_gc_t gc) {
+   /* internal helper func to write the attributes as last set through
+    * the generic API, those never set are the prolog's */
 
-   CPLT_funcn_t *dpt = (CPLT_funcn_t *) malloc(sizeof(*dpt));
-   if (dpt == NULL) {
-      fprintf(stderr, " *** Not enough memory for dispatch table!\n");
-      return NULL;
-   }
+   const CPLT_state_t *st = &gc->state;
+
+   if (st->col[0] >= 0.) CPLT_set_color_EPS(gc, st->col[0], st->col[1],
+                                            st->col[2]);
+   if (st->lwd >= 0.) CPLT_set_linewidth_EPS(gc, st->lwd);
+   if (st->lsty >= 0) CPLT_set_linestyle_EPS(gc, st->lsty);
+   if (st->fsize >= 0.) CPLT_set_fontsize_EPS(gc, st->fsize);
 
-   dpt->INIT  = &CPLT_init_graphics_EPS;
-   dpt->PLINE = &CPLT_draw_polyline_EPS;
-   dpt->PGON  = &CPLT_draw_polygon_EPS;
-   dpt->PGONF = &CPLT_draw_filledPolygon_EPS;
-   dpt->ARC   = &CPLT_draw_arc_EPS;
-   dpt->ARCF  = &CPLT_draw_filledArc_EPS;
-   dpt->CURVE = &CPLT_draw_curve_EPS;
-   dpt->MARK  = &CPLT_draw_marker_EPS;
-   dpt->TEXT  = &CPLT_draw_text_EPS;
-   dpt->FSIZE = &CPLT_set_fontsize_EPS;
-   dpt->COLR  = &CPLT_set_color_EPS;
-   dpt->LNWD  = &CPLT_set_linewidth_EPS;
-   dpt->LNSTY = &CPLT_set_linestyle_EPS;
-   dpt->FINI  = &CPLT_finish_graphics_EPS;
-
-   return dpt;
 }
 
+/*
+ *******************************************************************************
+ * dispatch table of the format's functions for the generic callers
+ *******************************************************************************
+ */
+
+const CPLT_funcn_t CPLT_dispatch_EPS = {
+   .INIT  = &CPLT_init_graphics_EPS,
+   .PLINE = &CPLT_draw_polyline_EPS,
+   .SEGS  = &CPLT_draw_segments_EPS,
+   .PGON  = &CPLT_draw_polygon_EPS,
+   .PGONF = &CPLT_draw_filledPolygon_EPS,
+   .ARC   = &CPLT_draw_arc_EPS,
+   .ARCF  = &CPLT_draw_filledArc_EPS,
+   .CURVE = &CPLT_draw_curve_EPS,
+   .MARK  = &CPLT_draw_marker_EPS,
+   .TEXT  = &CPLT_draw_text_EPS,
+   .FSIZE = &CPLT_set_fontsize_EPS,
+   .COLR  = &CPLT_set_color_EPS,
+   .LNWD  = &CPLT_set_linewidth_EPS,
+   .LNSTY = &CPLT_set_linestyle_EPS,
+   .FINI  = &CPLT_finish_graphics_EPS,
+   .SYMD  = &CPLT_define_symbol_EPS,
+   .SYME  = &CPLT_end_symbol_EPS,
+   .SYMP  = &CPLT_place_symbol_EPS,
+   .BRNCH = &CPLT_draw_branching_EPS,
+   .REPL  = NULL,   /* no recording */
+   .PATHB = &CPLT_path_begin_EPS,
+   .MOVE  = &CPLT_path_moveto_EPS,
+   .LINE  = &CPLT_path_lineto_EPS,
+   .STROKE = &CPLT_path_stroke_EPS,
+   .FILL  = &CPLT_path_fill_EPS,
+   .PUSH  = &CPLT_push_transform_EPS,
+   .POP   = &CPLT_pop_transform_EPS,
+   .CONCAT = &CPLT_concat_matrix_EPS,
+};
+
 /*
  *******************************************************************************
  */
@@ -18,6 +18,7 @@
 #include <ftw.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include <gd.h>
 
@@ -28,30 +29,86 @@
 #define USE_FDS 15
 #endif
 
-/* list of relevant fonts found installed */
+/* points of a streamed path drawn at once, the last one is kept */
+#define PATHCHUNK 256
+
+/* list of relevant fonts found installed, by the font discovery,
+ * which runs once per process, whatever thread calls first */
 #define MAXFONTS 16
 typedef struct {
    char *ttf;
    int prio;
 } font_t;
-font_t fonts[MAXFONTS];
-unsigned int numfonts = 0;
+static font_t fonts[MAXFONTS];
+static unsigned int numfonts = 0;
+static pthread_once_t fonts_once = PTHREAD_ONCE_INIT;
+
+/* a symbol pre-rasterized: the color of each pixel premultiplied by its
+ * alpha, i.e. coverage, all [0,255] */
+typedef struct {
+   int w, h;               /* size [pix], 0 if not defined */
+   int ox, oy;             /* its reference point [pix] */
+   unsigned char *px;      /* w x h pixels of r, g, b, alpha */
+} _sprite_t;
 
 /* graphics context */
 struct CPLT_gctx {
-   CPLT_funcn_t *dispatch; /* functions dispatch table */
+   const CPLT_funcn_t *dispatch; /* functions dispatch table */
    FILE *fp;               /* filepointer */
+   char *fpbuf;            /* fp's buffer, if not stdio's own */
+   CPLT_state_t state;     /* as set by the generic API */
+   CPLT_view_t view;       /* culled by the generic API */
+#ifdef CPLT_STATS
+   CPLT_stats_t stats;     /* counted by the generic API */
+#endif
    unsigned int pheight;   /* image's height [pix] */
    float curfontsize;      /* current GD-fontsize [pix] */
    CPLT_lnstyle_t curlsty; /* current linestyle [enumeration]*/
+   float curlwd;           /* current linewidth [pix] */
    int bgcol;              /* image's background color */
    int curcol;             /* current color/style */
    int colidx;             /* current color-index */
    gdImagePtr img;         /* pointer to GD in-memory image */
+   CPLT_arena_t scratch;   /* memory of the GD-points of a drawing call */
+   unsigned int pwidth;    /* image's width [pix] */
+   gdPoint path[PATHCHUNK];   /* streamed path: points not yet drawn */
+   int npath;              /* their number, 0: no current point */
+   gdPoint first;          /* first point of the subpath */
+   CPLT_point_t start;     /* first point of the subpath (cover coords) */
+   CPLT_point_t cur;       /* current point (cover coords) */
+   float *cover;           /* signed area of the path per pixel, or NULL */
+   int covy0, covy1;       /* rows of cover touched */
+   double tm[6];           /* current transform fused with y-inversion */
+   float tscale;           /* its mean scale, of linewidths and sizes */
+   double (*trans)[6];     /* transforms saved by CPLT_push_transform() */
+   int ntrans, maxtrans;   /* pushed, not popped yet, and room of trans */
+   gdImagePtr page;        /* the image, while a symbol is defined */
+   gdImagePtr canvas[2];   /* a symbol drawn on white and on black */
+   int both;               /* if a call draws to both canvases */
+   int sym;                /* id of the symbol defined */
+   int dirty[4];           /* canvases' rect drawn to: x0, y0, x1, y1 */
+   double pagetm[6];       /* the image's transform, while defining */
+   _sprite_t *sprites;     /* symbols pre-rasterized, by id */
+   int nsprites;           /* room of sprites */
 };
 
+/* while a symbol is defined, a drawing call is made on both canvases:
+ * on the black one first, then on the white one, and returns, the calls
+ * it makes drawing to the canvas at hand only */
+#define ON_CANVASES(gc, call) \
+   if ((gc)->page != NULL && !(gc)->both) { \
+      (gc)->both = 1; \
+      (gc)->img = (gc)->canvas[1]; \
+      call; \
+      (gc)->img = (gc)->canvas[0]; \
+      call; \
+      (gc)->both = 0; \
+      return; \
+   }
+
 
 /* global constants */
+static const float _EPS = 1.0E-5;   /* epsilon to 0 */
 /* List of start directories for recursive search for TT-fonts.
  * NOTE: if these dirs are not utilized by libpng/libfreetype2,
  * it makes no sense to list them here! */
@@ -60,19 +117,35 @@ static const char *fontdirs[] = {
    "/usr/local/share/fonts/truetype",
 };
 
-/* FT-fontface (*.ttf) used by string drawing */
+/* FT-fontface (*.ttf) used by string drawing, set by the font discovery,
+ * read-only afterwards */
 static char *fontface = NULL;    /* prelim. */
 
 /* prototypes of internal helper functions */
 gdPoint *_create_poly_PNG(CPLT_gc_t gc, int numpts, CPLT_point_t points[]);
+CPLT_point_t _map_PNG(CPLT_gc_t gc, const float x, const float y);
+void _transformed_PNG(CPLT_gc_t gc);
+void _attributes_PNG(CPLT_gc_t gc);
+void _touch_PNG(CPLT_gc_t gc, const float x, const float y, const float r);
 gdPoint _rotate_vec_PNG(const float x, const float y, const float angle);
 int _is_flat_bezier(CPLT_point_t points[]);
 void _subdivide_bezier(CPLT_point_t p[], CPLT_point_t l[], CPLT_point_t r[]);
 void _approx_bezier(CPLT_gc_t gc, CPLT_point_t points[]);
 void _set_coloredDash(CPLT_gc_t gc, const int colidx,
                       const CPLT_lnstyle_t style);
-CPLT_funcn_t *_get_dispatchFuncs_PNG(void);
-
+void _stroke_path_PNG(CPLT_gc_t gc);
+void _draw_path_PNG(CPLT_gc_t gc);
+void _cover_line_PNG(CPLT_gc_t gc, CPLT_point_t p0, CPLT_point_t p1);
+void _fill_cover_PNG(CPLT_gc_t gc, const int paint);
+void _paint_cover_PNG(CPLT_gc_t gc);
+void _cut_sprite_PNG(CPLT_gc_t gc, _sprite_t *s);
+void _blit_PNG(CPLT_gc_t gc, const _sprite_t *s, const int x0, const int y0);
+void _blit_mapped_PNG(CPLT_gc_t gc, const _sprite_t *s, CPLT_point_t ref,
+                      const double m[4]);
+void _blend_PNG(CPLT_gc_t gc, const int x, const int y,
+                int r, int g, int b, const int a);
+
+void _discover_fonts(void);
 char *_get_TTfontface(void);
 int _examine_directory_tree(const char *dirpath);
 int _examine_entry(const char *filepath, const struct stat *info,
@@ -87,10 +160,10 @@ int _cmp_by_prio(const void *f1, const void *f2);
 
 CPLT_gc_t CPLT_init_graphics_PNG(const unsigned int pwidth,
                                  const unsigned int pheight,
-                                 char *plotfilename) {
-   /* Initializes graphics of pwidth x pheight [pix] in graphics file
-    * plotfilename, returns graphics-context pointer.
-    * here GD/PNG: opens PNG-file, initializes image */
+                                 char *plotfilename, FILE *fp) {
+   /* Initializes graphics of pwidth x pheight [pix] named plotfilename,
+    * written to the opened fp, returns graphics-context pointer.
+    * here GD/PNG: initializes image */
 
    /* allocate memory for graphics context's data-struct */
    CPLT_gc_t gc = (CPLT_gc_t) malloc(sizeof(*gc));
@@ -98,13 +171,12 @@ CPLT_gc_t CPLT_init_graphics_PNG(const unsigned int pwidth,
       fprintf(stderr, " *** Not enough memory for graphics context!\n");
       return NULL;
    }
+   _unknown_state(&gc->state);
+   _init_view(&gc->view, pwidth, pheight);
 
-   /* open PNG-plotfile */
-   if ((gc->fp = fopen(plotfilename, "wb")) == NULL) {
-      fprintf(stderr,
-              " *** Can't open output image '%s'!\n", plotfilename);
-      return NULL;
-   }
+   gc->fp = fp;
+   gc->scratch.used = 0;
+   gc->scratch.chunk = NULL;
 
    /* create (empty) in-memory image */
    if ((gc->img = gdImageCreateTrueColor(pwidth, pheight)) == NULL) {
@@ -113,6 +185,23 @@ CPLT_gc_t CPLT_init_graphics_PNG(const unsigned int pwidth,
       return NULL;
    }
    gc->pheight = pheight;     /* save image height for y-inversion */
+   gc->pwidth = pwidth;
+   gc->npath = 0;
+   gc->cover = NULL;
+
+   /* identity transform, i.e. only y-inverted */
+   gc->tm[0] = 1.;  gc->tm[2] = 0.;  gc->tm[4] = 0.;
+   gc->tm[1] = 0.;  gc->tm[3] = -1.; gc->tm[5] = pheight;
+   gc->tscale = 1.;
+   gc->trans = NULL;
+   gc->ntrans = gc->maxtrans = 0;
+
+   /* no symbols yet */
+   gc->page = NULL;
+   gc->canvas[0] = gc->canvas[1] = NULL;
+   gc->both = 0;
+   gc->sprites = NULL;
+   gc->nsprites = 0;
 
    /* default colors */
    gc->bgcol = gdImageColorAllocate(gc->img, 255, 255, 255);   /* white */
@@ -123,16 +212,18 @@ CPLT_gc_t CPLT_init_graphics_PNG(const unsigned int pwidth,
    /* fill whole true-color image with white as background */
    gdImageFilledRectangle(gc->img, 0, 0, pwidth, pheight, gc->bgcol);
 
-   /* identify usable TTFont */
-   if (!fontface) fontface = _get_TTfontface();
+   /* identify usable TTFont, once for all threads */
+   pthread_once(&fonts_once, &_discover_fonts);
 #ifdef DEBUG
    fprintf(stderr, " +++ DEBUG CPLT_PNG: using fontface '%s'\n", fontface);
 #endif
    gc->curfontsize = 12.;
+   gc->curlsty = CPLT_SolidLine;
+   gc->curlwd = 1.;
    gdImageSetThickness(gc->img, 1);
 
    /* register dispatch table of our functions for generic callers */
-   gc->dispatch = _get_dispatchFuncs_PNG();
+   gc->dispatch = &CPLT_dispatch_PNG;
 
    return gc;
 }
@@ -150,6 +241,7 @@ void CPLT_draw_polyline_PNG(CPLT_gc_t gc, int numpts,
 
    if (gc == NULL) return;
    if (numpts <= 1) return;
+   ON_CANVASES(gc, CPLT_draw_polyline_PNG(gc, numpts, points));
 
    GDpoints = _create_poly_PNG(gc, numpts, points);
    if (GDpoints == NULL) return;
@@ -161,7 +253,7 @@ void CPLT_draw_polyline_PNG(CPLT_gc_t gc, int numpts,
                   GDpoints[0].x, GDpoints[0].y, GDpoints[1].x, GDpoints[1].y,
                   gc->curcol);
    }
-   free(GDpoints);
+   _arena_reset(&gc->scratch);
 
 }
 
@@ -179,12 +271,13 @@ void CPLT_draw_polygon_PNG(CPLT_gc_t gc, int numpts,
 
    if (gc == NULL) return;
    if (numpts <= 1) return;
+   ON_CANVASES(gc, CPLT_draw_polygon_PNG(gc, numpts, points));
 
    GDpoints = _create_poly_PNG(gc, numpts, points);
    if (GDpoints == NULL) return;
 
    gdImagePolygon(gc->img, GDpoints, numpts, gc->curcol);
-   free(GDpoints);
+   _arena_reset(&gc->scratch);
 
 }
 
@@ -203,13 +296,14 @@ void CPLT_draw_filledPolygon_PNG(CPLT_gc_t gc, int numpts,
 
    if (gc == NULL) return;
    if (numpts <= 1) return;
+   ON_CANVASES(gc, CPLT_draw_filledPolygon_PNG(gc, numpts, points));
 
    GDpoints = _create_poly_PNG(gc, numpts, points);
    if (GDpoints == NULL) return;
 
    gdImageFilledPolygon(gc->img, GDpoints, numpts, gc->colidx);
    gdImagePolygon(gc->img, GDpoints, numpts, gdAntiAliased);
-   free(GDpoints);
+   _arena_reset(&gc->scratch);
 
 }
 
@@ -228,11 +322,18 @@ void CPLT_draw_arc_PNG(CPLT_gc_t gc, const float cx, const float cy,
     * Both angles turn counterclockwise, i.e. mathematically positive.
     * Draws outline of the arc with current color and linewidth/style. */
 
+   CPLT_point_t c;
+   float d, rot;
+
    if (gc == NULL) return;
+   ON_CANVASES(gc, CPLT_draw_arc_PNG(gc, cx, cy, radius, start, end));
 
-   gdImageArc(gc->img, (int)cx, (int)(gc->pheight - cy),
-              (int)(2 * radius), (int)(2 * radius),
-              (int)(360 - end), (int)(360 - start), gc->curcol);
+   c = _map_PNG(gc, cx, cy);
+   d = 2 * radius * gc->tscale;
+   rot = atan2(-gc->tm[1], gc->tm[0]) * RAD2DEG;
+   _touch_PNG(gc, c.x, c.y, 0.5 * d + gc->curlwd * gc->tscale);
+   gdImageArc(gc->img, (int)c.x, (int)c.y, (int)d, (int)d,
+              (int)(360 - end - rot), (int)(360 - start - rot), gc->curcol);
 
 }
 
@@ -252,14 +353,22 @@ void CPLT_draw_filledArc_PNG(CPLT_gc_t gc, const float cx, const float cy,
     * Both angles turn counterclockwise, i.e. mathematically positive.
     * Fills + strokes the arc/"pie slice" with current color. */
 
-   if (gc == NULL) return;
+   CPLT_point_t c;
+   float d, rot;
 
-   gdImageFilledArc(gc->img, (int)cx, (int)(gc->pheight - cy),
-                    (int)(2 * radius), (int)(2 * radius),
-                    (int)(360 - end), (int)(360 - start), gc->colidx, gdArc);
-   gdImageArc(gc->img, (int)cx, (int)(gc->pheight - cy),
-              (int)(2 * radius), (int)(2 * radius),
-              (int)(360 - end), (int)(360 - start), gdAntiAliased);
+   if (gc == NULL) return;
+   ON_CANVASES(gc, CPLT_draw_filledArc_PNG(gc, cx, cy, radius, start, end));
+
+   c = _map_PNG(gc, cx, cy);
+   d = 2 * radius * gc->tscale;
+   rot = atan2(-gc->tm[1], gc->tm[0]) * RAD2DEG;
+   _touch_PNG(gc, c.x, c.y, 0.5 * d + gc->curlwd * gc->tscale);
+   gdImageFilledArc(gc->img, (int)c.x, (int)c.y, (int)d, (int)d,
+                    (int)(360 - end - rot), (int)(360 - start - rot),
+                    gc->colidx, gdArc);
+   gdImageArc(gc->img, (int)c.x, (int)c.y, (int)d, (int)d,
+              (int)(360 - end - rot), (int)(360 - start - rot),
+              gdAntiAliased);
 
 }
 
@@ -301,14 +410,18 @@ void CPLT_draw_marker_PNG(CPLT_gc_t gc, const float cx, const float cy,
     */
 
    gdPoint GDpoints[4];
+   CPLT_point_t c;
    int x, y, w;
 
    if (gc == NULL) return;
+   ON_CANVASES(gc, CPLT_draw_marker_PNG(gc, cx, cy, wd, symbol));
 
-   x = _rnd(cx);
-   y = _rnd(gc->pheight - cy);
-   w = _rnd(0.5 * wd);
+   c = _map_PNG(gc, cx, cy);
+   x = _rnd(c.x);
+   y = _rnd(c.y);
+   w = _rnd(0.5 * wd * gc->tscale);
    if (w < 1) return;
+   _touch_PNG(gc, x, y, w + gc->curlwd * gc->tscale);
 
    switch (symbol) {
       case 1:        /* + */
@@ -324,7 +437,8 @@ void CPLT_draw_marker_PNG(CPLT_gc_t gc, const float cx, const float cy,
          break;
 
       case 3:        /* circle */
-         gdImageArc(gc->img, x, y, (int)wd, (int)wd, 0, 360, gdAntiAliased);
+         gdImageArc(gc->img, x, y, (int)(wd * gc->tscale),
+                    (int)(wd * gc->tscale), 0, 360, gdAntiAliased);
          gdImageLine(gc->img, x, y + w, x, y, gdAntiAliased);
          break;
 
@@ -404,19 +518,26 @@ void CPLT_draw_text_PNG(CPLT_gc_t gc, const float x, const float y,
     *    sw--------s--------se
     */
 
-   float dx, dy;
+   float dx, dy, size;
    int i, anchor_num, brect[8], w, h, xp, yp;
    char *err;
    gdPoint p;
+   CPLT_point_t xy;
 
    if (gc == NULL) return;
+   ON_CANVASES(gc, CPLT_draw_text_PNG(gc, x, y, anchor, angle, text));
    anchor_num = _anchor_num_of(anchor);
    if (anchor_num == 0) anchor_num = 1;
 
+   /* the transform turns and scales the text as a whole */
+   xy = _map_PNG(gc, x, y);
+   angle += atan2(-gc->tm[1], gc->tm[0]) * RAD2DEG;
+   size = gc->curfontsize * gc->tscale;
+
    /* first obtain enclosing rectangle in brect w/o rendering
     * so that we can anchor the string */
    err = gdImageStringFT(NULL, brect, 0, fontface,
-                         gc->curfontsize, 0.0, 0, 0, text);
+                         size, 0.0, 0, 0, text);
    if (err) { fprintf(stderr, " *** libgd error: %s\n", err); return; }
 
    for (i = 1; i < 8; i += 2) brect[i] *= -1;   /* invert y for calc */
@@ -463,13 +584,14 @@ void CPLT_draw_text_PNG(CPLT_gc_t gc, const float x, const float y,
    }
 
    p = _rotate_vec_PNG(dx, dy, angle);
-   xp =                x + p.x;
-   yp = gc->pheight - (y - p.y);
+   xp = xy.x + p.x;
+   yp = xy.y + p.y;
 
    /* now render the anchored, rotated string */
    err = gdImageStringFT(gc->img, brect, gc->colidx, fontface,
-                         gc->curfontsize, angle * DEG2RAD, xp, yp, text);
+                         size, angle * DEG2RAD, xp, yp, text);
    if (err) fprintf(stderr, " *** libgd error: %s\n", err);
+   else for (i = 0; i < 8; i += 2) _touch_PNG(gc, brect[i], brect[i + 1], 1.);
 
 }
 
@@ -497,6 +619,7 @@ void CPLT_set_color_PNG(CPLT_gc_t gc, float r, float g, float b) {
     * here GD/PNG: maybe combined with current line dash pattern */
 
    if (gc == NULL) return;
+   ON_CANVASES(gc, CPLT_set_color_PNG(gc, r, g, b));
 
    r = r < 0. ? 0. : r > 1. ? 1. : r;
    g = g < 0. ? 0. : g > 1. ? 1. : g;
@@ -526,8 +649,10 @@ void CPLT_set_linewidth_PNG(CPLT_gc_t gc, const float w) {
    int p;
 
    if (gc == NULL) return;
+   ON_CANVASES(gc, CPLT_set_linewidth_PNG(gc, w));
 
-   p = _rnd(w);
+   gc->curlwd = w;
+   p = _rnd(w * gc->tscale);
    gdImageSetThickness(gc->img, (p < 1 ? 1 : p));
 
 }
@@ -542,6 +667,7 @@ void CPLT_set_linestyle_PNG(CPLT_gc_t gc, const CPLT_lnstyle_t s) {
     * here GD/PNG: maybe combined with current color */
 
    if (gc == NULL) return;
+   ON_CANVASES(gc, CPLT_set_linestyle_PNG(gc, s));
 
    gc->curlsty = s;
    if (gc->curlsty == CPLT_SolidLine) {
@@ -553,24 +679,409 @@ void CPLT_set_linestyle_PNG(CPLT_gc_t gc, const CPLT_lnstyle_t s) {
 
 }
 
+/*
+ *******************************************************************************
+ */
+
+void CPLT_draw_segments_PNG(CPLT_gc_t gc, const int n,
+                            const CPLT_point_t segments[],
+                            const float widths[], const float colors[][3]) {
+   /* Plots n straight line segments at once, segment i from segments[2*i]
+    * to segments[2*i+1], with linewidth widths[i] [pix] and color
+    * colors[i] (RGB values [0,1]), or the current linewidth or color for
+    * all if widths or colors is NULL, and the current linestyle.
+    * The current color and linewidth are not changed.
+    * here GD/PNG: the lines are drawn w/o a point array each, the color
+    * is resolved and the thickness set only where they change */
+
+   int colidx;             /* saved current color-index */
+   float lwd;              /* saved current linewidth */
+   CPLT_point_t p0, p1;
+   int i;
+
+   if (gc == NULL) return;
+   if (n <= 0) return;
+   ON_CANVASES(gc, CPLT_draw_segments_PNG(gc, n, segments, widths, colors));
+
+   colidx = gc->colidx;
+   lwd = gc->curlwd;
+
+   for (i = 0; i < n; i++) {
+      if (colors != NULL &&
+          (i == 0 || !_same_color(colors[i], colors[i - 1]))) {
+         CPLT_set_color_PNG(gc, colors[i][0], colors[i][1], colors[i][2]);
+      }
+      if (widths != NULL && (i == 0 || widths[i] != widths[i - 1])) {
+         CPLT_set_linewidth_PNG(gc, widths[i]);
+      }
+      p0 = _map_PNG(gc, segments[2 * i].x, segments[2 * i].y);
+      p1 = _map_PNG(gc, segments[2 * i + 1].x, segments[2 * i + 1].y);
+      gdImageLine(gc->img, _rnd(p0.x), _rnd(p0.y), _rnd(p1.x), _rnd(p1.y),
+                  gc->curcol);
+   }
+
+   /* restore current color and linewidth */
+   if (colors != NULL) {
+      gc->colidx = colidx;
+      gdImageSetAntiAliased(gc->img, gc->colidx);
+      if (gc->curlsty != CPLT_SolidLine)
+         _set_coloredDash(gc, gdAntiAliased, gc->curlsty);
+   }
+   if (widths != NULL) CPLT_set_linewidth_PNG(gc, lwd);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_begin_PNG(CPLT_gc_t gc) {
+   /* Begins a path, streamed point by point by CPLT_path_moveto() and
+    * CPLT_path_lineto() to the graphics format.
+    * here GD/PNG: chunked, the lines are drawn PATHCHUNK points at once
+    * and the area enclosed is accumulated per pixel as it goes, both in
+    * memory independent of the number of points */
+
+   if (gc == NULL) return;
+
+   gc->npath = 0;
+   gc->covy0 = gc->pheight;
+   gc->covy1 = -1;
+   if (gc->cover == NULL)
+      gc->cover = (float *) calloc((size_t)(gc->pwidth + 2) * gc->pheight,
+                                   sizeof(float));
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_moveto_PNG(CPLT_gc_t gc, const float x, const float y) {
+   /* Begins a new subpath of the path at x/y. */
+
+   CPLT_point_t p;
+
+   if (gc == NULL) return;
+
+   /* the previous subpath's area is closed, as filling would */
+   if (gc->npath > 0) _cover_line_PNG(gc, gc->cur, gc->start);
+
+   _stroke_path_PNG(gc);
+   p = _map_PNG(gc, x, y);
+   gc->path[0].x = _rnd(p.x);
+   gc->path[0].y = _rnd(p.y);
+   gc->first = gc->path[0];
+   gc->npath = 1;
+
+   /* the area's pixels are centered at half coords */
+   gc->start.x = gc->cur.x = p.x + 0.5;
+   gc->start.y = gc->cur.y = p.y + 0.5;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_lineto_PNG(CPLT_gc_t gc, const float x, const float y) {
+   /* Appends a straight line from the current point to x/y to the
+    * subpath.
+    * here GD/PNG: without a current point, it begins a subpath */
+
+   CPLT_point_t p, c;
+
+   if (gc == NULL) return;
+   if (gc->npath == 0) {
+      CPLT_path_moveto_PNG(gc, x, y);
+      return;
+   }
+
+   p = _map_PNG(gc, x, y);
+   c.x = p.x + 0.5;
+   c.y = p.y + 0.5;
+   _cover_line_PNG(gc, gc->cur, c);
+   gc->cur = c;
+
+   gc->path[gc->npath].x = _rnd(p.x);
+   gc->path[gc->npath].y = _rnd(p.y);
+   if (++gc->npath == PATHCHUNK) _stroke_path_PNG(gc);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_stroke_PNG(CPLT_gc_t gc) {
+   /* Ends the path, drawn as lines with current color and
+    * linewidth/style. */
+
+   if (gc == NULL) return;
+
+   _stroke_path_PNG(gc);
+   gc->npath = 0;
+   _fill_cover_PNG(gc, 0);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_fill_PNG(CPLT_gc_t gc) {
+   /* Ends the path: closes the current subpath, fills the area enclosed
+    * by all subpaths (nonzero winding) and strokes it, with current
+    * color.
+    * here GD/PNG: the area is antialiased by its coverage of each pixel,
+    * the lines drawn before are of the same color */
+
+   if (gc == NULL) return;
+
+   if (gc->npath > 0) {   /* back to the first point */
+      _cover_line_PNG(gc, gc->cur, gc->start);
+      gc->path[gc->npath++] = gc->first;
+      _stroke_path_PNG(gc);
+      gc->npath = 0;
+   }
+   _fill_cover_PNG(gc, 1);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_push_transform_PNG(CPLT_gc_t gc) {
+   /* Saves the current transform of the coords on a stack, to be
+    * restored by the matching CPLT_pop_transform(). */
+
+   double (*t)[6];
+
+   if (gc == NULL) return;
+
+   if (gc->ntrans == gc->maxtrans) {
+      t = (double (*)[6]) realloc(gc->trans,
+                                  (2 * gc->maxtrans + 16) * sizeof(*t));
+      if (t == NULL) {
+         fprintf(stderr, " *** Not enough memory for transform stack!\n");
+         return;
+      }
+      gc->trans = t;
+      gc->maxtrans = 2 * gc->maxtrans + 16;
+   }
+   memcpy(gc->trans[gc->ntrans++], gc->tm, sizeof(gc->tm));
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_pop_transform_PNG(CPLT_gc_t gc) {
+   /* Restores the transform saved by the last CPLT_push_transform() not
+    * popped yet, if any. */
+
+   if (gc == NULL || gc->ntrans == 0) return;
+
+   memcpy(gc->tm, gc->trans[--gc->ntrans], sizeof(gc->tm));
+   _transformed_PNG(gc);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_concat_matrix_PNG(CPLT_gc_t gc, const float a, const float b,
+                            const float c, const float d,
+                            const float e, const float f) {
+   /* Concatenates the matrix [a b c d e f] to the current transform.
+    * here GD/PNG: fused into one matrix with the transforms before and
+    * the y-inversion, which maps each point to its pixel at once */
+
+   double *m;
+   double t[6];
+
+   if (gc == NULL) return;
+
+   m = gc->tm;
+   t[0] = m[0] * a + m[2] * b;
+   t[1] = m[1] * a + m[3] * b;
+   t[2] = m[0] * c + m[2] * d;
+   t[3] = m[1] * c + m[3] * d;
+   t[4] = m[0] * e + m[2] * f + m[4];
+   t[5] = m[1] * e + m[3] * f + m[5];
+   memcpy(m, t, sizeof(t));
+   _transformed_PNG(gc);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+int CPLT_define_symbol_PNG(CPLT_gc_t gc, const int id) {
+   /* Starts the definition of symbol id, returns 0 or -1 on error.
+    * here GD/PNG: the drawing calls up to CPLT_end_symbol() draw to two
+    * canvases instead of the image, twice its size each way with the
+    * symbol's reference point in the middle, one white, one black: as
+    * GD blends antialiased pixels with what is below, not keeping their
+    * coverage as alpha, the difference of the two canvases gives it. */
+
+   _sprite_t *s;
+   int i, w, h;
+
+   if (gc == NULL || id < 0) return -1;
+   if (gc->page != NULL) {
+      fprintf(stderr, " *** CPlotter: symbols must not be nested!\n");
+      return -1;
+   }
+
+   if (id >= gc->nsprites) {
+      s = (_sprite_t *) realloc(gc->sprites, (id + 1) * sizeof(*s));
+      if (s == NULL) {
+         fprintf(stderr, " *** Not enough memory for symbols!\n");
+         return -1;
+      }
+      for (i = gc->nsprites; i <= id; i++) {
+         s[i].w = s[i].h = 0;
+         s[i].px = NULL;
+      }
+      gc->sprites = s;
+      gc->nsprites = id + 1;
+   }
+
+   /* the canvases, kept for the next symbols, black when created */
+   w = 2 * gc->pwidth;
+   h = 2 * gc->pheight;
+   if (gc->canvas[0] == NULL) {
+      gc->canvas[0] = gdImageCreateTrueColor(w, h);
+      gc->canvas[1] = gdImageCreateTrueColor(w, h);
+      if (gc->canvas[0] == NULL || gc->canvas[1] == NULL) {
+         fprintf(stderr, " *** Can't create in-memory canvases!\n");
+         if (gc->canvas[0] != NULL) gdImageDestroy(gc->canvas[0]);
+         if (gc->canvas[1] != NULL) gdImageDestroy(gc->canvas[1]);
+         gc->canvas[0] = gc->canvas[1] = NULL;
+         return -1;
+      }
+      gdImageFilledRectangle(gc->canvas[0], 0, 0, w, h, gc->bgcol);
+   }
+
+   gc->sym = id;
+   gc->page = gc->img;
+   gc->img = gc->canvas[0];
+   gc->pwidth = w;
+   gc->pheight = h;
+   memcpy(gc->pagetm, gc->tm, sizeof(gc->tm));
+   gc->tm[0] = 1.;  gc->tm[2] = 0.;  gc->tm[4] = w / 2;
+   gc->tm[1] = 0.;  gc->tm[3] = -1.; gc->tm[5] = h / 2;
+   gc->dirty[0] = w;
+   gc->dirty[1] = h;
+   gc->dirty[2] = gc->dirty[3] = -1;
+   free(gc->cover);           /* sized to the image drawn to */
+   gc->cover = NULL;
+   _attributes_PNG(gc);
+
+   return 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_end_symbol_PNG(CPLT_gc_t gc) {
+   /* Ends the definition of the current symbol.
+    * here GD/PNG: cuts the pixels drawn to out of the canvases as the
+    * symbol's sprite, and clears them for the next symbol */
+
+   if (gc == NULL || gc->page == NULL) return;
+
+   _cut_sprite_PNG(gc, &gc->sprites[gc->sym]);
+
+   gc->img = gc->page;
+   gc->page = NULL;
+   gc->pwidth /= 2;
+   gc->pheight /= 2;
+   memcpy(gc->tm, gc->pagetm, sizeof(gc->tm));
+   free(gc->cover);
+   gc->cover = NULL;
+   _attributes_PNG(gc);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_place_symbol_PNG(CPLT_gc_t gc, const int id,
+                           const float x, const float y,
+                           const float scale, const float angle) {
+   /* Plots symbol id with its reference point at x/y, scaled by scale
+    * and turned by angle degrees counterclockwise.
+    * here GD/PNG: blends the symbol's sprite into the image, mapped by
+    * the current transform: only moved, pixel by pixel, else each pixel
+    * it covers samples it bilinearly, which blurs its lines a little,
+    * more so for sprites placed in sprites placed turned */
+
+   const _sprite_t *s;
+   CPLT_point_t ref;
+   double m[4], c, sn;
+
+   if (gc == NULL || id < 0 || id >= gc->nsprites) return;
+   s = &gc->sprites[id];
+   if (s->px == NULL) return;
+   ON_CANVASES(gc, CPLT_place_symbol_PNG(gc, id, x, y, scale, angle));
+
+   /* steps in the image per pixel of the sprite, along x and y */
+   c = scale * cos(angle * DEG2RAD);
+   sn = scale * sin(angle * DEG2RAD);
+   m[0] = gc->tm[0] * c + gc->tm[2] * sn;
+   m[1] = gc->tm[1] * c + gc->tm[3] * sn;
+   m[2] = gc->tm[0] * sn - gc->tm[2] * c;
+   m[3] = gc->tm[1] * sn - gc->tm[3] * c;
+   ref = _map_PNG(gc, x, y);
+
+   if (fabs(m[0] - 1.) < _EPS && fabs(m[1]) < _EPS &&
+       fabs(m[2]) < _EPS && fabs(m[3] - 1.) < _EPS) {
+      _blit_PNG(gc, s, _rnd(ref.x) - s->ox, _rnd(ref.y) - s->oy);
+   } else {
+      _blit_mapped_PNG(gc, s, ref, m);
+   }
+
+}
+
 /*
  *******************************************************************************
  */
 
 void CPLT_finish_graphics_PNG(CPLT_gc_t gc) {
    /* Finishes graphics, closes plotfile, destroys graphics context.
-    * here GD/PNG: writes PNG-image to and closes imgfile */
+    * here GD/PNG: writes PNG-image to imgfile, closed by the caller */
+
+   double t0;
+   int i;
 
    if (gc == NULL) return;
+   CPLT_end_symbol_PNG(gc);
 
    /* convert internal image to PNG and write it to file */
+   t0 = _trace_start();
    gdImagePng(gc->img, gc->fp);
+   _trace_end("PNG encode", t0);
 
-   /* close imgfile, free in-memory image data */
-   fclose(gc->fp);
+   /* free in-memory image data */
    gdImageDestroy(gc->img);
+   _arena_free(&gc->scratch);
+   free(gc->cover);
+   free(gc->trans);
+   if (gc->canvas[0] != NULL) {
+      gdImageDestroy(gc->canvas[0]);
+      gdImageDestroy(gc->canvas[1]);
+   }
+   for (i = 0; i < gc->nsprites; i++) free(gc->sprites[i].px);
+   free(gc->sprites);
 
-   free(gc->dispatch);
    free(gc);
 }
 
@@ -580,6 +1091,22 @@ void CPLT_finish_graphics_PNG(CPLT_gc_t gc) {
  *******************************************************************************
  */
 
+void _discover_fonts(void) {
+   /* Internal helper func to set up FreeType's font cache and the
+    * fontface, called once by pthread_once(): afterwards the fonts are
+    * read-only and libgd's cache is guarded by its own mutex */
+
+   double t0 = _trace_start();
+
+   gdFontCacheSetup();
+   fontface = _get_TTfontface();
+   _trace_end("font discovery", t0);
+}
+
+/*
+ *******************************************************************************
+ */
+
 char *_get_TTfontface(void) {
    /* Internal helper func to get a TrueType-fontface
     * from installed font files */
@@ -722,11 +1249,13 @@ int _cmp_by_prio(const void *f1, const void *f2) {
 
 gdPoint *_create_poly_PNG(CPLT_gc_t gc, int numpts, CPLT_point_t points[]) {
    /* internal helper func to assemble gdPoint array of polygon-points
-    * from array points.
-    * caller must free() returned array! */
+    * from array points, in the scratch memory of gc.
+    * caller must _arena_reset() it when done! */
 
    int i;
-   gdPoint *GDpoints = (gdPoint *) malloc(numpts * sizeof(gdPoint));
+   CPLT_point_t p;
+   gdPoint *GDpoints = (gdPoint *) _arena_alloc(&gc->scratch,
+                                                numpts * sizeof(gdPoint));
    if (GDpoints == NULL) {
       fprintf(stderr, " *** Not enough memory for polygon points!\n");
       return NULL;
@@ -734,13 +1263,83 @@ gdPoint *_create_poly_PNG(CPLT_gc_t gc, int numpts, CPLT_point_t points[]) {
 
    /* process numpts points */
    for (i = 0; i < numpts; i++) {
-      GDpoints[i].x = _rnd(points[i].x);
-      GDpoints[i].y = _rnd(gc->pheight - points[i].y);
+      p = _map_PNG(gc, points[i].x, points[i].y);
+      GDpoints[i].x = _rnd(p.x);
+      GDpoints[i].y = _rnd(p.y);
    }
 
    return GDpoints;
 }
 
+/*
+ *******************************************************************************
+ */
+
+CPLT_point_t _map_PNG(CPLT_gc_t gc, const float x, const float y) {
+   /* internal helper func to map the coords x/y by the current transform
+    * to pixel coords, i.e. y-inverted; while a symbol is defined, the
+    * canvases are drawn to around them */
+
+   CPLT_point_t p;
+
+   p.x = gc->tm[0] * x + gc->tm[2] * y + gc->tm[4];
+   p.y = gc->tm[1] * x + gc->tm[3] * y + gc->tm[5];
+   if (gc->page != NULL) _touch_PNG(gc, p.x, p.y, gc->curlwd * gc->tscale);
+
+   return p;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _transformed_PNG(CPLT_gc_t gc) {
+   /* internal helper func to update the mean scale of the changed
+    * transform, and the thickness of the lines by it */
+
+   int p;
+
+   ON_CANVASES(gc, _transformed_PNG(gc));
+   gc->tscale = sqrt(fabs(gc->tm[0] * gc->tm[3] - gc->tm[1] * gc->tm[2]));
+   p = _rnd(gc->curlwd * gc->tscale);
+   gdImageSetThickness(gc->img, (p < 1 ? 1 : p));
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _attributes_PNG(CPLT_gc_t gc) {
+   /* internal helper func to set the current color, linestyle and
+    * linewidth for the image drawn to, i.e. for the canvases or back */
+
+   ON_CANVASES(gc, _attributes_PNG(gc));
+   gdImageSetAntiAliased(gc->img, gc->colidx);
+   if (gc->curlsty != CPLT_SolidLine)
+      _set_coloredDash(gc, gdAntiAliased, gc->curlsty);
+   _transformed_PNG(gc);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _touch_PNG(CPLT_gc_t gc, const float x, const float y, const float r) {
+   /* internal helper func to extend the canvases' rect drawn to by the
+    * pixels within r of x/y, and the antialiasing around, while a symbol
+    * is defined */
+
+   if (gc->page == NULL) return;
+
+   if (x - r - 2 < gc->dirty[0]) gc->dirty[0] = floorf(x - r - 2);
+   if (y - r - 2 < gc->dirty[1]) gc->dirty[1] = floorf(y - r - 2);
+   if (x + r + 2 > gc->dirty[2]) gc->dirty[2] = ceilf(x + r + 2);
+   if (y + r + 2 > gc->dirty[3]) gc->dirty[3] = ceilf(y + r + 2);
+
+}
+
 /*
  *******************************************************************************
  */
@@ -890,39 +1489,365 @@ void _set_coloredDash(CPLT_gc_t gc, const int colidx,
 
 /*
  *******************************************************************************
- * management function to assemble the dispatch table/struct
- * for the generic callers
+ */
+
+void _stroke_path_PNG(CPLT_gc_t gc) {
+   /* internal helper func to draw the pending points of the streamed
+    * path, keeps the last one as the first of the next chunk */
+
+   if (gc->npath < 2) return;
+
+   _draw_path_PNG(gc);
+   gc->path[0] = gc->path[gc->npath - 1];
+   gc->npath = 1;
+
+}
+
+/*
  *******************************************************************************
  */
 
-CPLT_funcn_t *_get_dispatchFuncs_PNG(void) {
+void _draw_path_PNG(CPLT_gc_t gc) {
+   /* internal helper func to draw the lines through the pending points
+    * of the streamed path */
 
-   CPLT_funcn_t *dpt = (CPLT_funcn_t *) malloc(sizeof(*dpt));
-   if (dpt == NULL) {
-      fprintf(stderr, " *** Not enough memory for dispatch table!\n");
-      return NULL;
+   ON_CANVASES(gc, _draw_path_PNG(gc));
+   if (gc->npath > 2) {
+      gdImageOpenPolygon(gc->img, gc->path, gc->npath, gc->curcol);
+   } else {
+      gdImageLine(gc->img, gc->path[0].x, gc->path[0].y,
+                  gc->path[1].x, gc->path[1].y, gc->curcol);
    }
 
-   dpt->INIT  = &CPLT_init_graphics_PNG;
-   dpt->PLINE = &CPLT_draw_polyline_PNG;
-   dpt->PGON  = &CPLT_draw_polygon_PNG;
-   dpt->PGONF = &CPLT_draw_filledPolygon_PNG;
-   dpt->ARC   = &CPLT_draw_arc_PNG;
-   dpt->ARCF  = &CPLT_draw_filledArc_PNG;
-   dpt->CURVE = &CPLT_draw_curve_PNG;
-   dpt->MARK  = &CPLT_draw_marker_PNG;
-   dpt->TEXT  = &CPLT_draw_text_PNG;
-   dpt->FSIZE = &CPLT_set_fontsize_PNG;
-   dpt->COLR  = &CPLT_set_color_PNG;
-   dpt->LNWD  = &CPLT_set_linewidth_PNG;
-   dpt->LNSTY = &CPLT_set_linestyle_PNG;
-   dpt->FINI  = &CPLT_finish_graphics_PNG;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _cover_line_PNG(CPLT_gc_t gc, CPLT_point_t p0, CPLT_point_t p1) {
+   /* internal helper func to accumulate the signed area between the line
+    * from p0 to p1 and the right edge of each pixel row it crosses into
+    * the cover, as exact area coverage (see font-rs): summed up along a
+    * row, the cover gives the winding number of each pixel, fractional
+    * at the edges. Points left or right of the image are clamped to it,
+    * which keeps the sums right. */
+
+   float *row, w = gc->pwidth, dir = 1., dxdy, x, xn, dy, d;
+   float x0, x1, x0f, x1f, xmf, s, a0, a1, a2, am;
+   int y, y0, y1, x0i, x1i, xi;
+   CPLT_point_t t;
+
+   if (gc->cover == NULL || p0.y == p1.y) return;
+   if (p0.y > p1.y) {
+      t = p0;
+      p0 = p1;
+      p1 = t;
+      dir = -1.;
+   }
+   dxdy = (p1.x - p0.x) / (p1.y - p0.y);
+   x = p0.x;
+   if (p0.y < 0.) x -= p0.y * dxdy;
+   y0 = p0.y < 0. ? 0 : (int) p0.y;
+   y1 = ceilf(p1.y) < gc->pheight ? (int) ceilf(p1.y) : (int) gc->pheight;
+   if (y0 < gc->covy0) gc->covy0 = y0;
+   if (y1 - 1 > gc->covy1) gc->covy1 = y1 - 1;
+
+   for (y = y0; y < y1; y++) {
+      row = gc->cover + (size_t) y * (gc->pwidth + 2);
+      dy = (y + 1 < p1.y ? y + 1 : p1.y) - (y > p0.y ? y : p0.y);
+      xn = x + dxdy * dy;
+      d = dy * dir;
+      x0 = x < xn ? x : xn;
+      x1 = x < xn ? xn : x;
+      x0 = x0 < 0. ? 0. : x0 > w ? w : x0;
+      x1 = x1 < 0. ? 0. : x1 > w ? w : x1;
+      x0i = (int) floorf(x0);
+      x1i = (int) ceilf(x1);
+      if (x1i <= x0i + 1) {          /* within one pixel */
+         xmf = 0.5 * (x0 + x1) - x0i;
+         row[x0i] += d - d * xmf;
+         row[x0i + 1] += d * xmf;
+      } else {                       /* across several */
+         s = 1. / (x1 - x0);
+         x0f = x0 - x0i;
+         a0 = 0.5 * s * (1. - x0f) * (1. - x0f);
+         x1f = x1 - x1i + 1.;
+         am = 0.5 * s * x1f * x1f;
+         row[x0i] += d * a0;
+         if (x1i == x0i + 2) {
+            row[x0i + 1] += d * (1. - a0 - am);
+         } else {
+            a1 = s * (1.5 - x0f);
+            row[x0i + 1] += d * (a1 - a0);
+            for (xi = x0i + 2; xi < x1i - 1; xi++) row[xi] += d * s;
+            a2 = a1 + (x1i - x0i - 3) * s;
+            row[x1i - 1] += d * (1. - a2 - am);
+         }
+         row[x1i] += d * am;
+      }
+      x = xn;
+   }
 
-   return dpt;
 }
 
 /*
  *******************************************************************************
  */
 
+void _fill_cover_PNG(CPLT_gc_t gc, const int paint) {
+   /* internal helper func to paint the pixels covered by the path's area
+    * with current color, if paint, blended by the fraction covered, and
+    * to clear the cover for the next path */
+
+   int y;
+
+   if (gc->cover == NULL) return;
+
+   if (paint) _paint_cover_PNG(gc);
+   for (y = gc->covy0; y <= gc->covy1; y++)
+      memset(gc->cover + (size_t) y * (gc->pwidth + 2), 0,
+             (gc->pwidth + 2) * sizeof(float));
+   gc->covy0 = gc->pheight;
+   gc->covy1 = -1;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _paint_cover_PNG(CPLT_gc_t gc) {
+   /* internal helper func to paint the pixels covered by the path's area
+    * with current color, blended by the fraction covered */
+
+   float *row, acc, cov;
+   int x, y, alpha;
+   int r = gdTrueColorGetRed(gc->colidx);
+   int g = gdTrueColorGetGreen(gc->colidx);
+   int b = gdTrueColorGetBlue(gc->colidx);
+
+   ON_CANVASES(gc, _paint_cover_PNG(gc));
+   for (y = gc->covy0; y <= gc->covy1; y++) {
+      row = gc->cover + (size_t) y * (gc->pwidth + 2);
+      for (x = 0, acc = 0.; x < (int) gc->pwidth; x++) {
+         acc += row[x];
+         cov = fabsf(acc);
+         if (cov < 0.5 / 127.) continue;
+         alpha = cov >= 1. ? 0 : 127 - (int)(127. * cov + 0.5);
+         gdImageSetPixel(gc->img, x, y, gdTrueColorAlpha(r, g, b, alpha));
+      }
+   }
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _cut_sprite_PNG(CPLT_gc_t gc, _sprite_t *s) {
+   /* internal helper func to make the rect of the canvases drawn to the
+    * sprite s: as GD blends linearly, a pixel drawn with coverage a of
+    * color c is c*a + (1-a) on white, c*a on black, which gives a and the
+    * premultiplied color. Clears the rect afterwards. */
+
+   int x, y, x0, y0, x1, y1, cw, cb, a;
+   unsigned char *p;
+
+   free(s->px);
+   s->px = NULL;
+   s->w = s->h = 0;
+
+   x0 = gc->dirty[0] < 0 ? 0 : gc->dirty[0];
+   y0 = gc->dirty[1] < 0 ? 0 : gc->dirty[1];
+   x1 = gc->dirty[2] < (int) gc->pwidth ? gc->dirty[2] : (int) gc->pwidth - 1;
+   y1 = gc->dirty[3] < (int) gc->pheight ? gc->dirty[3] : (int) gc->pheight - 1;
+   if (x1 < x0 || y1 < y0) return;
+
+   p = (unsigned char *) malloc((size_t)(x1 - x0 + 1) * (y1 - y0 + 1) * 4);
+   if (p == NULL) {
+      fprintf(stderr, " *** Not enough memory for symbol's sprite!\n");
+   } else {
+      s->px = p;
+      s->w = x1 - x0 + 1;
+      s->h = y1 - y0 + 1;
+      s->ox = gc->pwidth / 2 - x0;
+      s->oy = gc->pheight / 2 - y0;
+      for (y = y0; y <= y1; y++)
+         for (x = x0; x <= x1; x++, p += 4) {
+            cw = gdImageGetTrueColorPixel(gc->canvas[0], x, y);
+            cb = gdImageGetTrueColorPixel(gc->canvas[1], x, y);
+            a = 765 - (gdTrueColorGetRed(cw) - gdTrueColorGetRed(cb))
+                    - (gdTrueColorGetGreen(cw) - gdTrueColorGetGreen(cb))
+                    - (gdTrueColorGetBlue(cw) - gdTrueColorGetBlue(cb));
+            a = (a + 1) / 3;
+            a = a < 0 ? 0 : a > 255 ? 255 : a;
+            p[0] = gdTrueColorGetRed(cb) < a ? gdTrueColorGetRed(cb) : a;
+            p[1] = gdTrueColorGetGreen(cb) < a ? gdTrueColorGetGreen(cb) : a;
+            p[2] = gdTrueColorGetBlue(cb) < a ? gdTrueColorGetBlue(cb) : a;
+            p[3] = a;
+         }
+   }
+
+   gdImageFilledRectangle(gc->canvas[0], x0, y0, x1, y1, gc->bgcol);
+   gdImageFilledRectangle(gc->canvas[1], x0, y0, x1, y1,
+                          gdTrueColorAlpha(0, 0, 0, 0));
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _blit_PNG(CPLT_gc_t gc, const _sprite_t *s, const int x0, const int y0) {
+   /* internal helper func to blend sprite s into the image drawn to, with
+    * its top left pixel at x0/y0 */
+
+   const unsigned char *p;
+   int i, j, x, y;
+
+   _touch_PNG(gc, x0, y0, 0.);
+   _touch_PNG(gc, x0 + s->w, y0 + s->h, 0.);
+   for (j = 0; j < s->h; j++) {
+      y = y0 + j;
+      if (y < 0 || y >= (int) gc->pheight) continue;
+      for (i = 0, p = s->px + (size_t) j * s->w * 4; i < s->w; i++, p += 4) {
+         x = x0 + i;
+         if (p[3] == 0 || x < 0 || x >= (int) gc->pwidth) continue;
+         _blend_PNG(gc, x, y, p[0], p[1], p[2], p[3]);
+      }
+   }
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _blit_mapped_PNG(CPLT_gc_t gc, const _sprite_t *s, CPLT_point_t ref,
+                      const double m[4]) {
+   /* internal helper func to blend sprite s into the image drawn to, its
+    * reference point at ref and its pixel steps along x and y mapped to
+    * m[0]/m[1] and m[2]/m[3]: each pixel covered is inversely mapped
+    * into the sprite and samples its 4 nearest pixels bilinearly */
+
+   const unsigned char *p;
+   double det, dx, dy, u, v, fu, fv, wt, acc[4], cx, cy;
+   double xmin = 1e30, xmax = -1e30, ymin = 1e30, ymax = -1e30;
+   int x, y, x0, y0, x1, y1, i, j, k, iu, jv;
+
+   det = m[0] * m[3] - m[2] * m[1];
+   if (fabs(det) < 1e-9) return;
+
+   /* the image's rect covered, incl. the sprite's bilinear fringe */
+   for (k = 0; k < 4; k++) {
+      dx = (k & 1 ? s->w : -1) - s->ox;
+      dy = (k & 2 ? s->h : -1) - s->oy;
+      cx = ref.x + m[0] * dx + m[2] * dy;
+      cy = ref.y + m[1] * dx + m[3] * dy;
+      xmin = fmin(xmin, cx);  xmax = fmax(xmax, cx);
+      ymin = fmin(ymin, cy);  ymax = fmax(ymax, cy);
+   }
+   x0 = xmin < 0. ? 0 : (int) xmin;
+   y0 = ymin < 0. ? 0 : (int) ymin;
+   x1 = xmax >= gc->pwidth ? (int) gc->pwidth - 1 : (int) ceil(xmax);
+   y1 = ymax >= gc->pheight ? (int) gc->pheight - 1 : (int) ceil(ymax);
+   if (x1 < x0 || y1 < y0) return;
+   _touch_PNG(gc, x0, y0, 0.);
+   _touch_PNG(gc, x1, y1, 0.);
+
+   for (y = y0; y <= y1; y++)
+      for (x = x0; x <= x1; x++) {
+         dx = x - ref.x;
+         dy = y - ref.y;
+         u = (m[3] * dx - m[2] * dy) / det + s->ox;
+         v = (m[0] * dy - m[1] * dx) / det + s->oy;
+         if (u <= -1. || v <= -1. || u >= s->w || v >= s->h) continue;
+         iu = (int) floor(u);
+         jv = (int) floor(v);
+         fu = u - iu;
+         fv = v - jv;
+         acc[0] = acc[1] = acc[2] = acc[3] = 0.;
+         for (k = 0; k < 4; k++) {
+            i = iu + (k & 1);
+            j = jv + (k >> 1);
+            if (i < 0 || j < 0 || i >= s->w || j >= s->h) continue;
+            wt = (k & 1 ? fu : 1. - fu) * (k & 2 ? fv : 1. - fv);
+            p = s->px + ((size_t) j * s->w + i) * 4;
+            acc[0] += wt * p[0];
+            acc[1] += wt * p[1];
+            acc[2] += wt * p[2];
+            acc[3] += wt * p[3];
+         }
+         if (acc[3] < 0.5) continue;
+         _blend_PNG(gc, x, y, _rnd(acc[0]), _rnd(acc[1]), _rnd(acc[2]),
+                    _rnd(acc[3]));
+      }
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _blend_PNG(CPLT_gc_t gc, const int x, const int y,
+                int r, int g, int b, const int a) {
+   /* internal helper func to blend the premultiplied color r/g/b of
+    * alpha a [0,255] over the pixel x/y of the image drawn to */
+
+   int d;
+
+   if (a < 255) {
+      d = gdImageGetTrueColorPixel(gc->img, x, y);
+      r += (gdTrueColorGetRed(d) * (255 - a) + 127) / 255;
+      g += (gdTrueColorGetGreen(d) * (255 - a) + 127) / 255;
+      b += (gdTrueColorGetBlue(d) * (255 - a) + 127) / 255;
+   }
+   gdImageSetPixel(gc->img, x, y, gdTrueColorAlpha(r > 255 ? 255 : r,
+                                                   g > 255 ? 255 : g,
+                                                   b > 255 ? 255 : b, 0));
+
+}
+
+/*
+ *******************************************************************************
+ * dispatch table of the format's functions for the generic callers
+ *******************************************************************************
+ */
+
+const CPLT_funcn_t CPLT_dispatch_PNG = {
+   .INIT  = &CPLT_init_graphics_PNG,
+   .PLINE = &CPLT_draw_polyline_PNG,
+   .SEGS  = &CPLT_draw_segments_PNG,
+   .PGON  = &CPLT_draw_polygon_PNG,
+   .PGONF = &CPLT_draw_filledPolygon_PNG,
+   .ARC   = &CPLT_draw_arc_PNG,
+   .ARCF  = &CPLT_draw_filledArc_PNG,
+   .CURVE = &CPLT_draw_curve_PNG,
+   .MARK  = &CPLT_draw_marker_PNG,
+   .TEXT  = &CPLT_draw_text_PNG,
+   .FSIZE = &CPLT_set_fontsize_PNG,
+   .COLR  = &CPLT_set_color_PNG,
+   .LNWD  = &CPLT_set_linewidth_PNG,
+   .LNSTY = &CPLT_set_linestyle_PNG,
+   .FINI  = &CPLT_finish_graphics_PNG,
+   .SYMD  = &CPLT_define_symbol_PNG,
+   .SYME  = &CPLT_end_symbol_PNG,
+   .SYMP  = &CPLT_place_symbol_PNG,
+   .BRNCH = NULL,   /* no branching */
+   .REPL  = NULL,   /* no recording */
+   .PATHB = &CPLT_path_begin_PNG,
+   .MOVE  = &CPLT_path_moveto_PNG,
+   .LINE  = &CPLT_path_lineto_PNG,
+   .STROKE = &CPLT_path_stroke_PNG,
+   .FILL  = &CPLT_path_fill_PNG,
+   .PUSH  = &CPLT_push_transform_PNG,
+   .POP   = &CPLT_pop_transform_PNG,
+   .CONCAT = &CPLT_concat_matrix_PNG,
+};
+
+/*
+ *******************************************************************************
+ */
+
 
@@ -0,0 +1,995 @@
+/*
+ * ADT: 'CPlotter'
+ * CPlotter provides a basic, unified interface to different graphics
+ * formats for simple 2D-drawings in C.
+ *
+ * This backend records the drawing calls instead of rendering them:
+ * each call is appended with its arguments to a display list in
+ * memory, which CPLT_replay() feeds to any of the graphics formats,
+ * so a picture is drawn by the client once for several plotfiles.
+ * Fanned out, each full block of the list is passed on right away to
+ * several graphics formats, each drawing on a thread of its own.
+ *
+ * Author and Copyright: Dipl.-Ing. Horst-W. Radners, Berlin, 2015-2016
+ * License: LGPL 3.0, see http://www.gnu.org/licenses/lgpl-3.0.en.html
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "CPLT_intern.h"
+
+/* record of the display list: a call with its scalar arguments, the
+ * array and string arguments follow the record */
+typedef struct {
+   unsigned int op;        /* the call, see enum below */
+   unsigned int size;      /* size [bytes] of record incl. appended data */
+   int n;                  /* number of points/segments, int argument */
+   int m;                  /* 2nd int argument */
+   float f[5];             /* float arguments */
+} _rec_t;
+
+/* the recorded calls */
+enum {
+   _PLINE, _SEGS, _PGON, _PGONF, _ARC, _ARCF, _CURVE, _MARK, _TEXT,
+   _FSIZE, _COLR, _LNWD, _LNSTY, _PATHB, _MOVE, _LINE, _STROKE, _FILL,
+   _PUSH, _POP, _CONCAT, _SYMD, _SYME, _SYMP
+};
+
+/* block of the arena, the records are appended to the last block */
+typedef struct _block {
+   struct _block *next;    /* next block, NULL if last */
+   size_t used;            /* bytes used of data */
+   size_t cap;             /* capacity [bytes] of data */
+   int refs;               /* fanned out: outputs yet to draw the block */
+   double data[];          /* the records */
+} _block_t;
+
+#define BLOCKSIZE 65536    /* min. capacity [bytes] of arena block */
+#define QUEUELEN  8        /* max. blocks queued per output */
+
+/* bounded queue of the blocks an output thread has to draw,
+ * a NULL block ends it */
+typedef struct {
+   pthread_mutex_t mtx;
+   pthread_cond_t cond;    /* signalled if a block is put or taken */
+   _block_t *blk[QUEUELEN];
+   unsigned long head, tail;  /* next block taken and put */
+   CPLT_gc_t out;          /* graphics context of the output */
+   pthread_t tid;          /* its thread */
+} _queue_t;
+
+/* graphics context */
+struct CPLT_gctx {
+   const CPLT_funcn_t *dispatch; /* functions dispatch table */
+   FILE *fp;               /* filepointer, unused */
+   char *fpbuf;            /* fp's buffer, if not stdio's own */
+   CPLT_state_t state;     /* as set by the generic API */
+   CPLT_view_t view;       /* culled by the generic API */
+#ifdef CPLT_STATS
+   CPLT_stats_t stats;     /* counted by the generic API */
+#endif
+   unsigned int pwidth;    /* image's width [pix] */
+   unsigned int pheight;   /* image's height [pix] */
+   _block_t *first;        /* display list: first block of arena */
+   _block_t *last;         /* and the last block, appended to */
+   int fail;               /* if a record is lost for lack of memory */
+   int nout;               /* fanned out: number of outputs, else 0 */
+   _queue_t *queue;        /* their queues */
+};
+
+
+/* prototypes of internal helper functions */
+_rec_t *_append_REC(CPLT_gc_t gc, const unsigned int op, size_t extra);
+void _replay_block_REC(const _block_t *b, CPLT_gc_t out);
+void _put_REC(_queue_t *q, _block_t *b);
+void _send_REC(CPLT_gc_t gc);
+void *_output_REC(void *arg);
+
+/*
+ *******************************************************************************
+ * API functions
+ *******************************************************************************
+ */
+
+CPLT_gc_t CPLT_init_graphics_REC(const unsigned int pwidth,
+                                 const unsigned int pheight,
+                                 char *plotfilename, FILE *fp) {
+   /* Initializes graphics of pwidth x pheight [pix] named plotfilename,
+    * written to the opened fp, returns graphics-context pointer.
+    * here REC: starts an empty display list, plotfilename and fp are
+    * unused */
+
+   /* allocate memory for graphics context's data-struct */
+   CPLT_gc_t gc = (CPLT_gc_t) malloc(sizeof(*gc));
+   if (gc == NULL) {
+      fprintf(stderr, " *** Not enough memory for graphics context!\n");
+      return NULL;
+   }
+   _unknown_state(&gc->state);
+   _init_view(&gc->view, pwidth, pheight);
+
+   gc->fp = NULL;
+   gc->fpbuf = NULL;
+   gc->pwidth = pwidth;
+   gc->pheight = pheight;
+   gc->first = NULL;
+   gc->last = NULL;
+   gc->fail = 0;
+   gc->nout = 0;
+   gc->queue = NULL;
+
+   /* register dispatch table of our functions for generic callers */
+   gc->dispatch = &CPLT_dispatch_REC;
+
+   return gc;
+}
+
+/*
+ *******************************************************************************
+ */
+
+CPLT_gc_t CPLT_init_graphics_MULTI(const unsigned int pwidth,
+                                   const unsigned int pheight,
+                                   char *plotfilenames[], const int n) {
+   /* Initializes graphics of pwidth x pheight [pix] in the n graphics
+    * files plotfilenames, returns graphics-context pointer.
+    * here REC fanned out: initializes the graphics of each plotfile and
+    * starts a thread drawing into it from its queue */
+
+   CPLT_gc_t gc;
+   int i;
+
+   if (n < 1) {
+      fprintf(stderr, " *** No plotfiles to fan out to!\n");
+      return NULL;
+   }
+   if ((gc = CPLT_init_graphics_REC(pwidth, pheight, NULL, NULL)) == NULL)
+      return NULL;
+   if ((gc->queue = (_queue_t *) calloc(n, sizeof(*gc->queue))) == NULL) {
+      fprintf(stderr, " *** Not enough memory for output queues!\n");
+      CPLT_finish_graphics(gc);
+      return NULL;
+   }
+
+   for (i = 0; i < n; i++) {
+      if ((gc->queue[i].out = CPLT_init_graphics(pwidth, pheight,
+                                                 plotfilenames[i])) == NULL)
+         break;
+      pthread_mutex_init(&gc->queue[i].mtx, NULL);
+      pthread_cond_init(&gc->queue[i].cond, NULL);
+      if (pthread_create(&gc->queue[i].tid, NULL, &_output_REC,
+                         &gc->queue[i]) != 0) {
+         fprintf(stderr, " *** Can't start thread for '%s'!\n",
+                 plotfilenames[i]);
+         CPLT_finish_graphics(gc->queue[i].out);
+         pthread_cond_destroy(&gc->queue[i].cond);
+         pthread_mutex_destroy(&gc->queue[i].mtx);
+         break;
+      }
+      gc->nout = i + 1;
+   }
+   if (i < n) {   /* stop the outputs started, their plotfiles stay empty */
+      CPLT_finish_graphics(gc);
+      return NULL;
+   }
+
+   return gc;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_draw_polyline_REC(CPLT_gc_t gc, int numpts,
+                            CPLT_point_t points[]) {
+   /* Plots line through numpts 2D-points at given x/y-pairs in array points.
+    * Draws line with current color and linewidth/style. */
+
+   _rec_t *r;
+
+   if (gc == NULL) return;
+   if (numpts <= 1) return;
+
+   if ((r = _append_REC(gc, _PLINE, numpts * sizeof(*points))) == NULL)
+      return;
+   r->n = numpts;
+   memcpy(r + 1, points, numpts * sizeof(*points));
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_draw_polygon_REC(CPLT_gc_t gc, int numpts,
+                           CPLT_point_t points[]) {
+   /* Plots (automatically closed) 2D-polygon with numpts points at given
+    * x/y-pairs in array points.
+    * Draws outline of the polygon with current color and linewidth/style. */
+
+   _rec_t *r;
+
+   if (gc == NULL) return;
+
+   if ((r = _append_REC(gc, _PGON, numpts * sizeof(*points))) == NULL)
+      return;
+   r->n = numpts;
+   memcpy(r + 1, points, numpts * sizeof(*points));
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_draw_filledPolygon_REC(CPLT_gc_t gc, int numpts,
+                                 CPLT_point_t points[]) {
+   /* Plots (automatically closed) 2D-polygon with numpts points at given
+    * x/y-pairs in array points.
+    * Fills and strokes the polygon with current color. */
+
+   _rec_t *r;
+
+   if (gc == NULL) return;
+
+   if ((r = _append_REC(gc, _PGONF, numpts * sizeof(*points))) == NULL)
+      return;
+   r->n = numpts;
+   memcpy(r + 1, points, numpts * sizeof(*points));
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_draw_arc_REC(CPLT_gc_t gc, const float cx, const float cy,
+                       const float radius,
+                       const float start, const float end) {
+   /* Plots partial circle at given x/y-center with the specified radius.
+    * The arc begins at the position in degrees specified by angle start
+    * and ends at the position specified by angle end.
+    * A full circle can be drawn by beginning from start=0 degrees and
+    * ending at end=360 degrees.
+    * Both angles turn counterclockwise, i.e. mathematically positive.
+    * Draws outline of the arc with current color and linewidth/style. */
+
+   _rec_t *r;
+
+   if (gc == NULL) return;
+
+   if ((r = _append_REC(gc, _ARC, 0)) == NULL) return;
+   r->f[0] = cx;
+   r->f[1] = cy;
+   r->f[2] = radius;
+   r->f[3] = start;
+   r->f[4] = end;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_draw_filledArc_REC(CPLT_gc_t gc, const float cx, const float cy,
+                             const float radius,
+                             const float start, const float end) {
+   /* Plots partial circle at given x/y-center with the specified radius.
+    * The arc begins at the position in degrees specified by angle start
+    * and ends at the position specified by angle end.
+    * A full circle can be drawn by beginning from start=0 degrees and
+    * ending at end=360 degrees.
+    * Both angles turn counterclockwise, i.e. mathematically positive.
+    * Fills + strokes the arc/"pie slice" with current color. */
+
+   _rec_t *r;
+
+   if (gc == NULL) return;
+
+   if ((r = _append_REC(gc, _ARCF, 0)) == NULL) return;
+   r->f[0] = cx;
+   r->f[1] = cy;
+   r->f[2] = radius;
+   r->f[3] = start;
+   r->f[4] = end;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_draw_curve_REC(CPLT_gc_t gc, CPLT_point_t points[]) {
+   /* Plots a Bezier curve segment by 4 given 2D-points as x/y-pairs
+    * in array points. points[0] is start, points[3] end point of curve,
+    * points[1] and points[2] are the Bezier control points.
+    * Draws line with current color and linewidth/style. */
+
+   _rec_t *r;
+
+   if (gc == NULL) return;
+
+   if ((r = _append_REC(gc, _CURVE, 4 * sizeof(*points))) == NULL) return;
+   memcpy(r + 1, points, 4 * sizeof(*points));
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_draw_marker_REC(CPLT_gc_t gc, const float cx, const float cy,
+                          const int wd, const int symbol) {
+   /* Plots a marker of width/height wd [pix] centered at cx/cy, with
+    * current linewidth and color.
+    * symbol [0-7] enumerates the marker's form:
+    * 0: X
+    * 1: +
+    * 2: star
+    * 3: circle
+    * 4: square
+    * 5: square, turned 45°
+    * 6: triangle, tip up
+    * 7: triangle, tip down
+    */
+
+   _rec_t *r;
+
+   if (gc == NULL) return;
+
+   if ((r = _append_REC(gc, _MARK, 0)) == NULL) return;
+   r->f[0] = cx;
+   r->f[1] = cy;
+   r->n = wd;
+   r->m = symbol;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_draw_text_REC(CPLT_gc_t gc, const float x, const float y,
+                        char *anchor, float angle, char *text) {
+   /* Plots Latin-1 encoded text of current fontsize at angle degrees
+    * with current color (although the currrent linewidth is ignored,
+    * the actual strokewidth used depends on the current fontsize,
+    * see CPLT_set_fontsize()).
+    * anchor sets the reference point of the text enclosing
+    * rectangle positioned at x/y:
+    *
+    *    nw--------n--------ne    For example,
+    *    |         |         |    if anchor = "sw", the lower-left corner
+    *    w---------c---------e    of text is positioned at x/y,
+    *    |         |         |    if anchor = "c", the text is centered at x/y.
+    *    sw--------s--------se
+    *
+    * here REC: anchor and text are copied behind the record */
+
+   _rec_t *r;
+   size_t la, lt;
+
+   if (gc == NULL) return;
+
+   la = strlen(anchor) + 1;
+   lt = strlen(text) + 1;
+   if ((r = _append_REC(gc, _TEXT, la + lt)) == NULL) return;
+   r->f[0] = x;
+   r->f[1] = y;
+   r->f[2] = angle;
+   memcpy((char *)(r + 1), anchor, la);
+   memcpy((char *)(r + 1) + la, text, lt);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_set_fontsize_REC(CPLT_gc_t gc, const float fontsize) {
+   /* Sets current fontsize [pix] for CPLT_draw_text().
+    * (Preset: fontsize=12.0) */
+
+   _rec_t *r;
+
+   if (gc == NULL) return;
+
+   if ((r = _append_REC(gc, _FSIZE, 0)) == NULL) return;
+   r->f[0] = fontsize;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_set_color_REC(CPLT_gc_t gc, float r, float g, float b) {
+   /* Sets current color of RGB values [0,1].
+    * (Preset: r=0., g=0., b=0., i.e. black) */
+
+   _rec_t *rec;
+
+   if (gc == NULL) return;
+
+   if ((rec = _append_REC(gc, _COLR, 0)) == NULL) return;
+   rec->f[0] = r;
+   rec->f[1] = g;
+   rec->f[2] = b;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_set_linewidth_REC(CPLT_gc_t gc, const float w) {
+   /* Sets current linewidth w [pix]. (Preset: w=1.0) */
+
+   _rec_t *r;
+
+   if (gc == NULL) return;
+
+   if ((r = _append_REC(gc, _LNWD, 0)) == NULL) return;
+   r->f[0] = w;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_set_linestyle_REC(CPLT_gc_t gc, const CPLT_lnstyle_t s) {
+   /* Sets current linestyle s [enumeration].
+    * (Preset: s=CPLT_SolidLine) */
+
+   _rec_t *r;
+
+   if (gc == NULL) return;
+
+   if ((r = _append_REC(gc, _LNSTY, 0)) == NULL) return;
+   r->m = s;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_draw_segments_REC(CPLT_gc_t gc, const int n,
+                            const CPLT_point_t segments[],
+                            const float widths[], const float colors[][3]) {
+   /* Plots n straight line segments at once, segment i from segments[2*i]
+    * to segments[2*i+1], with linewidth widths[i] [pix] and color
+    * colors[i] (RGB values [0,1]), or the current linewidth or color for
+    * all if widths or colors is NULL, and the current linestyle.
+    * The current color and linewidth are not changed.
+    * here REC: the segments, widths and colors given are copied behind
+    * the record in this order, m flags which arrays are there */
+
+   _rec_t *r;
+   char *p;
+
+   if (gc == NULL) return;
+   if (n <= 0) return;
+
+   r = _append_REC(gc, _SEGS, n * (2 * sizeof(*segments) +
+                                   (widths ? sizeof(*widths) : 0) +
+                                   (colors ? sizeof(*colors) : 0)));
+   if (r == NULL) return;
+   r->n = n;
+   r->m = (widths ? 1 : 0) | (colors ? 2 : 0);
+   p = (char *)(r + 1);
+   memcpy(p, segments, 2 * n * sizeof(*segments));
+   p += 2 * n * sizeof(*segments);
+   if (widths) {
+      memcpy(p, widths, n * sizeof(*widths));
+      p += n * sizeof(*widths);
+   }
+   if (colors) memcpy(p, colors, n * sizeof(*colors));
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_begin_REC(CPLT_gc_t gc) {
+   /* Begins a path, streamed point by point by CPLT_path_moveto() and
+    * CPLT_path_lineto() to the graphics format. */
+
+   if (gc == NULL) return;
+
+   _append_REC(gc, _PATHB, 0);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_moveto_REC(CPLT_gc_t gc, const float x, const float y) {
+   /* Begins a new subpath of the path at x/y. */
+
+   _rec_t *r;
+
+   if (gc == NULL) return;
+
+   if ((r = _append_REC(gc, _MOVE, 0)) == NULL) return;
+   r->f[0] = x;
+   r->f[1] = y;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_lineto_REC(CPLT_gc_t gc, const float x, const float y) {
+   /* Appends a straight line from the current point to x/y to the
+    * subpath. */
+
+   _rec_t *r;
+
+   if (gc == NULL) return;
+
+   if ((r = _append_REC(gc, _LINE, 0)) == NULL) return;
+   r->f[0] = x;
+   r->f[1] = y;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_stroke_REC(CPLT_gc_t gc) {
+   /* Ends the path, drawn as lines with current color and
+    * linewidth/style. */
+
+   if (gc == NULL) return;
+
+   _append_REC(gc, _STROKE, 0);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_fill_REC(CPLT_gc_t gc) {
+   /* Ends the path: closes the current subpath, fills the area enclosed
+    * by all subpaths (nonzero winding) and strokes it, with current
+    * color. */
+
+   if (gc == NULL) return;
+
+   _append_REC(gc, _FILL, 0);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_push_transform_REC(CPLT_gc_t gc) {
+   /* Saves the current transform of the coords on a stack, to be
+    * restored by the matching CPLT_pop_transform(). */
+
+   if (gc == NULL) return;
+
+   _append_REC(gc, _PUSH, 0);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_pop_transform_REC(CPLT_gc_t gc) {
+   /* Restores the transform saved by the last CPLT_push_transform() not
+    * popped yet, if any. */
+
+   if (gc == NULL) return;
+
+   _append_REC(gc, _POP, 0);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_concat_matrix_REC(CPLT_gc_t gc, const float a, const float b,
+                            const float c, const float d,
+                            const float e, const float f) {
+   /* Concatenates the matrix [a b c d e f] to the current transform.
+    * here REC: the matrix follows the record */
+
+   _rec_t *r;
+   float *m;
+
+   if (gc == NULL) return;
+
+   if ((r = _append_REC(gc, _CONCAT, 6 * sizeof(float))) == NULL) return;
+   m = (float *)(r + 1);
+   m[0] = a;
+   m[1] = b;
+   m[2] = c;
+   m[3] = d;
+   m[4] = e;
+   m[5] = f;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+int CPLT_define_symbol_REC(CPLT_gc_t gc, const int id) {
+   /* Starts the definition of symbol id, returns 0 or -1 on error.
+    * here REC: the calls up to CPLT_end_symbol() are recorded as usual,
+    * whether the plotfiles drawn have symbols is up to their formats */
+
+   _rec_t *r;
+
+   if (gc == NULL || id < 0) return -1;
+
+   if ((r = _append_REC(gc, _SYMD, 0)) == NULL) return -1;
+   r->n = id;
+
+   return 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_end_symbol_REC(CPLT_gc_t gc) {
+   /* Ends the definition of the current symbol. */
+
+   if (gc == NULL) return;
+
+   _append_REC(gc, _SYME, 0);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_place_symbol_REC(CPLT_gc_t gc, const int id,
+                           const float x, const float y,
+                           const float scale, const float angle) {
+   /* Plots symbol id with its reference point at x/y, scaled by scale
+    * and turned by angle degrees counterclockwise. */
+
+   _rec_t *r;
+
+   if (gc == NULL) return;
+
+   if ((r = _append_REC(gc, _SYMP, 0)) == NULL) return;
+   r->f[0] = x;
+   r->f[1] = y;
+   r->f[2] = scale;
+   r->f[3] = angle;
+   r->n = id;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+int CPLT_replay_REC(CPLT_gc_t gc, char *plotfilename) {
+   /* Draws the calls recorded in gc into graphics file plotfilename of
+    * the recorded size, whose suffix determines the graphics format.
+    * Returns 0, or -1 on error. */
+
+   CPLT_gc_t out;
+   _block_t *b;
+
+   if (gc == NULL) return -1;
+   if (gc->nout) {
+      fprintf(stderr, " *** Fanned out graphics are not replayable!\n");
+      return -1;
+   }
+   if (gc->fail) {
+      fprintf(stderr, " *** Display list is incomplete, not replayed!\n");
+      return -1;
+   }
+   if ((out = CPLT_init_graphics(gc->pwidth, gc->pheight,
+                                 plotfilename)) == NULL)
+      return -1;
+
+   for (b = gc->first; b != NULL; b = b->next)
+      _replay_block_REC(b, out);
+
+   CPLT_finish_graphics(out);
+
+   return 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_finish_graphics_REC(CPLT_gc_t gc) {
+   /* Finishes graphics, closes plotfile, destroys graphics context.
+    * here REC: frees the display list, fanned out passes on the last
+    * block and waits for the outputs to finish their plotfiles */
+
+   _block_t *b;
+   int i;
+
+   if (gc == NULL) return;
+
+   if (gc->nout) {
+      _send_REC(gc);
+      for (i = 0; i < gc->nout; i++) {
+         _put_REC(&gc->queue[i], NULL);
+         pthread_join(gc->queue[i].tid, NULL);
+         pthread_cond_destroy(&gc->queue[i].cond);
+         pthread_mutex_destroy(&gc->queue[i].mtx);
+      }
+   }
+   free(gc->queue);
+
+   while ((b = gc->first) != NULL) {
+      gc->first = b->next;
+      free(b);
+   }
+
+   free(gc);
+
+}
+
+/*
+ *******************************************************************************
+ * internal helper functions
+ *******************************************************************************
+ */
+
+_rec_t *_append_REC(CPLT_gc_t gc, const unsigned int op, size_t extra) {
+   /* internal helper func to append a record of call op with extra bytes
+    * of data behind to the display list, returns it or NULL if out of
+    * memory. The records are kept aligned to the arena's data. */
+
+   _block_t *b = gc->last;
+   size_t size, cap;
+   _rec_t *r;
+
+   size = sizeof(_rec_t) + extra;
+   size = (size + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+
+   if (b == NULL || b->used + size > b->cap) {
+      if (gc->nout && b != NULL) _send_REC(gc);
+      cap = size > BLOCKSIZE ? size : BLOCKSIZE;
+      if ((b = (_block_t *) malloc(sizeof(*b) + cap)) == NULL) {
+         if (!gc->fail)
+            fprintf(stderr, " *** Not enough memory for display list!\n");
+         gc->fail = 1;
+         return NULL;
+      }
+      b->next = NULL;
+      b->used = 0;
+      b->cap = cap;
+      if (gc->last) gc->last->next = b;
+      else          gc->first = b;
+      gc->last = b;
+   }
+
+   r = (_rec_t *)((char *)b->data + b->used);
+   b->used += size;
+   r->op = op;
+   r->size = size;
+   r->n = r->m = 0;
+
+   return r;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _replay_block_REC(const _block_t *b, CPLT_gc_t out) {
+   /* internal helper func to draw the records of block b into out */
+
+   _rec_t *r;
+   size_t off;
+   char *p;
+   float *w, (*c)[3];
+
+   for (off = 0; off < b->used; off += r->size) {
+      r = (_rec_t *)((char *)b->data + off);
+      p = (char *)(r + 1);
+      switch (r->op) {
+         case _PLINE:
+            CPLT_draw_polyline(out, r->n, (CPLT_point_t *)p);
+            break;
+         case _SEGS:
+            w = (float *)(p + 2 * r->n * sizeof(CPLT_point_t));
+            c = (float (*)[3])(r->m & 1 ? w + r->n : w);
+            CPLT_draw_segments(out, r->n, (CPLT_point_t *)p,
+                               r->m & 1 ? w : NULL, r->m & 2 ? c : NULL);
+            break;
+         case _PGON:
+            CPLT_draw_polygon(out, r->n, (CPLT_point_t *)p);
+            break;
+         case _PGONF:
+            CPLT_draw_filledPolygon(out, r->n, (CPLT_point_t *)p);
+            break;
+         case _ARC:
+            CPLT_draw_arc(out, r->f[0], r->f[1], r->f[2], r->f[3], r->f[4]);
+            break;
+         case _ARCF:
+            CPLT_draw_filledArc(out, r->f[0], r->f[1], r->f[2],
+                                r->f[3], r->f[4]);
+            break;
+         case _CURVE:
+            CPLT_draw_curve(out, (CPLT_point_t *)p);
+            break;
+         case _MARK:
+            CPLT_draw_marker(out, r->f[0], r->f[1], r->n, r->m);
+            break;
+         case _TEXT:
+            CPLT_draw_text(out, r->f[0], r->f[1], p, r->f[2],
+                           p + strlen(p) + 1);
+            break;
+         case _FSIZE:
+            CPLT_set_fontsize(out, r->f[0]);
+            break;
+         case _COLR:
+            CPLT_set_color(out, r->f[0], r->f[1], r->f[2]);
+            break;
+         case _LNWD:
+            CPLT_set_linewidth(out, r->f[0]);
+            break;
+         case _LNSTY:
+            CPLT_set_linestyle(out, (CPLT_lnstyle_t) r->m);
+            break;
+         case _PATHB:
+            CPLT_path_begin(out);
+            break;
+         case _MOVE:
+            CPLT_path_moveto(out, r->f[0], r->f[1]);
+            break;
+         case _LINE:
+            CPLT_path_lineto(out, r->f[0], r->f[1]);
+            break;
+         case _STROKE:
+            CPLT_path_stroke(out);
+            break;
+         case _FILL:
+            CPLT_path_fill(out);
+            break;
+         case _PUSH:
+            CPLT_push_transform(out);
+            break;
+         case _POP:
+            CPLT_pop_transform(out);
+            break;
+         case _CONCAT:
+            w = (float *)p;
+            CPLT_concat_matrix(out, w[0], w[1], w[2], w[3], w[4], w[5]);
+            break;
+         case _SYMD:
+            CPLT_define_symbol(out, r->n);
+            break;
+         case _SYME:
+            CPLT_end_symbol(out);
+            break;
+         case _SYMP:
+            CPLT_place_symbol(out, r->n, r->f[0], r->f[1], r->f[2], r->f[3]);
+            break;
+      }
+   }
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _put_REC(_queue_t *q, _block_t *b) {
+   /* internal helper func to append block b to queue q, waits while the
+    * queue is full */
+
+   pthread_mutex_lock(&q->mtx);
+   while (q->tail - q->head == QUEUELEN)
+      pthread_cond_wait(&q->cond, &q->mtx);
+   q->blk[q->tail++ % QUEUELEN] = b;
+   pthread_cond_broadcast(&q->cond);
+   pthread_mutex_unlock(&q->mtx);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _send_REC(CPLT_gc_t gc) {
+   /* internal helper func to pass the blocks of the display list on to
+    * all outputs, which free them when drawn by all */
+
+   _block_t *b;
+   int i;
+
+   while ((b = gc->first) != NULL) {
+      gc->first = b->next;
+      b->refs = gc->nout;
+      for (i = 0; i < gc->nout; i++) _put_REC(&gc->queue[i], b);
+   }
+   gc->last = NULL;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void *_output_REC(void *arg) {
+   /* internal helper func, thread of an output: draws the blocks of its
+    * queue until the NULL block, then finishes its graphics */
+
+   _queue_t *q = (_queue_t *)arg;
+   _block_t *b;
+
+   for (;;) {
+      pthread_mutex_lock(&q->mtx);
+      while (q->head == q->tail)
+         pthread_cond_wait(&q->cond, &q->mtx);
+      b = q->blk[q->head++ % QUEUELEN];
+      pthread_cond_broadcast(&q->cond);
+      pthread_mutex_unlock(&q->mtx);
+      if (b == NULL) break;
+
+      _replay_block_REC(b, q->out);
+      if (__sync_sub_and_fetch(&b->refs, 1) == 0) free(b);
+   }
+   CPLT_finish_graphics(q->out);
+
+   return NULL;
+}
+
+/*
+ *******************************************************************************
+ * dispatch table of the format's functions for the generic callers
+ *******************************************************************************
+ */
+
+const CPLT_funcn_t CPLT_dispatch_REC = {
+   .INIT  = &CPLT_init_graphics_REC,
+   .PLINE = &CPLT_draw_polyline_REC,
+   .SEGS  = &CPLT_draw_segments_REC,
+   .PGON  = &CPLT_draw_polygon_REC,
+   .PGONF = &CPLT_draw_filledPolygon_REC,
+   .ARC   = &CPLT_draw_arc_REC,
+   .ARCF  = &CPLT_draw_filledArc_REC,
+   .CURVE = &CPLT_draw_curve_REC,
+   .MARK  = &CPLT_draw_marker_REC,
+   .TEXT  = &CPLT_draw_text_REC,
+   .FSIZE = &CPLT_set_fontsize_REC,
+   .COLR  = &CPLT_set_color_REC,
+   .LNWD  = &CPLT_set_linewidth_REC,
+   .LNSTY = &CPLT_set_linestyle_REC,
+   .FINI  = &CPLT_finish_graphics_REC,
+   .SYMD  = &CPLT_define_symbol_REC,
+   .SYME  = &CPLT_end_symbol_REC,
+   .SYMP  = &CPLT_place_symbol_REC,
+   .BRNCH = NULL,   /* no branching, not all formats have it */
+   .REPL  = &CPLT_replay_REC,
+   .PATHB = &CPLT_path_begin_REC,
+   .MOVE  = &CPLT_path_moveto_REC,
+   .LINE  = &CPLT_path_lineto_REC,
+   .STROKE = &CPLT_path_stroke_REC,
+   .FILL  = &CPLT_path_fill_REC,
+   .PUSH  = &CPLT_push_transform_REC,
+   .POP   = &CPLT_pop_transform_REC,
+   .CONCAT = &CPLT_concat_matrix_REC,
+};
+
+/*
+ *******************************************************************************
+ */
@@ -17,14 +17,24 @@
 
 /* graphics context */
 struct CPLT_gctx {
-   CPLT_funcn_t *dispatch; /* functions dispatch table */
+   const CPLT_funcn_t *dispatch; /* functions dispatch table */
    FILE *fp;               /* filepointer */
+   char *fpbuf;            /* fp's buffer, if not stdio's own */
+   CPLT_state_t state;     /* as set by the generic API */
+   CPLT_view_t view;       /* culled by the generic API */
+#ifdef CPLT_STATS
+   CPLT_stats_t stats;     /* counted by the generic API */
+#endif
    unsigned int pheight;   /* image's height [pix] */
    int curfontsize;        /* current font size [pix]*/
    int curlwd;             /* current linewidth [pix]*/
    char *curlsty;          /* current linestyle / dash array */
    int bgcol;              /* image's background color */
    int curcol[3];          /* current color, RGB [0,255]*/
+   int insym;              /* if a symbol is being defined */
+   int ngroups;            /* transformed groups open */
+   int *trans;             /* ngroups of each CPLT_push_transform() */
+   int ntrans, maxtrans;   /* pushed, not popped yet, and room of trans */
 };
 
 
@@ -36,7 +46,8 @@ static const float _EPS = 1.0E-5;   /* epsilon to 0 */
 /* prototypes of internal helper functions */
 CPLT_point_t _polar2cart_SVG(const float cx, const float cy,
                              const float radius, const float angle);
-CPLT_funcn_t *_get_dispatchFuncs_SVG(void);
+void _end_path_SVG(CPLT_gc_t gc);
+void _stroke_attrs_SVG(CPLT_gc_t gc);
 
 
 /*
@@ -47,10 +58,10 @@ CPLT_funcn_t *_get_dispatchFuncs_SVG(void);
 
 CPLT_gc_t CPLT_init_graphics_SVG(const unsigned int pwidth,
                                  const unsigned int pheight,
-                                 char *plotfilename) {
-   /* Initializes graphics of pwidth x pheight [pix] in graphics file
-    * plotfilename, returns graphics-context pointer.
-    * here SVG: opens plotfile, writes SVG-header */
+                                 char *plotfilename, FILE *fp) {
+   /* Initializes graphics of pwidth x pheight [pix] named plotfilename,
+    * written to the opened fp, returns graphics-context pointer.
+    * here SVG: writes SVG-header */
 
    /* allocate memory for graphics context's data-struct */
    CPLT_gc_t gc = (CPLT_gc_t) malloc(sizeof(*gc));
@@ -58,13 +69,10 @@ CPLT_gc_t CPLT_init_graphics_SVG(const unsigned int pwidth,
       fprintf(stderr, " *** Not enough memory for graphics context!\n");
       return NULL;
    }
+   _unknown_state(&gc->state);
+   _init_view(&gc->view, pwidth, pheight);
 
-   /* open SVG-plotfile */
-   if ((gc->fp = fopen(plotfilename, "w")) == NULL) {
-      fprintf(stderr,
-              " *** Can't open output plotfile '%s'!\n", plotfilename);
-      return NULL;
-   }
+   gc->fp = fp;
 
    /* write SVG-preamble */
    fprintf(gc->fp, "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n");
@@ -83,6 +91,10 @@ CPLT_gc_t CPLT_init_graphics_SVG(const unsigned int pwidth,
    gc->curlwd = 1;            /* current linewidth [pix]*/
    gc->curlsty = "none";      /* current linestyle / dash array */
    gc->curfontsize = 12;      /* current fontsize [pix]*/
+   gc->insym = 0;             /* not defining a symbol */
+   gc->ngroups = 0;           /* identity transform */
+   gc->trans = NULL;
+   gc->ntrans = gc->maxtrans = 0;
 
    /* fill whole canvas with white as background */
    fprintf(gc->fp, "<path d=\"\n");
@@ -96,7 +108,7 @@ CPLT_gc_t CPLT_init_graphics_SVG(const unsigned int pwidth,
            255, 255, 255, 255, 255, 255);
 
    /* register dispatch table of our functions for generic callers */
-   gc->dispatch = _get_dispatchFuncs_SVG();
+   gc->dispatch = &CPLT_dispatch_SVG;
 
    return gc;
 }
@@ -557,13 +569,13 @@ void CPLT_draw_text_SVG(CPLT_gc_t gc, const float x, const float y,
     */
 
    /* horizontal and vertical anchor positions */
-   static char *tanchor[10] = {
+   static const char *const tanchor[10] = {
       "",
       "start", "middle", "end",
       "start", "middle", "end",
       "start", "middle", "end"
    };
-   static char *tbase[10] = {
+   static const char *const tbase[10] = {
       "",
       "text-after-edge",  "text-after-edge",  "text-after-edge",
       "middle",           "middle",           "middle",
@@ -674,20 +686,279 @@ void CPLT_set_linestyle_SVG(CPLT_gc_t gc, const CPLT_lnstyle_t s) {
 
 }
 
+/*
+ *******************************************************************************
+ */
+
+int CPLT_define_symbol_SVG(CPLT_gc_t gc, const int id) {
+   /* Starts the definition of symbol id, returns 0 or -1 on error.
+    * here SVG: opens a symbol element, its contents are not rendered
+    * until referenced by <use>. The symbol keeps the page coords, as
+    * the use's transform moves its reference point (0,0) into place,
+    * and shows what overflows its viewport, i.e. the whole plot. */
+
+   if (gc == NULL) return -1;
+   if (gc->insym) {
+      fprintf(stderr, " *** CPlotter: symbols must not be nested!\n");
+      return -1;
+   }
+
+   fprintf(gc->fp, "<symbol id=\"sym%d\" overflow=\"visible\">\n", id);
+   gc->insym = 1;
+
+   return 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_end_symbol_SVG(CPLT_gc_t gc) {
+   /* Ends the definition of the current symbol.
+    * here SVG: closes the symbol element */
+
+   if (gc == NULL || !gc->insym) return;
+
+   fprintf(gc->fp, "</symbol>\n");
+   gc->insym = 0;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_place_symbol_SVG(CPLT_gc_t gc, const int id,
+                           const float x, const float y,
+                           const float scale, const float angle) {
+   /* Plots symbol id with its reference point at x/y, scaled by scale
+    * and turned by angle degrees counterclockwise.
+    * here SVG: references the symbol by <use>, whose transform maps
+    * the y-inverted coords of the symbol, i.e. inverts y back, turns,
+    * scales and moves it; the xlink namespace is declared on each use,
+    * so the SVG-preamble stays the same for plots w/o symbols */
+
+   if (gc == NULL) return;
+
+   fprintf(gc->fp, "<use xmlns:xlink=\"http://www.w3.org/1999/xlink\" "
+           "xlink:href=\"#sym%d\"\n", id);
+   fprintf(gc->fp, "transform=\"translate(%.2lf,%.2lf)", x, gc->pheight - y);
+   if (fabs(angle) > _EPS) fprintf(gc->fp, " rotate(%.4lf)", -angle);
+   if (fabs(scale - 1.) > _EPS) fprintf(gc->fp, " scale(%.4lf)", scale);
+   fprintf(gc->fp, " translate(0,%d)\"/>\n", -(int)gc->pheight);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_draw_segments_SVG(CPLT_gc_t gc, const int n,
+                            const CPLT_point_t segments[],
+                            const float widths[], const float colors[][3]) {
+   /* Plots n straight line segments at once, segment i from segments[2*i]
+    * to segments[2*i+1], with linewidth widths[i] [pix] and color
+    * colors[i] (RGB values [0,1]), or the current linewidth or color for
+    * all if widths or colors is NULL, and the current linestyle.
+    * The current color and linewidth are not changed.
+    * here SVG: each run of segments of the same stroke becomes a single
+    * path of moveto/lineto pairs, its stroke attributes written once */
+
+   int col[3], lwd;        /* saved current color and linewidth */
+   int i, open = 0;
+
+   if (gc == NULL) return;
+   if (n <= 0) return;
+
+   col[0] = gc->curcol[0];
+   col[1] = gc->curcol[1];
+   col[2] = gc->curcol[2];
+   lwd = gc->curlwd;
+
+   for (i = 0; i < n; i++) {
+      if (open && ((colors != NULL &&
+                    !_same_color(colors[i], colors[i - 1])) ||
+                   (widths != NULL && widths[i] != widths[i - 1]))) {
+         _end_path_SVG(gc);         /* stroke changes */
+         open = 0;
+      }
+      if (!open) {
+         if (colors != NULL)
+            CPLT_set_color_SVG(gc, colors[i][0], colors[i][1], colors[i][2]);
+         if (widths != NULL) CPLT_set_linewidth_SVG(gc, widths[i]);
+         fprintf(gc->fp, "<path d=\"\n");
+         open = 1;
+      }
+      fprintf(gc->fp, "M %.2lf %.2lf L %.2lf %.2lf\n",
+              segments[2 * i].x, gc->pheight - segments[2 * i].y,
+              segments[2 * i + 1].x, gc->pheight - segments[2 * i + 1].y);
+   }
+   _end_path_SVG(gc);
+
+   gc->curcol[0] = col[0];
+   gc->curcol[1] = col[1];
+   gc->curcol[2] = col[2];
+   gc->curlwd = lwd;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_begin_SVG(CPLT_gc_t gc) {
+   /* Begins a path, streamed point by point by CPLT_path_moveto() and
+    * CPLT_path_lineto() to the graphics format.
+    * here SVG: path element, its attributes follow its data */
+
+   if (gc == NULL) return;
+
+   fprintf(gc->fp, "<path d=\"\n");
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_moveto_SVG(CPLT_gc_t gc, const float x, const float y) {
+   /* Begins a new subpath of the path at x/y. */
+
+   if (gc == NULL) return;
+
+   fprintf(gc->fp, "M%.2lf %.2lf\n", x, gc->pheight - y);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_lineto_SVG(CPLT_gc_t gc, const float x, const float y) {
+   /* Appends a straight line from the current point to x/y to the
+    * subpath. */
+
+   if (gc == NULL) return;
+
+   fprintf(gc->fp, "L%.2lf %.2lf\n", x, gc->pheight - y);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_stroke_SVG(CPLT_gc_t gc) {
+   /* Ends the path, drawn as lines with current color and
+    * linewidth/style. */
+
+   if (gc == NULL) return;
+
+   _end_path_SVG(gc);
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_fill_SVG(CPLT_gc_t gc) {
+   /* Ends the path: closes the current subpath, fills the area enclosed
+    * by all subpaths (nonzero winding) and strokes it, with current
+    * color. */
+
+   if (gc == NULL) return;
+
+   fprintf(gc->fp, "Z\" fill=\"#%02X%02X%02X\"",
+           gc->curcol[0], gc->curcol[1], gc->curcol[2]);
+   _stroke_attrs_SVG(gc);
+   fprintf(gc->fp, "/>\n");
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_push_transform_SVG(CPLT_gc_t gc) {
+   /* Saves the current transform of the coords on a stack, to be
+    * restored by the matching CPLT_pop_transform().
+    * here SVG: saves the number of groups open, the ones opened by
+    * CPLT_concat_matrix() up to the pop are closed by it */
+
+   int *t;
+
+   if (gc == NULL) return;
+
+   if (gc->ntrans == gc->maxtrans) {
+      t = (int *) realloc(gc->trans, (2 * gc->maxtrans + 16) * sizeof(int));
+      if (t == NULL) {
+         fprintf(stderr, " *** Not enough memory for transform stack!\n");
+         return;
+      }
+      gc->trans = t;
+      gc->maxtrans = 2 * gc->maxtrans + 16;
+   }
+   gc->trans[gc->ntrans++] = gc->ngroups;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_pop_transform_SVG(CPLT_gc_t gc) {
+   /* Restores the transform saved by the last CPLT_push_transform() not
+    * popped yet, if any.
+    * here SVG: closes the groups opened since */
+
+   if (gc == NULL || gc->ntrans == 0) return;
+
+   gc->ntrans--;
+   while (gc->ngroups > gc->trans[gc->ntrans]) {
+      fprintf(gc->fp, "</g>\n");
+      gc->ngroups--;
+   }
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_concat_matrix_SVG(CPLT_gc_t gc, const float a, const float b,
+                            const float c, const float d,
+                            const float e, const float f) {
+   /* Concatenates the matrix [a b c d e f] to the current transform.
+    * here SVG: opens a group transforming the y-inverted coords, i.e.
+    * by the matrix between two y-inversions */
+
+   if (gc == NULL) return;
+
+   fprintf(gc->fp, "<g transform=\"matrix(%.6lf,%.6lf,%.6lf,%.6lf,"
+           "%.2lf,%.2lf)\">\n", a, -b, -c, d, c * gc->pheight + e,
+           gc->pheight - d * gc->pheight - f);
+   gc->ngroups++;
+
+}
+
 /*
  *******************************************************************************
  */
 
 void CPLT_finish_graphics_SVG(CPLT_gc_t gc) {
    /* Finishes graphics, closes plotfile, destroys graphics context.
-    * here SVG: writes SVG-trailer to and closes plotfile */
+    * here SVG: writes SVG-trailer to plotfile, closed by the caller */
 
    if (gc == NULL) return;
 
+   while (gc->ngroups > 0) {
+      fprintf(gc->fp, "</g>\n");
+      gc->ngroups--;
+   }
    fprintf(gc->fp, "\n</svg>\n");
-   fclose(gc->fp);
 
-   free(gc->dispatch);
+   free(gc->trans);
    free(gc);
 
 }
@@ -712,37 +983,71 @@ CPLT_point_t _polar2cart_SVG(const float cx, const float cy,
 
 /*
  *******************************************************************************
- * management function to assemble the dispatch table/struct
- * for the generic callers
+ */
+
+void _end_path_SVG(CPLT_gc_t gc) {
+   /* internal helper func to end a path with the current stroke */
+
+   fprintf(gc->fp, "\" fill=\"none\"");
+   _stroke_attrs_SVG(gc);
+   fprintf(gc->fp, "/>\n");
+
+}
+
+/*
  *******************************************************************************
  */
 
-CPLT_funcn_t *_get_dispatchFuncs_SVG(void) {
+void _stroke_attrs_SVG(CPLT_gc_t gc) {
+   /* internal helper func to write the attributes of the current stroke:
+    * color, and linewidth and dashes unless preset */
 
-   CPLT_funcn_t *dpt = (CPLT_funcn_t *) malloc(sizeof(*dpt));
-   if (dpt == NULL) {
-      fprintf(stderr, " *** Not enough memory for dispatch table!\n");
-      return NULL;
-   }
+   fprintf(gc->fp, " stroke=\"#%02X%02X%02X\"",
+           gc->curcol[0], gc->curcol[1], gc->curcol[2]);
+   if (gc->curlwd != 1)
+      fprintf(gc->fp, " stroke-width=\"%d\"", gc->curlwd);
+   if (strcmp(gc->curlsty, "none") != 0)
+      fprintf(gc->fp, " stroke-dasharray=\"%s\"", gc->curlsty);
 
-   dpt->INIT  = &CPLT_init_graphics_SVG;
-   dpt->PLINE = &CPLT_draw_polyline_SVG;
-   dpt->PGON  = &CPLT_draw_polygon_SVG;
-   dpt->PGONF = &CPLT_draw_filledPolygon_SVG;
-   dpt->ARC   = &CPLT_draw_arc_SVG;
-   dpt->ARCF  = &CPLT_draw_filledArc_SVG;
-   dpt->CURVE = &CPLT_draw_curve_SVG;
-   dpt->MARK  = &CPLT_draw_marker_SVG;
-   dpt->TEXT  = &CPLT_draw_text_SVG;
-   dpt->FSIZE = &CPLT_set_fontsize_SVG;
-   dpt->COLR  = &CPLT_set_color_SVG;
-   dpt->LNWD  = &CPLT_set_linewidth_SVG;
-   dpt->LNSTY = &CPLT_set_linestyle_SVG;
-   dpt->FINI  = &CPLT_finish_graphics_SVG;
-
-   return dpt;
 }
 
+/*
+ *******************************************************************************
+ * dispatch table of the format's functions for the generic callers
+ *******************************************************************************
+ */
+
+const CPLT_funcn_t CPLT_dispatch_SVG = {
+   .INIT  = &CPLT_init_graphics_SVG,
+   .PLINE = &CPLT_draw_polyline_SVG,
+   .SEGS  = &CPLT_draw_segments_SVG,
+   .PGON  = &CPLT_draw_polygon_SVG,
+   .PGONF = &CPLT_draw_filledPolygon_SVG,
+   .ARC   = &CPLT_draw_arc_SVG,
+   .ARCF  = &CPLT_draw_filledArc_SVG,
+   .CURVE = &CPLT_draw_curve_SVG,
+   .MARK  = &CPLT_draw_marker_SVG,
+   .TEXT  = &CPLT_draw_text_SVG,
+   .FSIZE = &CPLT_set_fontsize_SVG,
+   .COLR  = &CPLT_set_color_SVG,
+   .LNWD  = &CPLT_set_linewidth_SVG,
+   .LNSTY = &CPLT_set_linestyle_SVG,
+   .FINI  = &CPLT_finish_graphics_SVG,
+   .SYMD  = &CPLT_define_symbol_SVG,
+   .SYME  = &CPLT_end_symbol_SVG,
+   .SYMP  = &CPLT_place_symbol_SVG,
+   .BRNCH = NULL,   /* no branching */
+   .REPL  = NULL,   /* no recording */
+   .PATHB = &CPLT_path_begin_SVG,
+   .MOVE  = &CPLT_path_moveto_SVG,
+   .LINE  = &CPLT_path_lineto_SVG,
+   .STROKE = &CPLT_path_stroke_SVG,
+   .FILL  = &CPLT_path_fill_SVG,
+   .PUSH  = &CPLT_push_transform_SVG,
+   .POP   = &CPLT_pop_transform_SVG,
+   .CONCAT = &CPLT_concat_matrix_SVG,
+};
+
 /*
  *******************************************************************************
  */
@@ -87,7 +87,7 @@ int _anchor_num_of(char *anchor) {
 
    int i;
    char *as;
-   static char *anchors[10] =
+   static const char *const anchors[10] =
       { "", "sw", "s", "se", "w", "c", "e", "nw", "n", "ne" };
 
    for (i = 1; i < 10; i++)
@@ -104,3 +104,127 @@ int _anchor_num_of(char *anchor) {
  *******************************************************************************
  */
 
+int _same_color(const float c1[3], const float c2[3]) {
+   /* returns 1 if the colors c1 and c2 (RGB values [0,1]) are the same,
+    * once clamped to [0,1], else 0 */
+
+   int i;
+   float v1, v2;
+
+   for (i = 0; i < 3; i++) {
+      v1 = c1[i] < 0. ? 0. : c1[i] > 1. ? 1. : c1[i];
+      v2 = c2[i] < 0. ? 0. : c2[i] > 1. ? 1. : c2[i];
+      if (v1 != v2) return 0;
+   }
+
+   return 1;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void *_arena_alloc(CPLT_arena_t *arena, size_t size) {
+   /* returns size bytes of scratch memory from arena, valid up to the next
+    * _arena_reset(), or NULL if out of memory */
+
+   _arena_chunk_t *c = arena->chunk;
+   size_t cap;
+   void *p;
+
+   /* keep the alignment of double for all requests */
+   size = (size + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+
+   /* fast path: small requests fit into the inline buffer */
+   if (arena->used + size <= sizeof(arena->small)) {
+      p = (char *)arena->small + arena->used;
+      arena->used += size;
+      return p;
+   }
+
+   /* else bump the chunk, or start a larger one before it */
+   if (c == NULL || c->used + size > c->cap) {
+      cap = c ? 2 * c->cap : 4 * sizeof(arena->small);
+      if (cap < size) cap = size;
+      if ((c = (_arena_chunk_t *) malloc(sizeof(*c) + cap)) == NULL)
+         return NULL;
+      c->prev = arena->chunk;
+      c->cap = cap;
+      c->used = 0;
+      arena->chunk = c;
+   }
+   p = (char *)c->data + c->used;
+   c->used += size;
+
+   return p;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _arena_reset(CPLT_arena_t *arena) {
+   /* releases all scratch memory of arena at once, but keeps its largest
+    * chunk for the next requests */
+
+   _arena_chunk_t *c, *prev;
+
+   arena->used = 0;
+   if (arena->chunk == NULL) return;
+   for (c = arena->chunk->prev; c != NULL; c = prev) {
+      prev = c->prev;
+      free(c);
+   }
+   arena->chunk->prev = NULL;
+   arena->chunk->used = 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _arena_free(CPLT_arena_t *arena) {
+   /* frees the memory of arena and leaves it empty, as initialized
+    * by arena->used = 0 and arena->chunk = NULL */
+
+   _arena_reset(arena);
+   free(arena->chunk);
+   arena->chunk = NULL;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _unknown_state(CPLT_state_t *state) {
+   /* marks all of the cached graphics state as unknown,
+    * so the next call of each CPLT_set_...() is passed on */
+
+   state->col[0] = state->col[1] = state->col[2] = -1.;
+   state->lwd = -1.;
+   state->fsize = -1.;
+   state->lsty = -1;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _init_view(CPLT_view_t *view, const unsigned int pwidth,
+                const unsigned int pheight) {
+   /* sets view to the canvas of pwidth x pheight [pix] and the identity
+    * transform, with culling off */
+
+   static const float id[6] = { 1., 0., 0., 1., 0., 0. };
+
+   view->cull = 0;
+   view->w = pwidth;
+   view->h = pheight;
+   memcpy(view->tm, id, sizeof(id));
+   view->depth = 0;
+   view->insym = 0;
+}
+
+/*
+ *******************************************************************************
+ */
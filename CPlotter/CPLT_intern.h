@@ -31,9 +31,12 @@
 /* the function types */
 typedef CPLT_gc_t INIT_ft(const unsigned int pwidth,
                           const unsigned int pheight,
-                          char *plotfilename);
+                          char *plotfilename, FILE *fp);
 typedef void PLINE_ft(CPLT_gc_t gc, const int numpts,
                       CPLT_point_t points[]);
+typedef void SEGS_ft(CPLT_gc_t gc, const int n,
+                     const CPLT_point_t segments[], const float widths[],
+                     const float colors[][3]);
 typedef void PGON_ft(CPLT_gc_t gc, const int numpts,
                      CPLT_point_t points[]);
 typedef void PGONF_ft(CPLT_gc_t gc, const int numpts,
@@ -54,11 +57,76 @@ typedef void COLR_ft(CPLT_gc_t gc, float r, float g, float b);
 typedef void LNWD_ft(CPLT_gc_t gc, const float w);
 typedef void LNSTY_ft(CPLT_gc_t gc, const CPLT_lnstyle_t s);
 typedef void FINI_ft(CPLT_gc_t gc);
+typedef int SYMD_ft(CPLT_gc_t gc, const int id);
+typedef void SYME_ft(CPLT_gc_t gc);
+typedef void SYMP_ft(CPLT_gc_t gc, const int id, const float x, const float y,
+                     const float scale, const float angle);
+typedef int BRNCH_ft(CPLT_gc_t gc, const float x, const float y,
+                     const float angle, const float len,
+                     const float step, const float scale,
+                     const int depth, const float widths[],
+                     const float colors[][2][3]);
+typedef int REPL_ft(CPLT_gc_t gc, char *plotfilename);
+typedef void PATHB_ft(CPLT_gc_t gc);
+typedef void MOVE_ft(CPLT_gc_t gc, const float x, const float y);
+typedef void LINE_ft(CPLT_gc_t gc, const float x, const float y);
+typedef void STROKE_ft(CPLT_gc_t gc);
+typedef void FILL_ft(CPLT_gc_t gc);
+typedef void PUSH_ft(CPLT_gc_t gc);
+typedef void POP_ft(CPLT_gc_t gc);
+typedef void CONCAT_ft(CPLT_gc_t gc, const float a, const float b,
+                       const float c, const float d,
+                       const float e, const float f);
+
+/* the graphics state as last set through the generic API.
+ * Every format's gctx holds it right after the filepointer and its
+ * buffer, so that CPlotter.c can drop calls that wouldn't change
+ * anything. Built with CPLT_STATS defined, the counters of
+ * CPLT_get_stats() follow it. */
+typedef struct {
+   float col[3];           /* current color, RGB [0,1], col[0]<0: unknown */
+   float lwd;              /* current linewidth [pix], <0: unknown */
+   float fsize;            /* current fontsize [pix], <0: unknown */
+   int lsty;               /* current linestyle [enumeration], <0: unknown */
+} CPLT_state_t;
+
+/* the canvas and the current transform as concatenated through the
+ * generic API, for the culling of CPLT_set_culling(). Every format's gctx
+ * holds it right after the state. Only the transforms pushed up to
+ * VIEW_MAXDEPTH deep are tracked, no culling below them. */
+#define VIEW_MAXDEPTH 32
+typedef struct {
+   int cull;               /* if culling is on */
+   float w, h;             /* canvas [pix] */
+   float tm[6];            /* current transform [a b c d e f] */
+   int depth;              /* transforms pushed and not popped yet */
+   float stack[VIEW_MAXDEPTH][6];   /* the pushed ones */
+   int insym;              /* if defining a symbol, not culled */
+   float symtm[6];         /* the transform and depth */
+   int symdepth;           /* before the symbol */
+} CPLT_view_t;
+
+/* a bump arena for the scratch memory of the drawing calls of a gctx:
+ * requests are served from the small inline buffer while it lasts, else
+ * from a heap chunk, kept across calls and replaced by a larger one as
+ * needed. _arena_reset() releases all at once, when the call is done. */
+#define ARENA_SMALL 4096   /* bytes of the inline buffer */
+typedef struct _arena_chunk {
+   struct _arena_chunk *prev;   /* smaller chunk before, still in use */
+   size_t cap, used;            /* bytes of data, of them handed out */
+   double data[];               /* aligned for any scratch */
+} _arena_chunk_t;
+typedef struct {
+   size_t used;                 /* bytes of small handed out */
+   _arena_chunk_t *chunk;       /* the latest, largest chunk or NULL */
+   double small[ARENA_SMALL / sizeof(double)];
+} CPLT_arena_t;
 
 /* the type for the dispatch table, named pointers to the API functions */
 typedef struct {
    INIT_ft  *INIT;
    PLINE_ft *PLINE;
+   SEGS_ft  *SEGS;
    PGON_ft  *PGON;
    PGONF_ft *PGONF;
    ARC_ft   *ARC;
@@ -71,8 +139,27 @@ typedef struct {
    LNWD_ft  *LNWD;
    LNSTY_ft *LNSTY;
    FINI_ft  *FINI;
+   SYMD_ft  *SYMD;   /* symbols, NULL if the format has none */
+   SYME_ft  *SYME;
+   SYMP_ft  *SYMP;
+   BRNCH_ft *BRNCH;  /* NULL if the format has no branching */
+   REPL_ft  *REPL;   /* NULL unless recording */
+   PATHB_ft *PATHB;  /* streamed path */
+   MOVE_ft  *MOVE;
+   LINE_ft  *LINE;
+   STROKE_ft *STROKE;
+   FILL_ft  *FILL;
+   PUSH_ft  *PUSH;   /* transform stack */
+   POP_ft   *POP;
+   CONCAT_ft *CONCAT;
 } CPLT_funcn_t;
 
+/* the dispatch tables of the formats, and of the recording */
+extern const CPLT_funcn_t CPLT_dispatch_EPS;
+extern const CPLT_funcn_t CPLT_dispatch_PNG;
+extern const CPLT_funcn_t CPLT_dispatch_SVG;
+extern const CPLT_funcn_t CPLT_dispatch_REC;
+
 /************************************************************************/
 
 /* === _internal_ function prototypes === */
@@ -96,5 +183,38 @@ int _rnd(const float x);
 int _anchor_num_of(char *anchor);
 /* returns the number [1-9] of the text anchor string, 0 on error */
 
+int _same_color(const float c1[3], const float c2[3]);
+/* returns 1 if the colors c1 and c2 (RGB values [0,1]) are the same,
+ * once clamped to [0,1], else 0 */
+
+void *_arena_alloc(CPLT_arena_t *arena, size_t size);
+/* returns size bytes of scratch memory from arena, valid up to the next
+ * _arena_reset(), or NULL if out of memory */
+
+void _arena_reset(CPLT_arena_t *arena);
+/* releases all scratch memory of arena at once, but keeps its largest
+ * chunk for the next requests */
+
+void _arena_free(CPLT_arena_t *arena);
+/* frees the memory of arena and leaves it empty, as initialized
+ * by arena->used = 0 and arena->chunk = NULL */
+
+void _unknown_state(CPLT_state_t *state);
+/* marks all of the cached graphics state as unknown,
+ * so the next call of each CPLT_set_...() is passed on */
+
+void _init_view(CPLT_view_t *view, const unsigned int pwidth,
+                const unsigned int pheight);
+/* sets view to the canvas of pwidth x pheight [pix] and the identity
+ * transform, with culling off */
+
+double _trace_start(void);
+/* returns the time [s] to pass to _trace_end(), 0 if no trace of
+ * CPLT_trace() is written (in CPlotter.c) */
+
+void _trace_end(const char *name, const double t0);
+/* writes the event name, lasting from t0 of _trace_start() up to now,
+ * to the trace, if one is written (in CPlotter.c) */
+
 #endif
 
@@ -11,8 +11,67 @@
  * License: LGPL 3.0, see http://www.gnu.org/licenses/lgpl-3.0.en.html
  */
 
+#define _GNU_SOURCE     /* fopencookie() for CPLT_init_graphics_callback() */
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
 #include "CPLT_intern.h"
 
+/* size of the buffer of CPLT_init_graphics_buffered() by default */
+#define SINKBUFSIZE (1 << 20)
+
+/* consecutive calls of a function in a trace event by default */
+#define TRACECALLS 100
+
+
+/* Built with CPLT_STATIC_EPS, _PNG or _SVG defined (see Makefile), the
+ * API is bound to this single format: the calls go to its functions by
+ * its constant dispatch table instead of the gc's, so with link time
+ * optimization they may be inlined into the client. Recordings are not
+ * available then, as their gc dispatches to the recording's functions. */
+#if defined(CPLT_STATIC_EPS)
+#define CPLT_STATIC_BACKEND CPLT_dispatch_EPS
+#elif defined(CPLT_STATIC_PNG)
+#define CPLT_STATIC_BACKEND CPLT_dispatch_PNG
+#elif defined(CPLT_STATIC_SVG)
+#define CPLT_STATIC_BACKEND CPLT_dispatch_SVG
+#endif
+
+#ifdef CPLT_STATIC_BACKEND
+#define DISPATCH(gc) (&CPLT_STATIC_BACKEND)
+#else
+#define DISPATCH(gc) ((gc)->dispatch)
+#endif
+
+/* Built with CPLT_STATS defined (see Makefile), the calls of the format's
+ * functions are counted and timed in the gc, for CPLT_get_stats(),
+ * else these expand to the bare call or to nothing, but while tracing
+ * (see CPLT_trace()) the calls are timed for the trace all the same. */
+#define TRACING __atomic_load_n(&tracing, __ATOMIC_RELAXED)
+#ifdef CPLT_STATS
+#define COUNT(gc, func, call) \
+   do { double t0_ = _seconds(); call; _count(gc, func, t0_); } while (0)
+#define COUNT_POINTS(gc, n) ((gc)->stats.points += (n))
+#define COUNT_ELIDED(gc) ((gc)->stats.elided++)
+#define COUNT_CULLED(gc, n) ((gc)->stats.culled += (n))
+#else
+#define COUNT(gc, func, call) \
+   do { \
+      if (!TRACING) { call; } \
+      else { double t0_ = _seconds(); call; _count(gc, func, t0_); } \
+   } while (0)
+#define COUNT_POINTS(gc, n)
+#define COUNT_ELIDED(gc)
+#define COUNT_CULLED(gc, n)
+#endif
+
+/* if the drawing calls of gc are culled, see CPLT_set_culling(): on, and
+ * the transform is tracked and not the symbol's being defined */
+#define CULLING(gc) ((gc)->view.cull && !(gc)->view.insym && \
+                     (gc)->view.depth <= VIEW_MAXDEPTH)
+
 
 /* Array of implemented backends/graphics formats, defining name,
  * expected suffix and pointer to format-specific init function.
@@ -20,33 +79,138 @@
 INIT_ft CPLT_init_graphics_EPS;
 INIT_ft CPLT_init_graphics_PNG;
 INIT_ft CPLT_init_graphics_SVG;
+INIT_ft CPLT_init_graphics_REC;   /* not a format, see CPLT_replay() */
+CPLT_gc_t CPLT_init_graphics_MULTI(const unsigned int pwidth,
+                                   const unsigned int pheight,
+                                   char *plotfilenames[], const int n);
 struct {
    char *name;
    char *suffix;
    INIT_ft *initFunc;
 } GFORMAT[] = {
+#if !defined(CPLT_STATIC_BACKEND) || defined(CPLT_STATIC_EPS)
    {
       "Encapsulated Postscript vector graphics (PS-Adobe-3.0 EPSF-3.0)",
       "eps",
       &CPLT_init_graphics_EPS
    },
+#endif
+#if !defined(CPLT_STATIC_BACKEND) || defined(CPLT_STATIC_PNG)
    {
       "Portable Network Graphics, true-color raster image (PNG 1.2)",
       "png",
       &CPLT_init_graphics_PNG
    },
+#endif
+#if !defined(CPLT_STATIC_BACKEND) || defined(CPLT_STATIC_SVG)
    {
       "Scalable Vector Graphics (SVG 1.1)",
       "svg",
       &CPLT_init_graphics_SVG
    },
+#endif
 };
 
 
+/* the client's write function of CPLT_init_graphics_callback(), as the
+ * cookie of fopencookie() */
+typedef struct {
+   CPLT_write_ft *write;
+   void *arg;
+   long written;           /* bytes taken, for ftell() */
+} _sink_t;
+
+/* the names of the functions, as in CPLT_func_t */
+static const char *const FUNCNAME[CPLT_NumFuncs] = {
+   "init", "polyline", "segments", "polygon", "filledPolygon",
+   "arc", "filledArc", "curve", "marker", "text",
+   "fontsize", "color", "linewidth", "linestyle", "finish",
+   "define_symbol", "end_symbol", "place_symbol", "branching", "replay",
+   "path_begin", "path_moveto", "path_lineto", "path_stroke", "path_fill",
+   "push_transform", "pop_transform", "concat_matrix"
+};
+
+/* the trace of CPLT_trace(), written by all threads: tracefp and the
+ * rest guarded by tracemtx, tracing read without as it's just a hint */
+static int tracing;                    /* 1 while tracefp is open */
+static FILE *tracefp;                  /* the trace file */
+static double trace_t0;                /* its time 0 [s] */
+static unsigned long trace_nev;        /* events written to it */
+static unsigned long trace_calls = TRACECALLS;   /* calls per event */
+static pthread_mutex_t tracemtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t traceenv_once = PTHREAD_ONCE_INIT;
+
+/* the consecutive calls of a gc by this thread, to be written as one
+ * trace event */
+static __thread struct {
+   CPLT_gc_t gc;
+   unsigned long n;        /* number of calls, 0: none */
+   unsigned long calls[CPLT_NumFuncs];   /* of them of each function */
+   double t0, t1;          /* begin of the first, end of the last [s] */
+   double busy;            /* time spent in them [s] */
+} batch;
+
+/* the plotfile of CPLT_init_graphics_async(), as the cookie of
+ * fopencookie(): the drawing thread fills one buffer, while the writer
+ * thread writes the other one to fp */
+typedef struct {
+   FILE *fp;               /* the plotfile, written by the writer only */
+   char *buf[2];           /* the buffers, filled and written in turn */
+   size_t size;            /* bytes of each */
+   size_t fill;            /* bytes in buf[cur] */
+   int cur;                /* buffer filled by the drawing thread */
+   size_t pending;         /* bytes of buf[!cur] to be written, 0: none */
+   int done;               /* no more buffers */
+   int err;                /* if a write failed */
+   long written;           /* bytes taken, for ftell() */
+   pthread_mutex_t mtx;
+   pthread_cond_t cond;    /* signalled if pending or done changes */
+   pthread_t tid;          /* the writer thread */
+} _async_t;
+
+/* prototypes of internal helper functions */
+INIT_ft *_format_of(char *plotfilename);
+CPLT_gc_t _init_sink(INIT_ft *init, const unsigned int pwidth,
+                     const unsigned int pheight, char *plotfilename,
+                     FILE *fp, char *fpbuf);
+ssize_t _write_sink(void *cookie, const char *data, size_t len);
+int _seek_sink(void *cookie, off64_t *offset, int whence);
+int _close_sink(void *cookie);
+ssize_t _write_async(void *cookie, const char *data, size_t len);
+int _seek_async(void *cookie, off64_t *offset, int whence);
+int _close_async(void *cookie);
+int _hand_over_async(_async_t *as);
+void *_writer_async(void *arg);
+double _seconds(void);
+void _count(CPLT_gc_t gc, const CPLT_func_t func, const double t0);
+float _margin(CPLT_gc_t gc);
+int _visible(const CPLT_view_t *view, const CPLT_point_t p[], const int n,
+             const float r);
+void _cull_polyline(CPLT_gc_t gc, const int numpts, CPLT_point_t points[]);
+void _cull_segments(CPLT_gc_t gc, const int n,
+                    const CPLT_point_t segments[], const float widths[],
+                    const float colors[][3]);
+#ifdef CPLT_STATS
+void _print_stats(const CPLT_stats_t *stats, FILE *fp);
+#endif
+int _trace_to(const char *tracefile, const int calls);
+void _trace_from_env(void);
+void _trace_atexit(void);
+void _trace_flush(void);
+void _trace_event(const char *name, const double t0, const double t1,
+                  const unsigned long *calls, const double busy);
+
+
 /* (minimal) graphics context (common part of all backends), for dispatching */
 struct CPLT_gctx {
-   CPLT_funcn_t *dispatch; /* functions dispatch table */
+   const CPLT_funcn_t *dispatch; /* functions dispatch table */
    FILE *fp;               /* filepointer to plotfile */
+   char *fpbuf;            /* fp's buffer, if not stdio's own */
+   CPLT_state_t state;     /* as set by the generic API */
+   CPLT_view_t view;       /* culled by the generic API */
+#ifdef CPLT_STATS
+   CPLT_stats_t stats;     /* counted by the generic API */
+#endif
 };
 
 /*
@@ -63,38 +227,288 @@ CPLT_gc_t CPLT_init_graphics(const unsigned int pwidth,
     * The graphics-format specific suffix (.eps, .svg, .png)
     * must be included and determines the graphics format/backend used. */
 
-   int i, l, NGF, GFMT_IDX = -1;
-   char *sfx;            /* file-suffix from plotfilename */
+   INIT_ft *init;
+   FILE *fp;
 
-   /* graphics format requested */
-   NGF = sizeof(GFORMAT) / sizeof(GFORMAT[0]);
-   l = strlen(plotfilename);
-   sfx = _extract_lowered_suffix(plotfilename);
-   if (l > 3 && sfx) {
-      for (i = 0; i < NGF; i++) {
-         if (strcmp(GFORMAT[i].suffix, sfx) == 0) {
-            GFMT_IDX = i;
-            break;
-         }
-      }
+   if ((init = _format_of(plotfilename)) == NULL) return NULL;
+   if ((fp = fopen(plotfilename, "wb")) == NULL) {
+      fprintf(stderr,
+              " *** Can't open output plotfile '%s'!\n", plotfilename);
+      return NULL;
    }
-   if (GFMT_IDX < 0) {   /* requested suffix/format not implemented */
+
+   return _init_sink(init, pwidth, pheight, plotfilename, fp, NULL);
+}
+
+/*
+ *******************************************************************************
+ */
+
+CPLT_gc_t CPLT_init_graphics_buffered(const unsigned int pwidth,
+                                      const unsigned int pheight,
+                                      char *plotfilename,
+                                      const size_t bufsize) {
+   /* Initializes graphics like CPLT_init_graphics(), but the plotfile is
+    * written through a buffer of bufsize bytes (0: 1 MiB), by few large
+    * writes. Returns graphics context pointer. */
+
+   INIT_ft *init;
+   FILE *fp;
+   char *fpbuf;
+   size_t size = bufsize > 0 ? bufsize : SINKBUFSIZE;
+
+   if ((init = _format_of(plotfilename)) == NULL) return NULL;
+   if ((fpbuf = (char *) malloc(size)) == NULL) {
+      fprintf(stderr, " *** Not enough memory for plotfile buffer!\n");
+      return NULL;
+   }
+   if ((fp = fopen(plotfilename, "wb")) == NULL) {
       fprintf(stderr,
-              "\n *** ERR: The graphics format requested by suffix '%s'\n"
-              " *** (from plotfilename '%s')\n"
-              " *** is not implemented! Known suffixes are:\n",
-              (sfx ? sfx : ""), plotfilename);
-      for (i = 0; i < NGF; i++)
-         fprintf(stderr, " ***    %s: %s\n",
-                 GFORMAT[i].suffix, GFORMAT[i].name);
+              " *** Can't open output plotfile '%s'!\n", plotfilename);
+      free(fpbuf);
       return NULL;
    }
-   if (sfx) free(sfx);
+   setvbuf(fp, fpbuf, _IOFBF, size);
 
-   /* propagate this generic function call to format specific one,
-    * moreover this fills the dispatch table in the gc for calling
-    * all further format specific functions */
-   return (*(GFORMAT[GFMT_IDX].initFunc))(pwidth, pheight, plotfilename);
+   return _init_sink(init, pwidth, pheight, plotfilename, fp, fpbuf);
+}
+
+/*
+ *******************************************************************************
+ */
+
+CPLT_gc_t CPLT_init_graphics_memory(const unsigned int pwidth,
+                                    const unsigned int pheight,
+                                    char *plotname, char **buf, size_t *len) {
+   /* Initializes graphics of pwidth x pheight [pix], written to a buffer
+    * in memory growing as needed instead of a plotfile, the suffix of
+    * plotname determines the graphics format as by CPLT_init_graphics(),
+    * no file is written. CPLT_finish_graphics() sets *buf to the
+    * malloc'ed plot of *len bytes, the caller must free() it.
+    * Returns graphics context pointer. */
+
+   INIT_ft *init;
+   CPLT_gc_t gc;
+   FILE *fp;
+
+   if ((init = _format_of(plotname)) == NULL) return NULL;
+   if ((fp = open_memstream(buf, len)) == NULL) {
+      fprintf(stderr, " *** Not enough memory for plot buffer!\n");
+      return NULL;
+   }
+
+   if ((gc = _init_sink(init, pwidth, pheight, plotname, fp, NULL)) == NULL) {
+      free(*buf);               /* closing the stream has set *buf */
+      *buf = NULL;
+      *len = 0;
+   }
+   return gc;
+}
+
+/*
+ *******************************************************************************
+ */
+
+CPLT_gc_t CPLT_init_graphics_callback(const unsigned int pwidth,
+                                      const unsigned int pheight,
+                                      char *plotname,
+                                      CPLT_write_ft *write, void *arg) {
+   /* Initializes graphics of pwidth x pheight [pix] like
+    * CPLT_init_graphics_memory(), but the plot is passed on in pieces
+    * to the client's write(arg, data, len) as it is written, the last
+    * ones by CPLT_finish_graphics().
+    * Returns graphics context pointer. */
+
+   INIT_ft *init;
+   FILE *fp;
+   _sink_t *sink;
+   cookie_io_functions_t io = { NULL, &_write_sink, &_seek_sink,
+                                &_close_sink };
+
+   if ((init = _format_of(plotname)) == NULL) return NULL;
+   if ((sink = (_sink_t *) malloc(sizeof(*sink))) == NULL) {
+      fprintf(stderr, " *** Not enough memory for plot sink!\n");
+      return NULL;
+   }
+   sink->write = write;
+   sink->arg = arg;
+   sink->written = 0;
+   if ((fp = fopencookie(sink, "wb", io)) == NULL) {
+      fprintf(stderr, " *** Can't open plot sink!\n");
+      free(sink);
+      return NULL;
+   }
+
+   return _init_sink(init, pwidth, pheight, plotname, fp, NULL);
+}
+
+/*
+ *******************************************************************************
+ */
+
+CPLT_gc_t CPLT_init_graphics_fd(const unsigned int pwidth,
+                                const unsigned int pheight,
+                                char *plotname, const int fd) {
+   /* Initializes graphics of pwidth x pheight [pix] like
+    * CPLT_init_graphics_memory(), but written to the open file
+    * descriptor fd, e.g. of a pipe or socket, which
+    * CPLT_finish_graphics() leaves open.
+    * Returns graphics context pointer. */
+
+   INIT_ft *init;
+   FILE *fp;
+   int dupfd;
+
+   if ((init = _format_of(plotname)) == NULL) return NULL;
+   if ((dupfd = dup(fd)) < 0 || (fp = fdopen(dupfd, "wb")) == NULL) {
+      fprintf(stderr, " *** Can't write plot '%s' to file descriptor %d!\n",
+              plotname, fd);
+      if (dupfd >= 0) close(dupfd);
+      return NULL;
+   }
+
+   return _init_sink(init, pwidth, pheight, plotname, fp, NULL);
+}
+
+/*
+ *******************************************************************************
+ */
+
+CPLT_gc_t CPLT_init_graphics_async(const unsigned int pwidth,
+                                   const unsigned int pheight,
+                                   char *plotfilename,
+                                   const size_t bufsize) {
+   /* Initializes graphics like CPLT_init_graphics(), but the plotfile is
+    * written by a thread of its own, while the client goes on drawing:
+    * the format's output fills one of two buffers of bufsize bytes
+    * (0: 1 MiB), the other one is written meanwhile. Once both are full,
+    * drawing waits for the writing. CPLT_finish_graphics() returns when
+    * all is written. Returns graphics context pointer. */
+
+   INIT_ft *init;
+   FILE *fp;
+   _async_t *as;
+   cookie_io_functions_t io = { NULL, &_write_async, &_seek_async,
+                                &_close_async };
+
+   if ((init = _format_of(plotfilename)) == NULL) return NULL;
+   if ((as = (_async_t *) calloc(1, sizeof(*as))) == NULL) {
+      fprintf(stderr, " *** Not enough memory for plotfile buffers!\n");
+      return NULL;
+   }
+   as->size = bufsize > 0 ? bufsize : SINKBUFSIZE;
+   if ((as->buf[0] = (char *) malloc(as->size)) == NULL
+       || (as->buf[1] = (char *) malloc(as->size)) == NULL) {
+      fprintf(stderr, " *** Not enough memory for plotfile buffers!\n");
+      free(as->buf[0]);
+      free(as);
+      return NULL;
+   }
+   if ((as->fp = fopen(plotfilename, "wb")) == NULL) {
+      fprintf(stderr,
+              " *** Can't open output plotfile '%s'!\n", plotfilename);
+      free(as->buf[0]);
+      free(as->buf[1]);
+      free(as);
+      return NULL;
+   }
+   /* the writes go to the buffers directly, not through stdio's */
+   setvbuf(as->fp, NULL, _IONBF, 0);
+   pthread_mutex_init(&as->mtx, NULL);
+   pthread_cond_init(&as->cond, NULL);
+   if (pthread_create(&as->tid, NULL, &_writer_async, as) != 0) {
+      fprintf(stderr, " *** Can't start writer of plotfile '%s'!\n",
+              plotfilename);
+      pthread_cond_destroy(&as->cond);
+      pthread_mutex_destroy(&as->mtx);
+      fclose(as->fp);
+      free(as->buf[0]);
+      free(as->buf[1]);
+      free(as);
+      return NULL;
+   }
+   if ((fp = fopencookie(as, "wb", io)) == NULL) {
+      fprintf(stderr, " *** Can't open plot sink!\n");
+      _close_async(as);
+      return NULL;
+   }
+   setvbuf(fp, NULL, _IONBF, 0);
+
+   return _init_sink(init, pwidth, pheight, plotfilename, fp, NULL);
+}
+
+/*
+ *******************************************************************************
+ */
+
+CPLT_gc_t CPLT_init_graphics_multi(const unsigned int pwidth,
+                                   const unsigned int pheight,
+                                   char *plotfilenames[], const int n) {
+   /* Initializes graphics of pwidth x pheight [pix] in the n graphics files
+    * plotfilenames at once, their suffixes determine the graphics formats.
+    * The drawing calls are passed on to each plotfile's graphics format,
+    * every one drawing on a thread of its own.
+    * Returns graphics context pointer. */
+
+#ifdef CPLT_STATIC_BACKEND
+   fprintf(stderr, " *** CPlotter: bound to one format, "
+           "can't draw several plotfiles at once!\n");
+   return NULL;
+#else
+   CPLT_gc_t gc;
+
+   pthread_once(&traceenv_once, &_trace_from_env);
+   COUNT(gc, CPLT_InitFunc,
+         gc = CPLT_init_graphics_MULTI(pwidth, pheight, plotfilenames, n));
+   return gc;
+#endif
+}
+
+/*
+ *******************************************************************************
+ */
+
+CPLT_gc_t CPLT_init_recording(const unsigned int pwidth,
+                              const unsigned int pheight) {
+   /* Initializes a recording of graphics of pwidth x pheight [pix]: the
+    * drawing calls to it are not rendered, but appended to a display list
+    * in memory, to be drawn into plotfiles by CPLT_replay().
+    * Returns graphics context pointer. */
+
+#ifdef CPLT_STATIC_BACKEND
+   fprintf(stderr, " *** CPlotter: bound to one format, "
+           "can't record!\n");
+   return NULL;
+#else
+   CPLT_gc_t gc;
+
+   pthread_once(&traceenv_once, &_trace_from_env);
+   COUNT(gc, CPLT_InitFunc,
+         gc = CPLT_init_graphics_REC(pwidth, pheight, NULL, NULL));
+   return gc;
+#endif
+}
+
+/*
+ *******************************************************************************
+ */
+
+int CPLT_replay(CPLT_gc_t gc, char *plotfilename) {
+   /* Draws the calls recorded by gc into graphics file plotfilename of
+    * the recorded size, the suffix determines the graphics format.
+    * Returns 0, or -1 on error. */
+
+   int ret;
+
+   if (DISPATCH(gc)->REPL == NULL) {
+      fprintf(stderr, " *** CPlotter: graphics context is no recording!\n");
+      return -1;
+   }
+
+   /* propagate this generic function call to format specific one */
+   COUNT(gc, CPLT_ReplayFunc,
+         ret = (*(DISPATCH(gc)->REPL))(gc, plotfilename));
+   return ret;
 }
 
 /*
@@ -105,8 +519,15 @@ void CPLT_draw_polyline(CPLT_gc_t gc, int numpts, CPLT_point_t points[]) {
    /* Plots line through numpts 2D-points at given x/y-pairs in array points.
     * Draws line with current color and linewidth/style. */
 
+   /* cut it to the canvas, if culling */
+   if (CULLING(gc) && numpts > 1) {
+      _cull_polyline(gc, numpts, points);
+      return;
+   }
+
    /* propagate this generic function call to format specific one */
-   (*(gc->dispatch->PLINE))(gc, numpts, points);
+   COUNT_POINTS(gc, numpts);
+   COUNT(gc, CPLT_PolylineFunc, (*(DISPATCH(gc)->PLINE))(gc, numpts, points));
 
 }
 
@@ -119,8 +540,15 @@ void CPLT_draw_polygon(CPLT_gc_t gc, int numpts, CPLT_point_t points[]) {
     * x/y-pairs in array points.
     * Draws outline of the polygon with current color and linewidth/style. */
 
+   /* drop it, if it's off the canvas */
+   if (CULLING(gc) && !_visible(&gc->view, points, numpts, _margin(gc))) {
+      COUNT_CULLED(gc, 1);
+      return;
+   }
+
    /* propagate this generic function call to format specific one */
-   (*(gc->dispatch->PGON))(gc, numpts, points);
+   COUNT_POINTS(gc, numpts);
+   COUNT(gc, CPLT_PolygonFunc, (*(DISPATCH(gc)->PGON))(gc, numpts, points));
 }
 
 /*
@@ -132,8 +560,16 @@ void CPLT_draw_filledPolygon(CPLT_gc_t gc, int numpts, CPLT_point_t points[]) {
     * x/y-pairs in array points.
     * Fills and strokes the polygon with current color. */
 
+   /* drop it, if it's off the canvas */
+   if (CULLING(gc) && !_visible(&gc->view, points, numpts, _margin(gc))) {
+      COUNT_CULLED(gc, 1);
+      return;
+   }
+
    /* propagate this generic function call to format specific one */
-   (*(gc->dispatch->PGONF))(gc, numpts, points);
+   COUNT_POINTS(gc, numpts);
+   COUNT(gc, CPLT_FilledPolygonFunc,
+         (*(DISPATCH(gc)->PGONF))(gc, numpts, points));
 }
 
 /*
@@ -151,8 +587,17 @@ void CPLT_draw_arc(CPLT_gc_t gc, const float cx, const float cy,
     * Both angles turn counterclockwise, i.e. mathematically positive.
     * Draws outline of the arc with current color and linewidth/style. */
 
+   CPLT_point_t c = { cx, cy };
+
+   /* drop it, if it's off the canvas */
+   if (CULLING(gc) && !_visible(&gc->view, &c, 1, radius + _margin(gc))) {
+      COUNT_CULLED(gc, 1);
+      return;
+   }
+
    /* propagate this generic function call to format specific one */
-   (*(gc->dispatch->ARC))(gc, cx, cy, radius, start, end);
+   COUNT(gc, CPLT_ArcFunc,
+         (*(DISPATCH(gc)->ARC))(gc, cx, cy, radius, start, end));
 }
 
 /*
@@ -170,8 +615,17 @@ void CPLT_draw_filledArc(CPLT_gc_t gc, const float cx, const float cy,
     * Both angles turn counterclockwise, i.e. mathematically positive.
     * Fills and strokes the arc/"pie slice" with current color. */
 
+   CPLT_point_t c = { cx, cy };
+
+   /* drop it, if it's off the canvas */
+   if (CULLING(gc) && !_visible(&gc->view, &c, 1, radius + _margin(gc))) {
+      COUNT_CULLED(gc, 1);
+      return;
+   }
+
    /* propagate this generic function call to format specific one */
-   (*(gc->dispatch->ARCF))(gc, cx, cy, radius, start, end);
+   COUNT(gc, CPLT_FilledArcFunc,
+         (*(DISPATCH(gc)->ARCF))(gc, cx, cy, radius, start, end));
 }
 
 /*
@@ -184,8 +638,16 @@ void CPLT_draw_curve(CPLT_gc_t gc, CPLT_point_t points[]) {
     * points[1] and points[2] are the Bezier control points.
     * Draws line with current color and linewidth/style. */
 
+   /* drop it, if it's off the canvas: the curve lies within the hull
+    * of its points */
+   if (CULLING(gc) && !_visible(&gc->view, points, 4, _margin(gc))) {
+      COUNT_CULLED(gc, 1);
+      return;
+   }
+
    /* propagate this generic function call to format specific one */
-   (*(gc->dispatch->CURVE))(gc, points);
+   COUNT_POINTS(gc, 4);
+   COUNT(gc, CPLT_CurveFunc, (*(DISPATCH(gc)->CURVE))(gc, points));
 }
 
 /*
@@ -207,8 +669,17 @@ void CPLT_draw_marker(CPLT_gc_t gc, const float cx, const float cy,
     * 7: triangle, tip down
     */
 
+   CPLT_point_t c = { cx, cy };
+
+   /* drop it, if it's off the canvas */
+   if (CULLING(gc) && !_visible(&gc->view, &c, 1, 0.5 * wd + _margin(gc))) {
+      COUNT_CULLED(gc, 1);
+      return;
+   }
+
    /* propagate this generic function call to format specific one */
-   (*(gc->dispatch->MARK))(gc, cx, cy, wd, symbol);
+   COUNT_POINTS(gc, 1);
+   COUNT(gc, CPLT_MarkerFunc, (*(DISPATCH(gc)->MARK))(gc, cx, cy, wd, symbol));
 }
 
 /*
@@ -231,8 +702,20 @@ void CPLT_draw_text(CPLT_gc_t gc, const float x, const float y,
     *    sw--------s--------se
     */
 
+   CPLT_point_t p = { x, y };
+   float fs = gc->state.fsize >= 0. ? gc->state.fsize : 12.;
+
+   /* drop it, if it's off the canvas: no glyph is wider than a fontsize,
+    * so the text lies within its length in fontsizes around x/y */
+   if (CULLING(gc) && text != NULL &&
+       !_visible(&gc->view, &p, 1, fs * (strlen(text) + 1))) {
+      COUNT_CULLED(gc, 1);
+      return;
+   }
+
    /* propagate this generic function call to format specific one */
-   (*(gc->dispatch->TEXT))(gc, x, y, anchor, angle, text);
+   COUNT(gc, CPLT_TextFunc,
+         (*(DISPATCH(gc)->TEXT))(gc, x, y, anchor, angle, text));
 }
 
 /*
@@ -243,8 +726,15 @@ void CPLT_set_fontsize(CPLT_gc_t gc, const float fontsize) {
    /* Sets current fontsize [pix] for CPLT_draw_text().
     * (Preset: fontsize=12.0) */
 
+   /* drop it, if it doesn't change the current fontsize */
+   if (fontsize == gc->state.fsize) {
+      COUNT_ELIDED(gc);
+      return;
+   }
+   gc->state.fsize = fontsize;
+
    /* propagate this generic function call to format specific one */
-   (*(gc->dispatch->FSIZE))(gc, fontsize);
+   COUNT(gc, CPLT_FontsizeFunc, (*(DISPATCH(gc)->FSIZE))(gc, fontsize));
 }
 
 /*
@@ -255,8 +745,22 @@ void CPLT_set_color(CPLT_gc_t gc, float r, float g, float b) {
    /* Sets current color of RGB values [0,1].
     * (Preset: r=0., g=0., b=0., i.e. black) */
 
+   /* drop it, if it doesn't change the current color, clamped as by
+    * the formats */
+   r = r < 0. ? 0. : r > 1. ? 1. : r;
+   g = g < 0. ? 0. : g > 1. ? 1. : g;
+   b = b < 0. ? 0. : b > 1. ? 1. : b;
+   if (r == gc->state.col[0] && g == gc->state.col[1]
+       && b == gc->state.col[2]) {
+      COUNT_ELIDED(gc);
+      return;
+   }
+   gc->state.col[0] = r;
+   gc->state.col[1] = g;
+   gc->state.col[2] = b;
+
    /* propagate this generic function call to format specific one */
-   (*(gc->dispatch->COLR))(gc, r, g, b);
+   COUNT(gc, CPLT_ColorFunc, (*(DISPATCH(gc)->COLR))(gc, r, g, b));
 }
 
 /*
@@ -266,8 +770,15 @@ void CPLT_set_color(CPLT_gc_t gc, float r, float g, float b) {
 void CPLT_set_linewidth(CPLT_gc_t gc, const float w) {
    /* Sets current linewidth w [pix]. (Preset: w=1.0) */
 
+   /* drop it, if it doesn't change the current linewidth */
+   if (w == gc->state.lwd) {
+      COUNT_ELIDED(gc);
+      return;
+   }
+   gc->state.lwd = w;
+
    /* propagate this generic function call to format specific one */
-   (*(gc->dispatch->LNWD))(gc, w);
+   COUNT(gc, CPLT_LinewidthFunc, (*(DISPATCH(gc)->LNWD))(gc, w));
 }
 
 /*
@@ -278,24 +789,920 @@ void CPLT_set_linestyle(CPLT_gc_t gc, const CPLT_lnstyle_t s) {
    /* Sets current linestyle s [enumeration].
     * (Preset: s=CPLT_SolidLine) */
 
+   /* drop it, if it doesn't change the current linestyle */
+   if ((int) s == gc->state.lsty) {
+      COUNT_ELIDED(gc);
+      return;
+   }
+   gc->state.lsty = s;
+
    /* propagate this generic function call to format specific one */
-   (*(gc->dispatch->LNSTY))(gc, s);
+   COUNT(gc, CPLT_LinestyleFunc, (*(DISPATCH(gc)->LNSTY))(gc, s));
 }
 
 /*
  *******************************************************************************
  */
 
-void CPLT_finish_graphics(CPLT_gc_t gc) {
-   /* Finishes graphics, closes plotfile, destroys graphics context */
+int CPLT_define_symbol(CPLT_gc_t gc, const int id) {
+   /* Starts the definition of symbol id [>= 0]: the drawing calls up to
+    * CPLT_end_symbol() are not plotted, but make up the symbol, in coords
+    * relative to its reference point (0,0) and with the attributes set
+    * meanwhile, which stay current after it. Symbols must not be nested,
+    * but may place others. SVG and EPS define them natively, PNG renders
+    * each once into a sprite that is blended in where placed.
+    * Returns 0, or -1 if the graphics format has no symbols. */
+
+   int ret;
+
+   if (DISPATCH(gc)->SYMD == NULL) return -1;
+
+   /* propagate this generic function call to format specific one */
+   COUNT(gc, CPLT_DefineSymbolFunc,
+         ret = (*(DISPATCH(gc)->SYMD))(gc, id));
+
+   /* its coords are relative to the placements, not culled */
+   if (ret == 0 && !gc->view.insym) {
+      gc->view.insym = 1;
+      memcpy(gc->view.symtm, gc->view.tm, sizeof(gc->view.tm));
+      gc->view.symdepth = gc->view.depth;
+   }
+   return ret;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_end_symbol(CPLT_gc_t gc) {
+   /* Ends the definition of the symbol started by CPLT_define_symbol(). */
+
+   if (DISPATCH(gc)->SYME == NULL) return;
+
+   if (gc->view.insym) {
+      gc->view.insym = 0;
+      memcpy(gc->view.tm, gc->view.symtm, sizeof(gc->view.tm));
+      gc->view.depth = gc->view.symdepth;
+   }
+
+   /* propagate this generic function call to format specific one */
+   COUNT(gc, CPLT_EndSymbolFunc, (*(DISPATCH(gc)->SYME))(gc));
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_place_symbol(CPLT_gc_t gc, const int id, const float x,
+                       const float y, const float scale, const float angle) {
+   /* Plots the symbol id, defined before, with its reference point at
+    * x/y, scaled by scale and turned by angle degrees counterclockwise
+    * (the linewidths are scaled too). */
+
+   if (DISPATCH(gc)->SYMP == NULL) return;
+
+   /* propagate this generic function call to format specific one */
+   COUNT(gc, CPLT_PlaceSymbolFunc,
+         (*(DISPATCH(gc)->SYMP))(gc, id, x, y, scale, angle));
+}
+
+/*
+ *******************************************************************************
+ */
+
+int CPLT_draw_branching(CPLT_gc_t gc, const float x, const float y,
+                        const float angle, const float len,
+                        const float step, const float scale,
+                        const int depth, const float widths[],
+                        const float colors[][2][3]) {
+   /* Plots a binary branching, i.e. a fractal tree, from x/y: two
+    * branches of length len, turned by +step and -step degrees from the
+    * direction angle [degrees, counterclockwise], with two branches of
+    * length scale*len turned the same way from its end each, and so on,
+    * the levels j = 0..depth. The branches of level j have linewidth
+    * widths[j], the first one of a pair, turned by +step, the color
+    * colors[j][0], the second colors[j][1] (RGB values [0,1]), each
+    * branch is followed by its subtree. The current color and linewidth
+    * are not changed.
+    * A negative depth draws nothing, e.g. to probe the graphics format.
+    * Returns 0, or -1 if the graphics format has no branching. */
+
+   int ret;
+
+   if (DISPATCH(gc)->BRNCH == NULL) return -1;
+
+   /* propagate this generic function call to format specific one */
+   COUNT(gc, CPLT_BranchingFunc,
+         ret = (*(DISPATCH(gc)->BRNCH))(gc, x, y, angle, len, step, scale,
+                                        depth, widths, colors));
+   return ret;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_begin(CPLT_gc_t gc) {
+   /* Begins a path, streamed point by point by CPLT_path_moveto() and
+    * CPLT_path_lineto() to the graphics format, ended by
+    * CPLT_path_stroke() or CPLT_path_fill(). */
+
+   /* propagate this generic function call to format specific one */
+   COUNT(gc, CPLT_PathBeginFunc, (*(DISPATCH(gc)->PATHB))(gc));
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_moveto(CPLT_gc_t gc, const float x, const float y) {
+   /* Begins a new subpath of the path at x/y. */
+
+   /* propagate this generic function call to format specific one */
+   COUNT_POINTS(gc, 1);
+   COUNT(gc, CPLT_MovetoFunc, (*(DISPATCH(gc)->MOVE))(gc, x, y));
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_lineto(CPLT_gc_t gc, const float x, const float y) {
+   /* Appends a straight line from the current point to x/y to the
+    * subpath. */
+
+   /* propagate this generic function call to format specific one */
+   COUNT_POINTS(gc, 1);
+   COUNT(gc, CPLT_LinetoFunc, (*(DISPATCH(gc)->LINE))(gc, x, y));
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_stroke(CPLT_gc_t gc) {
+   /* Ends the path, drawn as lines with current color and
+    * linewidth/style. */
+
+   /* propagate this generic function call to format specific one */
+   COUNT(gc, CPLT_StrokeFunc, (*(DISPATCH(gc)->STROKE))(gc));
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_path_fill(CPLT_gc_t gc) {
+   /* Ends the path: closes the current subpath, fills the area enclosed
+    * by all subpaths (nonzero winding) and strokes it, with current
+    * color. */
+
+   /* propagate this generic function call to format specific one */
+   COUNT(gc, CPLT_FillFunc, (*(DISPATCH(gc)->FILL))(gc));
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_push_transform(CPLT_gc_t gc) {
+   /* Saves the current transform of the coords on a stack, to be
+    * restored by the matching CPLT_pop_transform(). */
+
+   CPLT_view_t *v = &gc->view;
+
+   /* tracked for the culling */
+   if (v->depth < VIEW_MAXDEPTH)
+      memcpy(v->stack[v->depth], v->tm, sizeof(v->tm));
+   v->depth++;
 
    /* propagate this generic function call to format specific one */
-   (*(gc->dispatch->FINI))(gc);
+   COUNT(gc, CPLT_PushTransformFunc, (*(DISPATCH(gc)->PUSH))(gc));
 }
 
 /*
  *******************************************************************************
  */
 
+void CPLT_pop_transform(CPLT_gc_t gc) {
+   /* Restores the transform saved by the last CPLT_push_transform() not
+    * popped yet, if any. */
+
+   CPLT_view_t *v = &gc->view;
 
+   /* tracked for the culling, those beyond the stack left the
+    * transform as is */
+   if (v->depth > 0 && --v->depth < VIEW_MAXDEPTH)
+      memcpy(v->tm, v->stack[v->depth], sizeof(v->tm));
 
+   /* propagate this generic function call to format specific one */
+   COUNT(gc, CPLT_PopTransformFunc, (*(DISPATCH(gc)->POP))(gc));
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_concat_matrix(CPLT_gc_t gc, const float a, const float b,
+                        const float c, const float d,
+                        const float e, const float f) {
+   /* Concatenates the matrix [a b c d e f] to the current transform, i.e.
+    * the coords x/y of the following drawing calls are mapped to
+    * a*x + c*y + e / b*x + d*y + f first, then by the transform before. */
+
+   float *m = gc->view.tm, t[6];
+
+   /* tracked for the culling */
+   if (gc->view.depth <= VIEW_MAXDEPTH) {
+      t[0] = m[0] * a + m[2] * b;
+      t[1] = m[1] * a + m[3] * b;
+      t[2] = m[0] * c + m[2] * d;
+      t[3] = m[1] * c + m[3] * d;
+      t[4] = m[0] * e + m[2] * f + m[4];
+      t[5] = m[1] * e + m[3] * f + m[5];
+      memcpy(m, t, sizeof(t));
+   }
+
+   /* propagate this generic function call to format specific one */
+   COUNT(gc, CPLT_ConcatMatrixFunc,
+         (*(DISPATCH(gc)->CONCAT))(gc, a, b, c, d, e, f));
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_draw_segments(CPLT_gc_t gc, const int n,
+                        const CPLT_point_t segments[], const float widths[],
+                        const float colors[][3]) {
+   /* Plots n straight line segments at once, segment i from segments[2*i]
+    * to segments[2*i+1], with linewidth widths[i] [pix] and color
+    * colors[i] (RGB values [0,1]), or the current linewidth or color for
+    * all if widths or colors is NULL, and the current linestyle.
+    * The current color and linewidth are not changed. */
+
+   /* cut it to the canvas, if culling */
+   if (CULLING(gc)) {
+      _cull_segments(gc, n, segments, widths, colors);
+      return;
+   }
+
+   /* propagate this generic function call to format specific one */
+   COUNT_POINTS(gc, 2 * n);
+   COUNT(gc, CPLT_SegmentsFunc,
+         (*(DISPATCH(gc)->SEGS))(gc, n, segments, widths, colors));
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_set_culling(CPLT_gc_t gc, const int on) {
+   /* Switches the culling of the drawing calls off the canvas on
+    * (on != 0) or off (preset). */
+
+   gc->view.cull = on != 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+int CPLT_get_stats(CPLT_gc_t gc, CPLT_stats_t *stats) {
+   /* Fills stats with the counters of gc up to now.
+    * Returns 0, or -1 if built without CPLT_STATS, then stats is zeroed. */
+
+#ifdef CPLT_STATS
+   long pos;
+
+   *stats = gc->stats;
+   if (gc->fp != NULL && (pos = ftell(gc->fp)) > 0) stats->bytes = pos;
+
+   return 0;
+#else
+   memset(stats, 0, sizeof(*stats));
+
+   return -1;
+#endif
+}
+
+/*
+ *******************************************************************************
+ */
+
+int CPLT_trace(const char *tracefile, const int calls) {
+   /* Starts writing a trace of the calls of all graphics contexts to
+    * tracefile, up to calls consecutive ones of a gc as one event, or
+    * stops writing the current one if tracefile is NULL.
+    * Returns 0, or -1 on error. */
+
+   /* before, so the environment's trace can't replace this one */
+   pthread_once(&traceenv_once, &_trace_from_env);
+
+   return _trace_to(tracefile, calls);
+}
+
+/*
+ *******************************************************************************
+ */
+
+void CPLT_finish_graphics(CPLT_gc_t gc) {
+   /* Finishes graphics, closes plotfile, destroys graphics context */
+
+   FILE *fp;                  /* the format writes its last, but doesn't */
+   char *fpbuf;               /* close, as it doesn't know the sink */
+   double tfini, tclose;      /* for the trace */
+#ifdef CPLT_STATS
+   CPLT_stats_t stats;        /* gc's counters, it's gone when timed */
+   double t0 = _seconds();
+   long pos;
+#endif
+
+   if (gc == NULL) return;
+   fp = gc->fp;
+   fpbuf = gc->fpbuf;
+#ifdef CPLT_STATS
+   CPLT_get_stats(gc, &stats);
+#endif
+   if (batch.n > 0 && batch.gc == gc) _trace_flush();
+   tfini = _trace_start();
+
+   /* propagate this generic function call to format specific one */
+   (*(DISPATCH(gc)->FINI))(gc);
+
+#ifdef CPLT_STATS
+   if (fp != NULL && (pos = ftell(fp)) > 0) stats.bytes = pos;
+#endif
+   tclose = _trace_start();
+   if (fp != NULL) fclose(fp);
+   free(fpbuf);
+   _trace_end("close", tclose);
+   _trace_end("finish", tfini);
+
+#ifdef CPLT_STATS
+   stats.calls[CPLT_FinishFunc]++;
+   stats.secs[CPLT_FinishFunc] += _seconds() - t0;
+   if (getenv("CPLT_STATS") != NULL) _print_stats(&stats, stderr);
+#endif
+}
+
+/*
+ *******************************************************************************
+ * internal helper functions
+ *******************************************************************************
+ */
+
+INIT_ft *_format_of(char *plotfilename) {
+   /* returns the init function of the graphics format requested by the
+    * suffix of plotfilename, or NULL if it's not implemented */
+
+   int i, l, NGF, GFMT_IDX = -1;
+   char *sfx;            /* file-suffix from plotfilename */
+
+   /* graphics format requested */
+   NGF = sizeof(GFORMAT) / sizeof(GFORMAT[0]);
+   l = strlen(plotfilename);
+   sfx = _extract_lowered_suffix(plotfilename);
+   if (l > 3 && sfx) {
+      for (i = 0; i < NGF; i++) {
+         if (strcmp(GFORMAT[i].suffix, sfx) == 0) {
+            GFMT_IDX = i;
+            break;
+         }
+      }
+   }
+   if (GFMT_IDX < 0) {   /* requested suffix/format not implemented */
+      fprintf(stderr,
+              "\n *** ERR: The graphics format requested by suffix '%s'\n"
+              " *** (from plotfilename '%s')\n"
+              " *** is not implemented! Known suffixes are:\n",
+              (sfx ? sfx : ""), plotfilename);
+      for (i = 0; i < NGF; i++)
+         fprintf(stderr, " ***    %s: %s\n",
+                 GFORMAT[i].suffix, GFORMAT[i].name);
+      return NULL;
+   }
+   if (sfx) free(sfx);
+
+   return GFORMAT[GFMT_IDX].initFunc;
+}
+
+/*
+ *******************************************************************************
+ */
+
+CPLT_gc_t _init_sink(INIT_ft *init, const unsigned int pwidth,
+                     const unsigned int pheight, char *plotfilename,
+                     FILE *fp, char *fpbuf) {
+   /* initializes graphics of the format's init function, written to the
+    * opened fp with its buffer fpbuf, closes them if this fails */
+
+   CPLT_gc_t gc;
+
+   pthread_once(&traceenv_once, &_trace_from_env);
+
+   /* propagate this generic function call to format specific one,
+    * moreover this fills the dispatch table in the gc for calling
+    * all further format specific functions */
+   COUNT(gc, CPLT_InitFunc, gc = (*init)(pwidth, pheight, plotfilename, fp));
+   if (gc == NULL) {
+      fclose(fp);
+      free(fpbuf);
+      return NULL;
+   }
+   gc->fpbuf = fpbuf;
+
+   return gc;
+}
+
+/*
+ *******************************************************************************
+ */
+
+ssize_t _write_sink(void *cookie, const char *data, size_t len) {
+   /* write function of fopencookie(), passes data on to the client's */
+
+   _sink_t *sink = (_sink_t *)cookie;
+   long taken = (*(sink->write))(sink->arg, data, len);
+
+   if (taken > 0) sink->written += taken;
+
+   return taken;
+}
+
+/*
+ *******************************************************************************
+ */
+
+int _seek_sink(void *cookie, off64_t *offset, int whence) {
+   /* seek function of fopencookie(), merely tells the position for
+    * ftell(), as the client's data can't be rewritten */
+
+   _sink_t *sink = (_sink_t *)cookie;
+
+   if (whence != SEEK_CUR || *offset != 0) return -1;
+   *offset = sink->written;
+
+   return 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+int _close_sink(void *cookie) {
+   /* close function of fopencookie() */
+
+   free(cookie);
+
+   return 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+float _margin(CPLT_gc_t gc) {
+   /* returns how far [pix] the strokes of current linewidth may reach
+    * beyond their points: half the width, at the miter of a sharp join
+    * (EPS: miterlimit 3, SVG: 4) up to twice it */
+
+   return 2. * (gc->state.lwd >= 0. ? gc->state.lwd : 1.);
+}
+
+/*
+ *******************************************************************************
+ */
+
+int _visible(const CPLT_view_t *view, const CPLT_point_t p[], const int n,
+             const float r) {
+   /* returns 1 if the bounding box of the n points p grown by r, mapped
+    * by the current transform of view, touches its canvas (grown by a
+    * pixel for the antialiasing), else 0 */
+
+   const float *m = view->tm;
+   float x, y, x0, x1, y0, y1, rx, ry;
+   int i;
+
+   x0 = y0 = HUGE_VALF;
+   x1 = y1 = -HUGE_VALF;
+   for (i = 0; i < n; i++) {
+      x = m[0] * p[i].x + m[2] * p[i].y + m[4];
+      y = m[1] * p[i].x + m[3] * p[i].y + m[5];
+      if (x < x0) x0 = x;
+      if (x > x1) x1 = x;
+      if (y < y0) y0 = y;
+      if (y > y1) y1 = y;
+   }
+   rx = r * (fabsf(m[0]) + fabsf(m[2])) + 1.;
+   ry = r * (fabsf(m[1]) + fabsf(m[3])) + 1.;
+
+   return x1 + rx >= 0. && x0 - rx <= view->w &&
+          y1 + ry >= 0. && y0 - ry <= view->h;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _cull_polyline(CPLT_gc_t gc, const int numpts, CPLT_point_t points[]) {
+   /* internal helper func to draw the polyline of numpts points as the
+    * runs of its segments touching the canvas, or whole if dashed, as the
+    * dashes would start anew with each run */
+
+   const float r = _margin(gc);
+   int i, i0 = -1, culled = 0;
+
+   if (gc->state.lsty > (int) CPLT_SolidLine) {
+      if (_visible(&gc->view, points, numpts, r)) {
+         COUNT_POINTS(gc, numpts);
+         COUNT(gc, CPLT_PolylineFunc,
+               (*(DISPATCH(gc)->PLINE))(gc, numpts, points));
+      } else {
+         COUNT_CULLED(gc, 1);
+      }
+      return;
+   }
+
+   for (i = 0; i < numpts - 1; i++) {
+      if (_visible(&gc->view, points + i, 2, r)) {
+         if (i0 < 0) i0 = i;
+         continue;
+      }
+      culled++;
+      if (i0 < 0) continue;
+      COUNT_POINTS(gc, i - i0 + 1);
+      COUNT(gc, CPLT_PolylineFunc,
+            (*(DISPATCH(gc)->PLINE))(gc, i - i0 + 1, points + i0));
+      i0 = -1;
+   }
+   if (i0 >= 0) {
+      COUNT_POINTS(gc, numpts - i0);
+      COUNT(gc, CPLT_PolylineFunc,
+            (*(DISPATCH(gc)->PLINE))(gc, numpts - i0, points + i0));
+   }
+   COUNT_CULLED(gc, culled);
+   (void) culled;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _cull_segments(CPLT_gc_t gc, const int n,
+                    const CPLT_point_t segments[], const float widths[],
+                    const float colors[][3]) {
+   /* internal helper func to draw the runs of the n segments touching the
+    * canvas, each by a call of the format's CPLT_draw_segments() */
+
+   const float r = _margin(gc);
+   int i, i0 = -1, culled = 0;
+
+   for (i = 0; i <= n; i++) {
+      if (i < n && _visible(&gc->view, segments + 2 * i, 2,
+                            widths ? 2. * widths[i] : r)) {
+         if (i0 < 0) i0 = i;
+         continue;
+      }
+      if (i < n) culled++;
+      if (i0 < 0) continue;
+      COUNT_POINTS(gc, 2 * (i - i0));
+      COUNT(gc, CPLT_SegmentsFunc,
+            (*(DISPATCH(gc)->SEGS))(gc, i - i0, segments + 2 * i0,
+                                    widths ? widths + i0 : NULL,
+                                    colors ? colors + i0 : NULL));
+      i0 = -1;
+   }
+   COUNT_CULLED(gc, culled);
+   (void) culled;
+
+}
+
+/*
+ *******************************************************************************
+ */
+
+double _seconds(void) {
+   /* returns the time of a monotonic clock [s] */
+
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _count(CPLT_gc_t gc, const CPLT_func_t func, const double t0) {
+   /* counts a call of the format's function func begun at time t0,
+    * the init function of a new gc starts its counters, and adds it
+    * to the trace, if one is written */
+
+   double t1 = _seconds();
+
+   if (gc == NULL) return;
+#ifdef CPLT_STATS
+   if (func == CPLT_InitFunc) memset(&gc->stats, 0, sizeof(gc->stats));
+   gc->stats.calls[func]++;
+   gc->stats.secs[func] += t1 - t0;
+#endif
+   if (!TRACING) return;
+
+   if (batch.n > 0 && (batch.gc != gc || func == CPLT_InitFunc))
+      _trace_flush();
+   if (batch.n == 0) {
+      batch.gc = gc;
+      memset(batch.calls, 0, sizeof(batch.calls));
+      batch.t0 = t0;
+      batch.busy = 0.;
+   }
+   batch.n++;
+   batch.calls[func]++;
+   batch.t1 = t1;
+   batch.busy += t1 - t0;
+   if (func == CPLT_InitFunc
+       || batch.n >= __atomic_load_n(&trace_calls, __ATOMIC_RELAXED))
+      _trace_flush();
+}
+
+/*
+ *******************************************************************************
+ */
+
+ssize_t _write_async(void *cookie, const char *data, size_t len) {
+   /* write function of fopencookie(), fills the current buffer with
+    * data, hands it over to the writer thread whenever it's full */
+
+   _async_t *as = (_async_t *)cookie;
+   size_t n, left = len;
+
+   while (left > 0) {
+      n = as->size - as->fill < left ? as->size - as->fill : left;
+      memcpy(as->buf[as->cur] + as->fill, data, n);
+      as->fill += n;
+      data += n;
+      left -= n;
+      if (as->fill == as->size && _hand_over_async(as) != 0) return -1;
+   }
+   as->written += len;
+
+   return len;
+}
+
+/*
+ *******************************************************************************
+ */
+
+int _seek_async(void *cookie, off64_t *offset, int whence) {
+   /* seek function of fopencookie(), merely tells the position for
+    * ftell() */
+
+   _async_t *as = (_async_t *)cookie;
+
+   if (whence != SEEK_CUR || *offset != 0) return -1;
+   *offset = as->written;
+
+   return 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+int _close_async(void *cookie) {
+   /* close function of fopencookie(), hands over the last buffer, waits
+    * for the writer thread to finish and closes the plotfile */
+
+   _async_t *as = (_async_t *)cookie;
+   int err;
+
+   if (as->fill > 0) _hand_over_async(as);
+   pthread_mutex_lock(&as->mtx);
+   as->done = 1;
+   pthread_cond_broadcast(&as->cond);
+   pthread_mutex_unlock(&as->mtx);
+   pthread_join(as->tid, NULL);
+
+   err = as->err | (fclose(as->fp) != 0);
+   pthread_cond_destroy(&as->cond);
+   pthread_mutex_destroy(&as->mtx);
+   free(as->buf[0]);
+   free(as->buf[1]);
+   free(as);
+
+   return err ? EOF : 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+int _hand_over_async(_async_t *as) {
+   /* passes the current buffer on to the writer thread, as soon as it's
+    * done with the other one, and goes on with that.
+    * Returns 0, or -1 if a write has failed */
+
+   int err;
+
+   pthread_mutex_lock(&as->mtx);
+   while (as->pending > 0) pthread_cond_wait(&as->cond, &as->mtx);
+   as->pending = as->fill;
+   as->cur = !as->cur;
+   err = as->err;
+   pthread_cond_broadcast(&as->cond);
+   pthread_mutex_unlock(&as->mtx);
+   as->fill = 0;
+
+   return err ? -1 : 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void *_writer_async(void *arg) {
+   /* thread: writes the buffers handed over to the plotfile, up to the
+    * last one */
+
+   _async_t *as = (_async_t *)arg;
+   char *buf;
+   size_t n;
+   int err;
+
+   pthread_mutex_lock(&as->mtx);
+   for (;;) {
+      while (as->pending == 0 && !as->done)
+         pthread_cond_wait(&as->cond, &as->mtx);
+      if ((n = as->pending) == 0) break;   /* done */
+      buf = as->buf[!as->cur];   /* not filled, until handed back */
+      pthread_mutex_unlock(&as->mtx);
+
+      err = fwrite(buf, 1, n, as->fp) != n;
+
+      pthread_mutex_lock(&as->mtx);
+      as->err |= err;
+      as->pending = 0;
+      pthread_cond_broadcast(&as->cond);
+   }
+   pthread_mutex_unlock(&as->mtx);
+
+   return NULL;
+}
+
+#ifdef CPLT_STATS
+/*
+ *******************************************************************************
+ */
+
+void _print_stats(const CPLT_stats_t *stats, FILE *fp) {
+   /* prints the counters stats to fp, the functions called only */
+
+   int i;
+
+   fprintf(fp, " +++ CPlotter: %lu points, %lu bytes, %lu calls elided, "
+           "%lu culled\n", stats->points, stats->bytes, stats->elided,
+           stats->culled);
+   for (i = 0; i < CPLT_NumFuncs; i++) {
+      if (stats->calls[i] == 0) continue;
+      fprintf(fp, "     %-14s %10lu calls %12.6f s\n",
+              FUNCNAME[i], stats->calls[i], stats->secs[i]);
+   }
+}
+#endif
+
+/*
+ *******************************************************************************
+ */
+
+int _trace_to(const char *tracefile, const int calls) {
+   /* does CPLT_trace(), but leaves the environment's trace alone */
+
+   FILE *fp = NULL;
+
+   _trace_flush();
+
+   if (tracefile != NULL && (fp = fopen(tracefile, "w")) == NULL) {
+      fprintf(stderr, " *** Can't open trace file '%s'!\n", tracefile);
+      return -1;
+   }
+
+   pthread_mutex_lock(&tracemtx);
+   if (tracefp != NULL) {
+      fprintf(tracefp, "\n]\n");
+      fclose(tracefp);
+   }
+   tracefp = fp;
+   if (fp != NULL) {
+      fprintf(fp, "[\n");
+      trace_nev = 0;
+      trace_t0 = _seconds();
+      __atomic_store_n(&trace_calls, calls > 1 ? calls : 1, __ATOMIC_RELAXED);
+   }
+   __atomic_store_n(&tracing, fp != NULL, __ATOMIC_RELAXED);
+   pthread_mutex_unlock(&tracemtx);
+
+   return 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _trace_from_env(void) {
+   /* starts the trace named by the environment's CPLT_TRACE, if set,
+    * with CPLT_TRACE_CALLS calls per event, called once by pthread_once() */
+
+   char *tracefile = getenv("CPLT_TRACE"), *calls;
+
+   if (tracefile == NULL || *tracefile == '\0') return;
+   calls = getenv("CPLT_TRACE_CALLS");
+   if (_trace_to(tracefile, calls ? atoi(calls) : TRACECALLS) == 0)
+      atexit(&_trace_atexit);
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _trace_atexit(void) {
+   /* completes the trace of the environment at exit */
+
+   CPLT_trace(NULL, 0);
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _trace_flush(void) {
+   /* writes this thread's pending calls as a trace event, named by
+    * their function, if all are of the same */
+
+   int i;
+
+   if (batch.n == 0) return;
+   for (i = 0; i < CPLT_NumFuncs && batch.calls[i] != batch.n; i++) ;
+   _trace_event(i < CPLT_NumFuncs ? FUNCNAME[i] : "calls",
+                batch.t0, batch.t1, batch.calls, batch.busy);
+   batch.n = 0;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _trace_event(const char *name, const double t0, const double t1,
+                  const unsigned long *calls, const double busy) {
+   /* writes a complete event from t0 to t1 [s] of this thread to the
+    * trace, with the number of calls of each function and the time
+    * spent in them, if calls isn't NULL */
+
+   int i;
+
+   pthread_mutex_lock(&tracemtx);
+   if (tracefp != NULL) {
+      fprintf(tracefp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+              "\"dur\":%.3f,\"pid\":%d,\"tid\":%ld",
+              trace_nev++ ? ",\n" : "", name, 1e6 * (t0 - trace_t0),
+              1e6 * (t1 - t0), (int) getpid(), (long) syscall(SYS_gettid));
+      if (calls != NULL) {
+         fprintf(tracefp, ",\"args\":{\"busy_us\":%.3f", 1e6 * busy);
+         for (i = 0; i < CPLT_NumFuncs; i++)
+            if (calls[i] > 0)
+               fprintf(tracefp, ",\"%s\":%lu", FUNCNAME[i], calls[i]);
+         fprintf(tracefp, "}");
+      }
+      fprintf(tracefp, "}");
+   }
+   pthread_mutex_unlock(&tracemtx);
+}
+
+/*
+ *******************************************************************************
+ */
+
+double _trace_start(void) {
+   /* returns the time [s] for _trace_end(), 0 if no trace is written */
+
+   return TRACING ? _seconds() : 0.;
+}
+
+/*
+ *******************************************************************************
+ */
+
+void _trace_end(const char *name, const double t0) {
+   /* writes the event name from t0 of _trace_start() up to now to the
+    * trace, if one was written at t0 */
+
+   if (t0 > 0. && TRACING) _trace_event(name, t0, _seconds(), NULL, 0.);
+}
+
+/*
+ *******************************************************************************
+ */
@@ -22,6 +22,10 @@
  *
  * The graphics format to use is determined by the file-suffix given in
  * the plotfilename to CPLT_init_graphics(), see below.
+ * A library built with CPLT_STATIC_BACKEND set to one of them (see
+ * Makefile) knows only this one format and no recordings, in exchange
+ * its functions are called directly instead of through the graphics
+ * context.
  *
  * Please note, since CPlotter utilizes the GD-library (see
  * https://libgd.github.io/) to create PNG files, it has to be linked with
@@ -43,12 +47,17 @@
  * All coords are in native units of the resp. backend format (pix, pt).
  * Although CPlotter uses float for the coords, they may be rounded to
  * int dependent on the backend format.
+ * The coords of the drawing calls may be transformed, e.g. into the local
+ * coords of a part of a hierarchical scene, by CPLT_concat_matrix().
  *
  * === Graphics Attributes ===
  *
  * All attributes (color, linewidth, linestyle, fontsize) of the drawing
  * items are persistent, i.e. they keep their values until reset by the
- * respective CPLT_set_*() function (again).
+ * respective CPLT_set_*() function (again). A CPLT_set_*() call, which
+ * doesn't change the current value, is dropped before it reaches the
+ * backend, so clients may set the attributes of every item without
+ * bloating the plotfile.
  *
  * === Abstract Data Type ===
  *
@@ -59,6 +68,8 @@
  * same time. The client must not exploit any knowledge about the internal
  * structure of the graphics context, but interact with CPlotter solely by
  * calls to the interface/API functions declared below.
+ * The instances may as well be drawn on different threads concurrently,
+ * as long as each one is used by one thread at a time.
  *
  * === Example ===
  *
@@ -139,12 +150,63 @@ typedef enum {
    CPLT_DashDotDotLine
 } CPLT_lnstyle_t;
 
+/* The type of client functions taking the plot in pieces, see
+ * CPLT_init_graphics_callback(): returns the number of bytes taken of
+ * the len ones at data, fewer on error */
+typedef long CPLT_write_ft(void *arg, const char *data, size_t len);
+
+/* Enumerated functions of a graphics format, see CPLT_get_stats() */
+typedef enum {
+   CPLT_InitFunc,
+   CPLT_PolylineFunc,
+   CPLT_SegmentsFunc,
+   CPLT_PolygonFunc,
+   CPLT_FilledPolygonFunc,
+   CPLT_ArcFunc,
+   CPLT_FilledArcFunc,
+   CPLT_CurveFunc,
+   CPLT_MarkerFunc,
+   CPLT_TextFunc,
+   CPLT_FontsizeFunc,
+   CPLT_ColorFunc,
+   CPLT_LinewidthFunc,
+   CPLT_LinestyleFunc,
+   CPLT_FinishFunc,
+   CPLT_DefineSymbolFunc,
+   CPLT_EndSymbolFunc,
+   CPLT_PlaceSymbolFunc,
+   CPLT_BranchingFunc,
+   CPLT_ReplayFunc,
+   CPLT_PathBeginFunc,
+   CPLT_MovetoFunc,
+   CPLT_LinetoFunc,
+   CPLT_StrokeFunc,
+   CPLT_FillFunc,
+   CPLT_PushTransformFunc,
+   CPLT_PopTransformFunc,
+   CPLT_ConcatMatrixFunc,
+   CPLT_NumFuncs
+} CPLT_func_t;
+
+/* The counters of a graphics context, see CPLT_get_stats() */
+typedef struct {
+   unsigned long calls[CPLT_NumFuncs]; /* calls of each format function */
+   double secs[CPLT_NumFuncs];   /* time spent in each one [s] */
+   unsigned long points;         /* points of the lines, polygons, curves,
+                                  * segments, markers and paths drawn */
+   unsigned long bytes;          /* bytes written to the plot so far */
+   unsigned long elided;         /* CPLT_set_*() calls dropped */
+   unsigned long culled;         /* drawing calls and line segments
+                                  * dropped off the canvas */
+} CPLT_stats_t;
+
 /************************************************************************/
 
-/* === The 14 functions constituting the ADT ===
+/* === The 37 functions constituting the ADT ===
  *
  * Each other function needs as its first parameter the graphics
- * context pointer returned by CPLT_init_graphics(). */
+ * context pointer returned by one of the CPLT_init_graphics...()
+ * functions or CPLT_init_recording(). */
 
 
 CPLT_gc_t CPLT_init_graphics(const unsigned int pwidth,
@@ -156,6 +218,90 @@ CPLT_gc_t CPLT_init_graphics(const unsigned int pwidth,
  * Returns graphics context pointer. */
 
 
+CPLT_gc_t CPLT_init_graphics_buffered(const unsigned int pwidth,
+                                      const unsigned int pheight,
+                                      char *plotfilename,
+                                      const size_t bufsize);
+/* Initializes graphics like CPLT_init_graphics(), but the plotfile is
+ * written through a buffer of bufsize bytes (0: 1 MiB), by few large
+ * writes. Returns graphics context pointer. */
+
+
+CPLT_gc_t CPLT_init_graphics_memory(const unsigned int pwidth,
+                                    const unsigned int pheight,
+                                    char *plotname, char **buf, size_t *len);
+/* Initializes graphics of pwidth x pheight [pix], written to a buffer
+ * in memory growing as needed instead of a plotfile, the suffix of
+ * plotname determines the graphics format as by CPLT_init_graphics(),
+ * no file is written. CPLT_finish_graphics() sets *buf to the
+ * malloc'ed plot of *len bytes, the caller must free() it.
+ * Returns graphics context pointer. */
+
+
+CPLT_gc_t CPLT_init_graphics_callback(const unsigned int pwidth,
+                                      const unsigned int pheight,
+                                      char *plotname,
+                                      CPLT_write_ft *write, void *arg);
+/* Initializes graphics of pwidth x pheight [pix] like
+ * CPLT_init_graphics_memory(), but the plot is passed on in pieces
+ * to the client's write(arg, data, len) as it is written, the last
+ * ones by CPLT_finish_graphics().
+ * Returns graphics context pointer. */
+
+
+CPLT_gc_t CPLT_init_graphics_fd(const unsigned int pwidth,
+                                const unsigned int pheight,
+                                char *plotname, const int fd);
+/* Initializes graphics of pwidth x pheight [pix] like
+ * CPLT_init_graphics_memory(), but written to the open file
+ * descriptor fd, e.g. of a pipe or socket, which
+ * CPLT_finish_graphics() leaves open.
+ * Returns graphics context pointer. */
+
+
+CPLT_gc_t CPLT_init_graphics_async(const unsigned int pwidth,
+                                   const unsigned int pheight,
+                                   char *plotfilename,
+                                   const size_t bufsize);
+/* Initializes graphics like CPLT_init_graphics(), but the plotfile is
+ * written by a thread of its own, while the client goes on drawing:
+ * the format's output fills one of two buffers of bufsize bytes
+ * (0: 1 MiB), the other one is written meanwhile. Once both are full,
+ * drawing waits for the writing. CPLT_finish_graphics() returns when
+ * all is written. Returns graphics context pointer. */
+
+
+CPLT_gc_t CPLT_init_graphics_multi(const unsigned int pwidth,
+                                   const unsigned int pheight,
+                                   char *plotfilenames[], const int n);
+/* Initializes graphics of pwidth x pheight [pix] in the n graphics files
+ * plotfilenames at once, their suffixes determine the graphics formats
+ * as by CPLT_init_graphics(). The drawing calls to it are passed on to
+ * each plotfile's graphics format, every one drawing on a thread of its
+ * own, in blocks of calls queued up to a bounded number. Like with a
+ * recording, there is no branching.
+ * CPLT_finish_graphics() returns when all plotfiles are finished.
+ * Returns graphics context pointer. */
+
+
+CPLT_gc_t CPLT_init_recording(const unsigned int pwidth,
+                              const unsigned int pheight);
+/* Initializes a recording of graphics of pwidth x pheight [pix]: the
+ * drawing calls to it are not rendered, but appended to a display list
+ * in memory, to be drawn into plotfiles by CPLT_replay(). The recording
+ * has no branching, as not all graphics formats have, and
+ * CPLT_finish_graphics() discards it.
+ * Returns graphics context pointer. */
+
+
+int CPLT_replay(CPLT_gc_t gc, char *plotfilename);
+/* Draws the calls recorded by gc, returned by CPLT_init_recording(),
+ * into graphics file plotfilename of the recorded size, the suffix
+ * determines the graphics format as by CPLT_init_graphics().
+ * A recording can be replayed into any number of plotfiles.
+ * Returns 0, or -1 on error. */
+
+
 void CPLT_draw_polyline(CPLT_gc_t gc, const int numpts,
                         CPLT_point_t points[]);
 /* Plots line through numpts 2D-points at given x/y-pairs in array points.
@@ -259,8 +405,157 @@ void CPLT_set_linestyle(CPLT_gc_t gc, const CPLT_lnstyle_t s);
  * (Preset: s=CPLT_SolidLine) */
 
 
+int CPLT_define_symbol(CPLT_gc_t gc, const int id);
+/* Starts the definition of symbol id [>= 0]: the drawing calls up to
+ * CPLT_end_symbol() are not plotted, but make up the symbol, in coords
+ * relative to its reference point (0,0) and with the attributes set
+ * meanwhile, which stay current after it. Symbols must not be nested,
+ * but may place others. SVG and EPS define them natively, PNG renders
+ * each once into a sprite that is blended in where placed.
+ * Returns 0, or -1 if the graphics format has no symbols, then the
+ * client has to draw the geometry itself. */
+
+
+void CPLT_end_symbol(CPLT_gc_t gc);
+/* Ends the definition of the symbol started by CPLT_define_symbol(). */
+
+
+void CPLT_place_symbol(CPLT_gc_t gc, const int id, const float x,
+                       const float y, const float scale, const float angle);
+/* Plots the symbol id, defined before, with its reference point at
+ * x/y, scaled by scale and turned by angle degrees counterclockwise
+ * (the linewidths are scaled too). */
+
+
+int CPLT_draw_branching(CPLT_gc_t gc, const float x, const float y,
+                        const float angle, const float len,
+                        const float step, const float scale,
+                        const int depth, const float widths[],
+                        const float colors[][2][3]);
+/* Plots a binary branching, i.e. a fractal tree, from x/y: two
+ * branches of length len, turned by +step and -step degrees from the
+ * direction angle [degrees, counterclockwise], with two branches of
+ * length scale*len turned the same way from its end each, and so on,
+ * the levels j = 0..depth. The branches of level j have linewidth
+ * widths[j], the first one of a pair, turned by +step, the color
+ * colors[j][0], the second colors[j][1] (RGB values [0,1]), each
+ * branch is followed by its subtree. The current color and linewidth
+ * are not changed.
+ * A negative depth draws nothing, e.g. to probe the graphics format.
+ * Returns 0, or -1 if the graphics format has no branching (currently
+ * only EPS has, as a recursive procedure expanded by the interpreter),
+ * then the client has to draw the branches itself. */
+
+
+void CPLT_path_begin(CPLT_gc_t gc);
+/* Begins a path, streamed point by point by CPLT_path_moveto() and
+ * CPLT_path_lineto() to the graphics format, which doesn't keep it
+ * (except for a recording): lines of any number of points are drawn
+ * without an array of them. The path ends with CPLT_path_stroke() or
+ * CPLT_path_fill(), until then no other drawing call may be made, nor
+ * the attributes changed. */
+
+
+void CPLT_path_moveto(CPLT_gc_t gc, const float x, const float y);
+/* Begins a new subpath of the path at x/y, each subpath must begin
+ * with it. */
+
+
+void CPLT_path_lineto(CPLT_gc_t gc, const float x, const float y);
+/* Appends a straight line from the current point to x/y to the
+ * subpath. */
+
+
+void CPLT_path_stroke(CPLT_gc_t gc);
+/* Ends the path, drawn as lines with current color and
+ * linewidth/style. */
+
+
+void CPLT_path_fill(CPLT_gc_t gc);
+/* Ends the path: closes the current subpath, fills the area enclosed
+ * by all subpaths (nonzero winding) and strokes it, with current
+ * color, like CPLT_draw_filledPolygon(). In PNG the area's edges are
+ * smoothed (antialiased). */
+
+
+void CPLT_push_transform(CPLT_gc_t gc);
+/* Saves the current transform of the coords (see CPLT_concat_matrix())
+ * on a stack, to be restored by the matching CPLT_pop_transform().
+ * The attributes are neither saved nor restored. */
+
+
+void CPLT_pop_transform(CPLT_gc_t gc);
+/* Restores the transform saved by the last CPLT_push_transform() not
+ * popped yet, if any. Inside a symbol definition, the pushes and pops
+ * must match. */
+
+
+void CPLT_concat_matrix(CPLT_gc_t gc, const float a, const float b,
+                        const float c, const float d,
+                        const float e, const float f);
+/* Concatenates the matrix [a b c d e f] to the current transform, i.e.
+ * the coords x/y of the following drawing calls are mapped to
+ * a*x + c*y + e / b*x + d*y + f first, then by the transform before:
+ * translated by e/f with a=d=1 and b=c=0, turned by w degrees
+ * counterclockwise with a=d=cos(w) and b=-c=sin(w), scaled by s with
+ * a=d=s and b=c=0. The transform starts as the identity, it scales the
+ * linewidths, fontsizes and markers too. The vector formats transform
+ * natively, PNG maps each point by the transform fused with its
+ * y-inversion, but its arcs, markers and text only follow the turn and
+ * mean scale of the transform. */
+
+
+void CPLT_draw_segments(CPLT_gc_t gc, const int n,
+                        const CPLT_point_t segments[], const float widths[],
+                        const float colors[][3]);
+/* Plots n straight line segments at once, segment i from segments[2*i]
+ * to segments[2*i+1], with linewidth widths[i] [pix] and color
+ * colors[i] (RGB values [0,1]), or the current linewidth or color for
+ * all if widths or colors is NULL, and the current linestyle.
+ * The current color and linewidth are not changed. */
+
+
+void CPLT_set_culling(CPLT_gc_t gc, const int on);
+/* Switches the culling of the drawing calls off the canvas on (on != 0)
+ * or off (preset): the lines, polygons, curves, arcs, markers, texts and
+ * segments whose bounding box, mapped by the current transform and grown
+ * by their linewidth, lies wholly outside the canvas of pwidth x pheight
+ * given at init, are dropped before they reach the graphics format.
+ * Solid polylines and CPLT_draw_segments() are cut to the runs of their
+ * segments touching the canvas, so zoomed into large data, the plotfile
+ * only grows with what is visible. The texts' extents are estimated by
+ * fontsize. Not culled are the drawing calls within symbol definitions
+ * or below 32 pushed transforms, paths, branchings and placed symbols. */
+
+
+int CPLT_get_stats(CPLT_gc_t gc, CPLT_stats_t *stats);
+/* Fills stats with the counters of gc up to now: the calls of each
+ * function of its graphics format (elided ones not included) and the
+ * time spent in it, and the points, bytes, elided and culled calls.
+ * The bytes are counted if the plot is written to a file, memory or
+ * callback (not to a pipe, nor by recordings).
+ * Returns 0, or -1 if CPlotter was built without CPLT_STATS defined
+ * (see Makefile), then it counts nothing at no cost, stats is zeroed. */
+
+
+int CPLT_trace(const char *tracefile, const int calls);
+/* Starts writing a trace of the calls of all graphics contexts to
+ * tracefile, as Chrome trace events in JSON, to be viewed e.g. by
+ * chrome://tracing or ui.perfetto.dev: an event for up to calls
+ * consecutive calls of a graphics context by a thread (with the number
+ * of calls of each function and the time spent in them), and one each
+ * for the font discovery, the PNG encoding, the closing of a plotfile.
+ * Stops writing and completes the current trace if tracefile is NULL.
+ * The environment variable CPLT_TRACE names a trace file to be written
+ * all the time up to the exit of the program instead, with
+ * CPLT_TRACE_CALLS calls per event (by default 100).
+ * Returns 0, or -1 if tracefile can't be written. */
+
+
 void CPLT_finish_graphics(CPLT_gc_t gc);
-/* Finishes graphics, closes plotfile, destroys graphics context */
+/* Finishes graphics, closes plotfile, destroys graphics context.
+ * If built with CPLT_STATS and the environment variable CPLT_STATS is
+ * set, prints the counters of gc to stderr. */
 
 #endif
 
@@ -0,0 +1,338 @@
+/***********************************************************************
+ * Benchmark of the tree generator of template_funcs.c:
+ * segments per second of ploterplotfirst() compared to the
+ * recursive reference ploterplotfirst_rec(), and of the generation
+ * into the segment buffer alone, i.e. w/o emitting to a plotfile,
+ * of tree_generate_dfs() compared to tree_generate_libm(), and of
+ * the level-synchronous tree_generate() with each SIMD kernel and
+ * with the subtrees generated on several threads, and of the
+ * rendering in depth-first order compared to grouped by state and
+ * to batched segment calls, and of the rendering into EPS, SVG and PNG
+ * one after the other compared to all at once in parallel, and of the
+ * plotfile written by the drawing thread compared to a writer thread.
+ *
+ ***********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "CPlotter.h"
+#include "template_funcs.h"
+
+#define PSZ 600   /* size [pix] of square plot area */
+
+typedef void tree_ft(int wied, const unsigned int psz, CPLT_gc_t gc);
+
+/***********************************************************************/
+
+double now(void) {
+   /* monotonic wall clock [s] */
+
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/***********************************************************************/
+
+double bench(tree_ft *tree, int wied, char *plotfilename, int reps) {
+   /* returns best time [s] of reps renderings of tree of depth wied */
+
+   CPLT_gc_t gc;
+   double t, best = -1.;
+   int r;
+
+   for (r = 0; r < reps; r++) {
+      if ((gc = CPLT_init_graphics(PSZ, PSZ, plotfilename)) == NULL) exit(1);
+      t = now();
+      (*tree)(wied, PSZ, gc);
+      t = now() - t;
+      CPLT_finish_graphics(gc);
+      if (best < 0 || t < best) best = t;
+   }
+
+   return best;
+}
+
+/***********************************************************************/
+
+typedef int gen_ft(segbuf_t *sb, const tree_param_t *tp);
+
+double bench_gen(gen_ft *gen, int wied, int reps) {
+   /* returns best time [s] of reps generations of tree of depth wied */
+
+   segbuf_t sb;
+   tree_param_t tp;
+   double t, best = -1.;
+   int r;
+
+   tree_param_init(&tp, wied, PSZ);
+   if (segbuf_init(&sb, tree_numsegs(wied)) != 0) exit(1);
+   for (r = 0; r < reps; r++) {
+      t = now();
+      (*gen)(&sb, &tp);
+      t = now() - t;
+      if (best < 0 || t < best) best = t;
+   }
+   segbuf_free(&sb);
+
+   return best;
+}
+
+/***********************************************************************/
+
+double bench_render(int wied, int grouped, int batched, char *plotfilename,
+                    int reps, long *size) {
+   /* returns best time [s] of reps renderings by tree_render() of tree of
+    * depth wied, grouped by state and batched or not, and the plotfile's
+    * size */
+
+   CPLT_gc_t gc;
+   tree_param_t tp;
+   FILE *fp;
+   double t, best = -1.;
+   int r;
+
+   tree_param_init(&tp, wied, PSZ);
+   tp.grouped = grouped;
+   tp.batched = batched;
+   for (r = 0; r < reps; r++) {
+      if ((gc = CPLT_init_graphics(PSZ, PSZ, plotfilename)) == NULL) exit(1);
+      t = now();
+      if (tree_render(&tp, gc, NULL) != 0) exit(1);
+      CPLT_finish_graphics(gc);
+      t = now() - t;
+      if (best < 0 || t < best) best = t;
+   }
+   *size = 0;
+   if ((fp = fopen(plotfilename, "rb")) != NULL) {
+      fseek(fp, 0, SEEK_END);
+      *size = ftell(fp);
+      fclose(fp);
+   }
+
+   return best;
+}
+
+/***********************************************************************/
+
+double bench_multi(int wied, int multi, int reps) {
+   /* returns best time [s] of reps renderings by tree_render() of tree of
+    * depth wied into EPS, SVG and PNG, each on its own or all at once */
+
+   char *files[3] = { "bench_tree.eps", "bench_tree.svg", "bench_tree.png" };
+   CPLT_gc_t gc;
+   tree_param_t tp;
+   double t, best = -1.;
+   int r, i;
+
+   tree_param_init(&tp, wied, PSZ);
+   for (r = 0; r < reps; r++) {
+      t = now();
+      if (multi) {
+         if ((gc = CPLT_init_graphics_multi(PSZ, PSZ, files, 3)) == NULL)
+            exit(1);
+         if (tree_render(&tp, gc, NULL) != 0) exit(1);
+         CPLT_finish_graphics(gc);
+      } else {
+         for (i = 0; i < 3; i++) {
+            if ((gc = CPLT_init_graphics(PSZ, PSZ, files[i])) == NULL)
+               exit(1);
+            if (tree_render(&tp, gc, NULL) != 0) exit(1);
+            CPLT_finish_graphics(gc);
+         }
+      }
+      t = now() - t;
+      if (best < 0 || t < best) best = t;
+   }
+   for (i = 0; i < 3; i++) remove(files[i]);
+
+   return best;
+}
+
+/***********************************************************************/
+
+double bench_async(int wied, int async, char *plotfilename, int reps) {
+   /* returns best time [s] of reps renderings by tree_render() of tree of
+    * depth wied, the plotfile written and closed, by the drawing thread
+    * or async by a writer thread */
+
+   CPLT_gc_t gc;
+   tree_param_t tp;
+   double t, best = -1.;
+   int r;
+
+   tree_param_init(&tp, wied, PSZ);
+   for (r = 0; r < reps; r++) {
+      t = now();
+      gc = async ? CPLT_init_graphics_async(PSZ, PSZ, plotfilename, 0)
+                 : CPLT_init_graphics(PSZ, PSZ, plotfilename);
+      if (gc == NULL) exit(1);
+      if (tree_render(&tp, gc, NULL) != 0) exit(1);
+      CPLT_finish_graphics(gc);
+      t = now() - t;
+      if (best < 0 || t < best) best = t;
+   }
+
+   return best;
+}
+
+/***********************************************************************/
+
+int main(int argc, char *argv[]) {
+
+   char *kernel[3] = { "scalar", "sse2", "avx2" };
+   int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+   int i, k, wied, mind = 10, maxd = 18, gmind = 16, gmaxd = 22, reps = 3;
+   double trec, tit, tgen, tlibm, tbest, n;
+   long sord, sgrp;
+   char *suffix = "eps", plotfilename[40], label[20];
+
+   /* parse options */
+   for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+      switch (argv[i][1]) {
+         case 'd':
+            if (i + 2 >= argc) goto usage;
+            mind = atoi(argv[++i]);
+            maxd = atoi(argv[++i]);
+            break;
+         case 'g':
+            if (i + 2 >= argc) goto usage;
+            gmind = atoi(argv[++i]);
+            gmaxd = atoi(argv[++i]);
+            break;
+         case 'r':
+            if (i + 1 >= argc) goto usage;
+            reps = atoi(argv[++i]);
+            break;
+         case 't':
+            if (i + 1 >= argc) goto usage;
+            nthreads = atoi(argv[++i]);
+            break;
+         case 'h':
+         /* fall -through */
+         default:
+         usage:
+            fprintf(stderr, "Usage: %s [-h] [-d mindepth maxdepth] "
+                    "[-g mindepth maxdepth] [-r repeats] [-t threads] [suffix]\n",
+                    argv[0]);
+            fprintf(stderr,
+                    "       -h: print this help text\n"
+                    "       -d: range of tree depths rendered "
+                    "(default: 10 18)\n"
+                    "       -g: range of tree depths generated only "
+                    "(default: 16 22)\n"
+                    "       -r: repetitions, best is taken (default: 3)\n"
+                    "       -t: threads generating subtrees "
+                    "(default: number of CPUs)\n"
+                    "   suffix: graphics-format rendered to (eps [default],"
+                    " png, svg)\n");
+            return 1;
+      }
+   }
+   if (i <= argc - 1) suffix = argv[i];
+   sprintf(plotfilename, "bench_tree.%.8s", suffix);
+
+   printf("%5s %10s %14s %14s %8s\n", "depth", "segments",
+          "recursive/s", "iterative/s", "speedup");
+   for (wied = mind; wied <= maxd; wied++) {
+      n = tree_numsegs(wied);
+      trec = bench(&ploterplotfirst_rec, wied, plotfilename, reps);
+      tit  = bench(&ploterplotfirst,     wied, plotfilename, reps);
+      printf("%5d %10.0f %14.0f %14.0f %8.2f\n",
+             wied, n, n / trec, n / tit, trec / tit);
+   }
+   remove(plotfilename);
+
+   /* incl. writing the plotfile, whose size shrinks with fewer changes */
+   printf("\n%5s %10s %14s %14s %8s %12s %12s\n", "depth", "segments",
+          "ordered/s", "grouped/s", "speedup", "ordered/B", "grouped/B");
+   for (wied = mind; wied <= maxd; wied++) {
+      n = tree_numsegs(wied);
+      tit  = bench_render(wied, 0, 0, plotfilename, reps, &sord);
+      tbest = bench_render(wied, 1, 0, plotfilename, reps, &sgrp);
+      printf("%5d %10.0f %14.0f %14.0f %8.2f %12ld %12ld\n",
+             wied, n, n / tit, n / tbest, tit / tbest, sord, sgrp);
+   }
+   remove(plotfilename);
+
+   printf("\n%5s %10s %14s %14s %8s %12s %12s\n", "depth", "segments",
+          "ordered/s", "batched/s", "speedup", "ordered/B", "batched/B");
+   for (wied = mind; wied <= maxd; wied++) {
+      n = tree_numsegs(wied);
+      tit  = bench_render(wied, 0, 0, plotfilename, reps, &sord);
+      tbest = bench_render(wied, 0, 1, plotfilename, reps, &sgrp);
+      printf("%5d %10.0f %14.0f %14.0f %8.2f %12ld %12ld\n",
+             wied, n, n / tit, n / tbest, tit / tbest, sord, sgrp);
+   }
+   remove(plotfilename);
+
+   /* incl. closing the plotfile, i.e. until it's all written */
+   printf("\n%5s %10s %14s %14s %8s\n", "depth", "segments",
+          "sync/s", "async/s", "speedup");
+   for (wied = mind; wied <= maxd; wied++) {
+      n = tree_numsegs(wied);
+      tit  = bench_async(wied, 0, plotfilename, reps);
+      tbest = bench_async(wied, 1, plotfilename, reps);
+      printf("%5d %10.0f %14.0f %14.0f %8.2f\n",
+             wied, n, n / tit, n / tbest, tit / tbest);
+   }
+   remove(plotfilename);
+
+   /* incl. finishing the plotfiles, PNG's encoding takes longest */
+   printf("\n%5s %10s %14s %14s %8s\n", "depth", "segments",
+          "one by one/s", "parallel/s", "speedup");
+   for (wied = mind; wied <= maxd; wied++) {
+      n = tree_numsegs(wied);
+      tit  = bench_multi(wied, 0, reps);
+      tbest = bench_multi(wied, 1, reps);
+      printf("%5d %10.0f %14.0f %14.0f %8.2f\n",
+             wied, n, n / tit, n / tbest, tit / tbest);
+   }
+
+   printf("\n%5s %10s %14s %14s %8s\n", "depth", "segments",
+          "cos,sin/s", "rotation/s", "speedup");
+   for (wied = gmind; wied <= gmaxd; wied++) {
+      n = tree_numsegs(wied);
+      tlibm = bench_gen(&tree_generate_libm, wied, reps);
+      tgen  = bench_gen(&tree_generate_dfs,  wied, reps);
+      printf("%5d %10.0f %14.0f %14.0f %8.2f\n",
+             wied, n, n / tlibm, n / tgen, tlibm / tgen);
+   }
+
+   /* segment buffer traffic: 5 floats and 1 byte per segment */
+   printf("\n%5s %10s %14s", "depth", "segments", "depth-first/s");
+   for (k = 0; k < 3; k++) printf(" %14s", kernel[k]);
+   printf(" %8s\n", "GB/s");
+   for (wied = gmind; wied <= gmaxd; wied++) {
+      n = tree_numsegs(wied);
+      tgen = bench_gen(&tree_generate_dfs, wied, reps);
+      printf("%5d %10.0f %14.0f", wied, n, n / tgen);
+      for (k = 0; k < 3; k++) {
+         if (tree_simd(kernel[k]) == NULL) { printf(" %14s", "-"); continue; }
+         tbest = bench_gen(&tree_generate, wied, reps);
+         printf(" %14.0f", n / tbest);
+      }
+      tree_simd(NULL);
+      tbest = bench_gen(&tree_generate, wied, reps);
+      printf(" %8.2f\n", n * (5 * sizeof(float) + 1) / tbest * 1e-9);
+   }
+
+   sprintf(label, "%d threads/s", nthreads);
+   printf("\n%5s %10s %14s %14s %8s\n", "depth", "segments",
+          "1 thread/s", label, "speedup");
+   for (wied = gmind; wied <= gmaxd; wied++) {
+      n = tree_numsegs(wied);
+      tgen = bench_gen(&tree_generate, wied, reps);
+      if (tree_threads(nthreads, 0) != 0) exit(1);
+      tbest = bench_gen(&tree_generate, wied, reps);
+      tree_threads(1, 0);
+      printf("%5d %10.0f %14.0f %14.0f %8.2f\n",
+             wied, n, n / tgen, n / tbest, tgen / tbest);
+   }
+
+   return 0;
+}
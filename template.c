@@ -1,32 +1,86 @@
 /***********************************************************************
  * Template for using graphics-ADT CPlotter
  *
+ * Renders the tree into a plotfile, with its parameters from the
+ * command line, or a batch of trees listed in a manifest file, each
+ * line as "plotfile [size=N] [depth=N] [length=X] [width=N] [step=X]
+ * [min_length=X] [min_width=X] [stub=0|1] [grouped=0|1] [instanced=0|1]
+ * [transformed=0|1] [batched=0|1]", the parameters not given taken from
+ * the command line.
+ * A plotfile may be a comma-separated list: the plot is drawn once then,
+ * passed on to all plotfiles' graphics formats in parallel, also if the
+ * plots are rendered by several workers.
+ *
  ***********************************************************************/
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include "CPlotter.h"
 #include "template_funcs.h"
+#include "workpool.h"
 
-int main() {
+#define MAXLINE 1024    /* max. length of manifest lines */
 
-   const unsigned int PSZ = 600;    /* size [pix] of square plot area */
+/* a plot to render */
+typedef struct {
+   char *plotfilename;
+   tree_param_t tp;
+   unsigned long pruned;            /* segments left out by LOD */
+   int fail;
+} job_t;
 
-   CPLT_gc_t gc;                    /* graphics context */
-   CPLT_point_t pts[4];             /* coord. points */
-   char *plotfilename = "graphic.svg";
-   
-   int a=20;
+/***********************************************************************/
+
+char **split_plotfiles(const char *list, int *n) {
+   /* splits the comma-separated list of plotfiles into their names,
+    * returns them malloc'ed in one block, or NULL if out of memory */
+
+   char **names, *cp;
+   int max = 2;
+
+   for (cp = (char *)list; *cp; cp++) max += *cp == ',';
+   if ((names = (char **) malloc(max * sizeof(char *) + strlen(list) + 1))
+       == NULL) {
+      fprintf(stderr, " *** Not enough memory for plotfile names!\n");
+      return NULL;
+   }
+   cp = strcpy((char *)(names + max), list);
+   for (*n = 0; (names[*n] = strsep(&cp, ",")) != NULL; ++*n) ;
+
+   return names;
+}
 
+/***********************************************************************/
 
+void render_job(void *arg, int worker) {
+   /* renders the tree of a job into its plotfile(s), task of the pool */
 
-  int wied=10;
+   job_t *job = (job_t *)arg;
+   const unsigned int PSZ = job->tp.psz;  /* size [pix] of plot area */
 
-   /* initialize graphics context */
-   if ((gc = CPLT_init_graphics(PSZ, PSZ, plotfilename)) == NULL) {
-      fprintf(stderr, "\n *** Can't initialize graphics context, abort!\n");
-      return 1;
+   CPLT_gc_t gc;                    /* graphics context */
+   CPLT_point_t pts[4];             /* coord. points */
+   char **files;                    /* the plotfiles */
+   int nfiles;
+
+   if ((files = split_plotfiles(job->plotfilename, &nfiles)) == NULL) {
+      job->fail = 1;
+      return;
+   }
+
+   /* initialize graphics context, of several plotfiles at once */
+   if (nfiles == 1)
+      gc = CPLT_init_graphics(PSZ, PSZ, files[0]);
+   else
+      gc = CPLT_init_graphics_multi(PSZ, PSZ, files, nfiles);
+   if (gc == NULL) {
+      fprintf(stderr, "\n *** Can't initialize graphics context for '%s'!\n",
+              job->plotfilename);
+      job->fail = 1;
+      free(files);
+      return;
    }
 
    /* blue box border, title */
@@ -36,36 +90,274 @@ int main() {
    pts[1].x = PSZ - 1.;   pts[1].y = 1.;
    pts[2].x = PSZ - 1.;   pts[2].y = PSZ - 1.;
    pts[3].x = 1.;         pts[3].y = PSZ - 1.;
-   
-   	
-	
-	
-
-   
    CPLT_draw_polygon(gc, 4, pts);
- 
+
    CPLT_set_color(gc, 0., 0., 0.);
    CPLT_set_fontsize(gc, 16);
    CPLT_draw_text(gc, 0.5 * PSZ+15, PSZ - 20., "sw", 0., "Baum");
-                                                                                                 
-
-   /* TODO */
-
-        			
-  
-   
-        			
-	
-	
-   			 ploterplotfirst  (wied,PSZ,gc);
-   					
-   			
-   				
-  	
-  		 /* finish graphics */
- CPLT_finish_graphics(gc);
-    
-   printf("\n Done, plot written to plotfile '%s'.\n", plotfilename);
+
+   /* the tree */
+   if (tree_render(&job->tp, gc, &job->pruned) != 0) job->fail = 1;
+
+   /* finish graphics */
+   CPLT_finish_graphics(gc);
+   free(files);
+}
+
+/***********************************************************************/
+
+int parse_param(tree_param_t *tp, const char *key, const char *val) {
+   /* sets parameter key of tp to value val, returns -1 if either is bad */
+
+   char *end;
+   double d;
+
+   d = strtod(val, &end);
+   if (end == val || *end != '\0') return -1;
+
+   if (strcmp(key, "size") == 0 && d >= 1 && d == floor(d))
+      tp->psz = d;
+   else if (strcmp(key, "depth") == 0 && d >= 0 && d <= 40 && d == floor(d))
+      tp->depth = d;
+   else if (strcmp(key, "length") == 0 && d > 0)
+      tp->len = d;
+   else if (strcmp(key, "width") == 0 && d >= 0 && d == floor(d))
+      tp->width = d;
+   else if (strcmp(key, "step") == 0)
+      tp->step = d;
+   else if (strcmp(key, "min_length") == 0 && d >= 0)
+      tp->min_len = d;
+   else if (strcmp(key, "min_width") == 0 && d >= 0)
+      tp->min_width = d;
+   else if (strcmp(key, "stub") == 0 && (d == 0 || d == 1))
+      tp->stub = d;
+   else if (strcmp(key, "grouped") == 0 && (d == 0 || d == 1))
+      tp->grouped = d;
+   else if (strcmp(key, "instanced") == 0 && (d == 0 || d == 1))
+      tp->instanced = d;
+   else if (strcmp(key, "transformed") == 0 && (d == 0 || d == 1))
+      tp->transformed = d;
+   else if (strcmp(key, "batched") == 0 && (d == 0 || d == 1))
+      tp->batched = d;
+   else
+      return -1;
 
    return 0;
 }
+
+/***********************************************************************/
+
+job_t *read_manifest(const char *manifest, const tree_param_t *tp, int *njobs) {
+   /* reads the jobs of the manifest file, with parameters not given
+    * set from tp, returns them malloc'ed or NULL on error */
+
+   FILE *fp;
+   job_t *jobs = NULL, *j;
+   char line[MAXLINE], *tok, *val;
+   int n = 0, lineno = 0, ok = 1;
+
+   if ((fp = fopen(manifest, "r")) == NULL) {
+      fprintf(stderr, " *** Can't open manifest file '%s'!\n", manifest);
+      return NULL;
+   }
+   while (ok && fgets(line, sizeof(line), fp) != NULL) {
+      lineno++;
+      if ((tok = strchr(line, '#')) != NULL) *tok = '\0';
+      if ((tok = strtok(line, " \t\r\n")) == NULL) continue;
+
+      if ((j = (job_t *) realloc(jobs, (n + 1) * sizeof(*jobs))) == NULL) {
+         fprintf(stderr, " *** Not enough memory for jobs!\n");
+         ok = 0;
+         break;
+      }
+      jobs = j;
+      j = &jobs[n];
+      j->tp = *tp;
+      j->pruned = 0;
+      j->fail = 0;
+      if ((j->plotfilename = strdup(tok)) == NULL) {
+         ok = 0;
+         break;
+      }
+      n++;
+      while ((tok = strtok(NULL, " \t\r\n")) != NULL) {
+         if ((val = strchr(tok, '=')) != NULL) *val++ = '\0';
+         if (val == NULL || parse_param(&j->tp, tok, val) != 0) {
+            fprintf(stderr, " *** %s:%d: bad parameter '%s'!\n",
+                    manifest, lineno, tok);
+            ok = 0;
+            break;
+         }
+      }
+   }
+   fclose(fp);
+
+   if (ok && n == 0) {
+      fprintf(stderr, " *** No plots in manifest file '%s'!\n", manifest);
+      ok = 0;
+   }
+   if (!ok) {
+      while (n > 0) free(jobs[--n].plotfilename);
+      free(jobs);
+      return NULL;
+   }
+   *njobs = n;
+   return jobs;
+}
+
+/***********************************************************************/
+
+int main(int argc, char *argv[]) {
+
+   tree_param_t tp;                 /* parameters of tree */
+   char *plotfilename = "graphic.svg";
+   char *manifest = NULL;
+   job_t single, *jobs;
+   workpool_t wp = NULL;
+   int nworkers = 1, nthreads = 1, njobs = 1, nfails = 0;
+   unsigned long npruned = 0;
+   int i;
+
+   tree_param_init(&tp, 10, 600);
+
+   /* parse options */
+   for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+      if (strchr("hSGITB", argv[i][1]) == NULL && i + 1 >= argc) goto usage;
+      switch (argv[i][1]) {
+         case 's':
+            if (parse_param(&tp, "size", argv[++i]) != 0) goto usage;
+            break;
+         case 'd':
+            if (parse_param(&tp, "depth", argv[++i]) != 0) goto usage;
+            break;
+         case 'l':
+            if (parse_param(&tp, "length", argv[++i]) != 0) goto usage;
+            break;
+         case 'w':
+            if (parse_param(&tp, "width", argv[++i]) != 0) goto usage;
+            break;
+         case 'a':
+            if (parse_param(&tp, "step", argv[++i]) != 0) goto usage;
+            break;
+         case 'L':
+            if (parse_param(&tp, "min_length", argv[++i]) != 0) goto usage;
+            break;
+         case 'W':
+            if (parse_param(&tp, "min_width", argv[++i]) != 0) goto usage;
+            break;
+         case 'S':
+            tp.stub = 1;
+            break;
+         case 'G':
+            tp.grouped = 1;
+            break;
+         case 'I':
+            tp.instanced = 1;
+            break;
+         case 'T':
+            tp.transformed = 1;
+            break;
+         case 'B':
+            tp.batched = 1;
+            break;
+         case 'o':
+            plotfilename = argv[++i];
+            break;
+         case 'm':
+            manifest = argv[++i];
+            break;
+         case 'j':
+            if ((nworkers = atoi(argv[++i])) < 1) goto usage;
+            break;
+         case 't':
+            if ((nthreads = atoi(argv[++i])) < 1) goto usage;
+            break;
+         case 'h':
+         /* fall -through */
+         default:
+         usage:
+            fprintf(stderr, "Usage: %s [-h] [-s size] [-d depth] [-l length] "
+                    "[-w width] [-a step]\n"
+                    "          [-L min_length] [-W min_width] [-S] [-G] [-I] [-T]\n"
+                    "          [-B] "
+                    "[-o plotfile | -m manifest] [-j workers] "
+                    "[-t threads]\n", argv[0]);
+            fprintf(stderr,
+                    "       -h: print this help text\n"
+                    "       -s: size [pix] of square plot area (default: 600)\n"
+                    "       -d: depth of tree (default: 10)\n"
+                    "       -l: length [pix] of trunk (default: 119)\n"
+                    "       -w: linewidth [pix] of trunk (default: 20)\n"
+                    "       -a: angle step [rad] of branching "
+                    "(default: 0.345575)\n"
+                    "       -L: leave out branches shorter than min_length "
+                    "[pix] (default: 0)\n"
+                    "       -W: leave out branches thinner than min_width "
+                    "[pix] (default: 0)\n"
+                    "       -S: end left out subtrees in a stub\n"
+                    "       -G: draw segments grouped by color and linewidth\n"
+                    "       -I: draw each level once: as a symbol (SVG), "
+                    "a sprite (PNG), or\n"
+                    "           by a recursive procedure (EPS, a symbol "
+                    "with stubs)\n"
+                    "       -T: draw each branch in its parent's coordinates, "
+                    "by transforms\n"
+                    "       -B: hand the segments to the graphics-format "
+                    "in batches\n"
+                    "       -o: plotfile, its suffix selects the "
+                    "graphics-format (default: graphic.svg),\n"
+                    "           or comma-separated plotfiles, "
+                    "all drawn at once\n"
+                    "       -m: manifest file with a plot per line: "
+                    "plotfile [size=N]\n"
+                    "           [depth=N] [length=X] [width=N] [step=X] "
+                    "[min_length=X]\n"
+                    "           [min_width=X] [stub=0|1] [grouped=0|1] "
+                    "[instanced=0|1]\n"
+                    "           [transformed=0|1] [batched=0|1], defaults "
+                    "from the options\n"
+                    "       -j: worker threads rendering the manifest's "
+                    "plots (default: 1)\n"
+                    "       -t: threads generating each tree (default: 1)\n");
+            return 1;
+      }
+   }
+   if (i < argc) goto usage;
+
+   /* the plots to render */
+   if (manifest) {
+      if ((jobs = read_manifest(manifest, &tp, &njobs)) == NULL) return 1;
+   } else {
+      single.plotfilename = plotfilename;
+      single.tp = tp;
+      single.pruned = 0;
+      single.fail = 0;
+      jobs = &single;
+   }
+
+   if (nthreads > 1 && tree_threads(nthreads, 0) != 0) return 1;
+   if (nworkers > njobs) nworkers = njobs;
+   if (nworkers > 1 && (wp = workpool_create(nworkers - 1)) == NULL) return 1;
+
+   workpool_run(wp, &render_job, jobs, sizeof(*jobs), njobs);
+
+   for (i = 0; i < njobs; i++) {
+      nfails += jobs[i].fail;
+      npruned += jobs[i].pruned;
+   }
+   workpool_destroy(wp);
+   tree_threads(1, 0);
+
+   if (manifest) {
+      printf("\n Done, %d of %d plots written as listed in manifest '%s'.\n",
+             njobs - nfails, njobs, manifest);
+      if (npruned) printf(" %lu segments pruned.\n", npruned);
+      for (i = 0; i < njobs; i++) free(jobs[i].plotfilename);
+      free(jobs);
+   } else if (!nfails) {
+      printf("\n Done, plot written to plotfile '%s'.\n", plotfilename);
+      if (npruned) printf(" %lu segments pruned.\n", npruned);
+   }
+
+   return nfails ? 1 : 0;
+}
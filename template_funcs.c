@@ -7,23 +7,29 @@
 
 
 #include "template_funcs.h"
+#include "workpool.h"
 #include <math.h>
+#include <string.h>
+#include <pthread.h>
+
+/* default angle step [rad] of each branching, see winkell()/winkelr() */
+#define WINSTEP 0.345575
 
 void   winkell  (double *windif){
 
 
-	*windif	=  (*windif-0.345575);
+	*windif	=  (*windif-WINSTEP);
 
 
 }
 void   winkelr  (double *windif){
 
 
-	*windif	=  (*windif+0.345575);
+	*windif	=  (*windif+WINSTEP);
 }
 
-/* TODO */
-void ploterplotfirst  (int wied, const unsigned int PSZ, CPLT_gc_t gc){
+/* recursive reference implementation, see ploterplotfirst() below */
+void ploterplotfirst_rec  (int wied, const unsigned int PSZ, CPLT_gc_t gc){
 	CPLT_point_t points[2];
 	int j=0;
 	int a=20;
@@ -45,8 +51,8 @@ color(gc,R,G,B,j);
 
 	CPLT_draw_polyline( gc,  2,points );
 
-	plotleft(l*fac_l, wied,PSZ,&points,j, gc,windif,fac_l,&a,k,R,G,B);
-	plotright(l*fac_l, wied,PSZ,&points,j, gc,windif,fac_l,&a,k,R,G,B);
+	plotleft(l*fac_l, wied,PSZ,points,j, gc,windif,fac_l,&a,k,R,G,B);
+	plotright(l*fac_l, wied,PSZ,points,j, gc,windif,fac_l,&a,k,R,G,B);
 }
 
 
@@ -74,8 +80,8 @@ color(gc,R,G,B,j);
 if (j<wied){
 
 
-		plotleft  (l*0.75,wied,PSZ,&temp1,j+1, gc,windif,fac_l,&a,k*0.75,R,G,B);
-		plotright (l*0.75,wied,PSZ,&temp1,j+1, gc,windif,fac_l,&a,k*0.75,R,G,B);
+		plotleft  (l*0.75,wied,PSZ,temp1,j+1, gc,windif,fac_l,a,k*0.75,R,G,B);
+		plotright (l*0.75,wied,PSZ,temp1,j+1, gc,windif,fac_l,a,k*0.75,R,G,B);
 
 	}
 
@@ -103,8 +109,8 @@ color(gc,R,G,B,j);
 	if (j<wied){
 
 
-		plotleft  (l*0.75,wied,PSZ,&temp1,j+1, gc,windif,fac_l,&a,k*0.75,R,G,B);
-		plotright (l*0.75,wied,PSZ,&temp1,j+1, gc,windif,fac_l,&a,k*0.75,R,G,B);
+		plotleft  (l*0.75,wied,PSZ,temp1,j+1, gc,windif,fac_l,a,k*0.75,R,G,B);
+		plotright (l*0.75,wied,PSZ,temp1,j+1, gc,windif,fac_l,a,k*0.75,R,G,B);
 
 
 	}
@@ -114,13 +120,1277 @@ color(gc,R,G,B,j);
 
 void color(CPLT_gc_t gc,double R,double G,double B,int j){
 
-R=0.25-(j*0.025);
-G=0.1+(j*0.07);
-B=0.1;
-CPLT_set_color(gc, R, G, B);
+float rgb[3];
+
+color_rgb(j, rgb);
+CPLT_set_color(gc, rgb[0], rgb[1], rgb[2]);
+
+}
+
+void color_rgb(int j, float rgb[3]){
+	/* the color of level j, as set by color() */
+
+	rgb[0] = 0.25-(j*0.025);
+	rgb[1] = 0.1+(j*0.07);
+	rgb[2] = 0.1;
+}
+
+
+
+
+
+/***********************************************************************
+ * iterative tree generator
+ ***********************************************************************/
+
+/* a pending branch on the explicit stack of tree_generate_dfs() */
+typedef struct {
+	CPLT_point_t p;		/* start point of branch [pix] */
+	double l;		/* length of branch [pix] */
+	double c, s;		/* direction of branch as cos/sin, already turned */
+	double windif;		/* direction of branch [rad], only for _libm() */
+	int k;			/* linewidth of branch [pix] */
+	int j;			/* depth level of branch */
+} branch_t;
+
+static int _lod(const tree_param_t *tp, double *stublen, int *stubk);
+
+void ploterplotfirst  (int wied, const unsigned int PSZ, CPLT_gc_t gc){
+	/* Plots the tree with exactly the segments (and calls) of the recursion
+	 * ploterplotfirst_rec(), see tree_render(). */
+
+	tree_param_t tp;
+
+	tree_param_init(&tp, wied, PSZ);
+	tree_render(&tp, gc, NULL);
+}
+
+/***********************************************************************/
+
+void tree_param_init  (tree_param_t *tp, int wied, const unsigned int PSZ){
+	/* Sets the parameters of the tree of depth wied in a plot area of
+	 * PSZ x PSZ pix, the others to those of the original template. */
+
+	tp->psz   = PSZ;
+	tp->depth = wied;
+	tp->len   = 119;
+	tp->width = 20;
+	tp->step  = WINSTEP;
+	tp->min_len   = 0.;
+	tp->min_width = 0.;
+	tp->stub      = 0;
+	tp->grouped   = 0;
+	tp->instanced = 0;
+	tp->transformed = 0;
+	tp->batched   = 0;
+}
+
+/***********************************************************************/
+
+int tree_render  (const tree_param_t *tp, CPLT_gc_t gc, unsigned long *pruned){
+	/* Plots the tree of tp: generates its geometry into a segment buffer
+	 * first, then emits the buffer to gc, grouped and/or batched as tp
+	 * says, or if tp->instanced and the graphics format has symbols or
+	 * branching, draws each level once, or if tp->transformed, draws
+	 * each branch in its parent's coordinates.
+	 * Sets *pruned, if not NULL, to the number of segments left out by
+	 * LOD pruning. Returns 0 on success, -1 if out of memory. */
+
+	segbuf_t sb;
+	double stublen;
+	int keep, stubk, ret = -1;
+
+	/* the symbols hold the geometry, if the graphics format has them */
+	if ((tp->instanced && tree_emit_instanced(tp, gc) == 0) ||
+	    (tp->transformed && tree_emit_transformed(tp, gc) == 0)) {
+		if (pruned) {
+			keep = _lod(tp, &stublen, &stubk);
+			*pruned = tree_numsegs(tp->depth) -
+				  (keep >= 0 ? tree_numsegs(keep) : 1);
+		}
+		return 0;
+	}
+
+	if (segbuf_init(&sb, tree_numsegs(tp->depth)) != 0) return -1;
+	if (tree_generate(&sb, tp) == 0) {
+		if (tp->batched) ret = tree_emit_batched(&sb, gc, tp->grouped);
+		else if (tp->grouped) ret = tree_emit_grouped(&sb, gc);
+		else {
+			tree_emit(&sb, gc);
+			ret = 0;
+		}
+		if (pruned) *pruned = sb.pruned;
+	}
+	segbuf_free(&sb);
+
+	return ret;
+}
+
+/***********************************************************************/
+
+static int _lod(const tree_param_t *tp, double *stublen, int *stubk){
+	/* Returns the deepest level of the tree of tp kept by LOD pruning,
+	 * i.e. whose branches are at least min_len long and min_width wide,
+	 * -1 if only the trunk is. Sets the length and width of the stubs
+	 * which stand in for the pruned subtrees, if tp->stub: the reach of
+	 * a subtree's zig-zag middle path, i.e. the sum of the pruned levels'
+	 * lengths times cos(step), and the first pruned level's width. */
+
+	const int D = tp->depth > 0 ? tp->depth : 0;
+	double l = tp->len*(double)(float)0.75;
+	int j, k = tp->width, keep = -1;
+
+	*stublen = 0.;
+	*stubk = 0;
+	for (j = 0; j <= D; j++) {
+		if (keep == j-1 && l >= tp->min_len && k >= tp->min_width) {
+			keep = j;
+		} else {
+			if (keep == j-1) *stubk = k;
+			*stublen += l;
+		}
+		l = l*0.75;	k = k*0.75;
+	}
+	*stublen *= cos(tp->step);
+
+	return keep;
+}
+
+/***********************************************************************/
+
+int tree_generate_dfs  (segbuf_t *sb, const tree_param_t *tp){
+	/* Generates the segments of the tree of tp into sb, in the
+	 * depth-first order of the recursion. Walks the tree from an explicit
+	 * stack which is preallocated for depth+2 branches, so the depth is only
+	 * limited by the size of sb, not by the C stack.
+	 * Instead of the angle, each branch carries its direction as cos/sin,
+	 * a child's direction is the parent's rotated by +-step, i.e. a
+	 * complex multiplication, so the loop needs no libm calls. The rounding
+	 * error of the directions grows only linearly with the depth, i.e.
+	 * stays far below float precision of the points.
+	 * Below the level kept by LOD pruning, see tree_param_t, the branches
+	 * end in a stub each, if tp->stub, else without children.
+	 * Returns 0 on success, -1 if sb is too small or out of memory. */
+
+	const int wied = tp->depth;
+	const unsigned int PSZ = tp->psz;
+	branch_t *stack, b, c;
+	unsigned long i = 0;
+	int n = 0;
+	int k = tp->width;
+	double l = tp->len;
+	double windif = 1.53938;
+	const float fac_l = 0.75;
+	const double rc = cos(tp->step), rs = sin(tp->step);	/* rotation */
+	double stublen;
+	int stubk;
+	const int keep = _lod(tp, &stublen, &stubk);
+	const int stub = tp->stub && keep < (wied > 0 ? wied : 0);
+
+	if (sb->cap < tree_numsegs(wied)) {
+		fprintf(stderr, " *** Segment buffer too small for tree!\n");
+		return -1;
+	}
+
+	/* each popped branch pushes its two children, right first so the
+	 * left subtree comes first; hence the stack never holds more than
+	 * one pending right sibling per level plus the current pair */
+	stack = (branch_t *) malloc(((wied > 0 ? wied : 0) + 2) * sizeof(*stack));
+	if (stack == NULL) {
+		fprintf(stderr, " *** Not enough memory for tree stack!\n");
+		return -1;
+	}
+
+	/* trunk */
+	sb->x0[i] = PSZ/2.;	sb->y0[i] = 1.;
+	sb->x1[i] = PSZ/2.;	sb->y1[i] = l;
+	sb->width[i] = k;	sb->level[i] = 0;
+
+	c.p.x = sb->x1[i];	c.p.y = sb->y1[i];
+	c.l = l*fac_l;		c.k = k;	c.j = 0;
+	b.c = cos(windif);	b.s = sin(windif);
+	if (keep >= 0) {
+		c.c = b.c*rc - b.s*rs;	c.s = b.s*rc + b.c*rs;	stack[n++] = c;
+		c.c = b.c*rc + b.s*rs;	c.s = b.s*rc - b.c*rs;	stack[n++] = c;
+	} else if (stub) {
+		i++;
+		sb->x0[i] = sb->x1[0];
+		sb->y0[i] = sb->y1[0];
+		sb->x1[i] = sb->x1[0]-(b.c*stublen);
+		sb->y1[i] = sb->y1[0]+(b.s*stublen);
+		sb->width[i] = stubk;
+		sb->level[i] = 0;
+	}
+	i++;
+
+	while (n > 0) {
+		b = stack[--n];
+
+		sb->x0[i] = b.p.x;
+		sb->y0[i] = b.p.y;
+		sb->x1[i] = b.p.x-(b.c*b.l);
+		sb->y1[i] = b.p.y+(b.s*b.l);
+		sb->width[i] = b.k;
+		sb->level[i] = b.j;
+
+		if (b.j < keep) {
+			c.p.x = sb->x1[i];	c.p.y = sb->y1[i];
+			c.l = b.l*0.75;		c.k = b.k*0.75;	c.j = b.j+1;
+			/* right: +step, left: -step */
+			c.c = b.c*rc - b.s*rs;	c.s = b.s*rc + b.c*rs;	stack[n++] = c;
+			c.c = b.c*rc + b.s*rs;	c.s = b.s*rc - b.c*rs;	stack[n++] = c;
+		} else if (stub) {
+			sb->x0[i+1] = sb->x1[i];
+			sb->y0[i+1] = sb->y1[i];
+			sb->x1[i+1] = sb->x1[i]-(b.c*stublen);
+			sb->y1[i+1] = sb->y1[i]+(b.s*stublen);
+			sb->width[i+1] = stubk;
+			sb->level[i+1] = b.j+1;
+			i++;
+		}
+		i++;
+	}
+	sb->n = i;
+	sb->pruned = tree_numsegs(wied) - (keep >= 0 ? tree_numsegs(keep) : 1);
+
+	free(stack);
+	return 0;
+}
+
+/***********************************************************************/
+
+int tree_generate_libm  (segbuf_t *sb, const tree_param_t *tp){
+	/* Reference for tree_generate_dfs(), for benchmark and accuracy check:
+	 * turns the direction angle like the recursion did and calls cos()
+	 * and sin() for every branch. */
+
+	const int wied = tp->depth;
+	const unsigned int PSZ = tp->psz;
+	branch_t *stack, b, c;
+	unsigned long i = 0;
+	int n = 0;
+	int k = tp->width;
+	double l = tp->len;
+	double windif = 1.53938;
+	const float fac_l = 0.75;
+
+	if (sb->cap < tree_numsegs(wied)) {
+		fprintf(stderr, " *** Segment buffer too small for tree!\n");
+		return -1;
+	}
+
+	stack = (branch_t *) malloc(((wied > 0 ? wied : 0) + 2) * sizeof(*stack));
+	if (stack == NULL) {
+		fprintf(stderr, " *** Not enough memory for tree stack!\n");
+		return -1;
+	}
+
+	/* trunk */
+	sb->x0[i] = PSZ/2.;	sb->y0[i] = 1.;
+	sb->x1[i] = PSZ/2.;	sb->y1[i] = l;
+	sb->width[i] = k;	sb->level[i] = 0;
+
+	c.p.x = sb->x1[i];	c.p.y = sb->y1[i];
+	c.l = l*fac_l;		c.k = k;	c.j = 0;
+	c.windif = windif + tp->step;	stack[n++] = c;
+	c.windif = windif - tp->step;	stack[n++] = c;
+	i++;
+
+	while (n > 0) {
+		b = stack[--n];
+
+		sb->x0[i] = b.p.x;
+		sb->y0[i] = b.p.y;
+		sb->x1[i] = b.p.x-(cos(b.windif)*b.l);
+		sb->y1[i] = b.p.y+(sin(b.windif)*b.l);
+		sb->width[i] = b.k;
+		sb->level[i] = b.j;
+
+		if (b.j < wied) {
+			c.p.x = sb->x1[i];	c.p.y = sb->y1[i];
+			c.l = b.l*0.75;		c.k = b.k*0.75;	c.j = b.j+1;
+			c.windif = b.windif + tp->step;	stack[n++] = c;
+			c.windif = b.windif - tp->step;	stack[n++] = c;
+		}
+		i++;
+	}
+	sb->n = i;
+	sb->pruned = 0;
+
+	free(stack);
+	return 0;
+}
+
+/***********************************************************************
+ * level-synchronous tree generator
+ ***********************************************************************/
+
+/* height [levels] of the subtrees expanded breadth-first at once, so the
+ * scratch levels of at most 2^BFS_HEIGHT branches stay in L1 cache and
+ * the segments they scatter to in a window of the segment buffer */
+#define BFS_HEIGHT 7
+
+/* a level of pending branches of tree_generate(), each branch's children
+ * are stored next to each other, left one first */
+typedef struct {
+	float *x, *y;		/* end points of branches [pix] */
+	double *c, *s;		/* directions of branches as cos/sin */
+	unsigned long *pos;	/* indices of branches in segment buffer */
+	void *mem;		/* memory block of all arrays */
+} level_t;
+
+/* per level constants of a tree */
+typedef struct {
+	int D;			/* deepest level kept by LOD pruning */
+	int stub;		/* if level D's branches end in a stub */
+	double stublen;		/* length of stubs */
+	int stubk;		/* linewidth of stubs */
+	double rc, rs;		/* rotation by the angle step as cos/sin */
+	double *l;		/* lengths of branches per level */
+	int *k;			/* linewidths of branches per level */
+	unsigned long *S;	/* sizes of subtrees per level */
+	void *mem;		/* memory block of all arrays */
+} shape_t;
+
+/* scratch levels of _expand_tree() */
+typedef struct {
+	level_t top[2];		/* top levels above subtrees */
+	level_t sub[2];		/* levels of one subtree */
+} scratch_t;
+
+static void _scratch_free(scratch_t *sc);
+
+/* kernel expanding n parents into their 2n children, i.e. one level:
+ * end points cx/cy of the children of length l, their directions cc/cs
+ * (if not NULL) rotated by rc/rs = cos/sin(step) */
+typedef void expand_ft(unsigned long n, const float *px, const float *py,
+		       const double *pc, const double *ps, double l,
+		       double rc, double rs,
+		       float *cx, float *cy, double *cc, double *cs);
+
+static void _expand_scalar(unsigned long n, const float *px, const float *py,
+			   const double *pc, const double *ps, double l,
+			   double rc, double rs,
+			   float *cx, float *cy, double *cc, double *cs){
+	/* kernel: plain C, the same arithmetic as tree_generate_dfs(),
+	 * which all other kernels have to reproduce bit by bit */
+
+	unsigned long i;
+	double c, s;
+
+	for (i = 0; i < n; i++) {
+		/* left: -step */
+		c = pc[i]*rc + ps[i]*rs;	s = ps[i]*rc - pc[i]*rs;
+		cx[2*i] = px[i]-(c*l);		cy[2*i] = py[i]+(s*l);
+		if (cc) { cc[2*i] = c;		cs[2*i] = s; }
+		/* right: +step */
+		c = pc[i]*rc - ps[i]*rs;	s = ps[i]*rc + pc[i]*rs;
+		cx[2*i+1] = px[i]-(c*l);	cy[2*i+1] = py[i]+(s*l);
+		if (cc) { cc[2*i+1] = c;	cs[2*i+1] = s; }
+	}
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+
+__attribute__((target("sse2")))
+static void _expand_sse2(unsigned long n, const float *px, const float *py,
+			 const double *pc, const double *ps, double l,
+			 double rc, double rs,
+			 float *cx, float *cy, double *cc, double *cs){
+	/* kernel: SSE2, 2 parents per step */
+
+	const __m128d vrc = _mm_set1_pd(rc), vrs = _mm_set1_pd(rs);
+	const __m128d vl = _mm_set1_pd(l);
+	__m128d c, s, x, y, crc, srs, src, crs, lc, ls, rtc, rts, lx, ly, rx, ry;
+	unsigned long i;
+
+	for (i = 0; i + 2 <= n; i += 2) {
+		c = _mm_loadu_pd(pc + i);
+		s = _mm_loadu_pd(ps + i);
+		x = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)(px + i))));
+		y = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)(py + i))));
+
+		crc = _mm_mul_pd(c, vrc);	srs = _mm_mul_pd(s, vrs);
+		src = _mm_mul_pd(s, vrc);	crs = _mm_mul_pd(c, vrs);
+		lc  = _mm_add_pd(crc, srs);	ls  = _mm_sub_pd(src, crs);
+		rtc = _mm_sub_pd(crc, srs);	rts = _mm_add_pd(src, crs);
+
+		lx = _mm_sub_pd(x, _mm_mul_pd(lc, vl));
+		ly = _mm_add_pd(y, _mm_mul_pd(ls, vl));
+		rx = _mm_sub_pd(x, _mm_mul_pd(rtc, vl));
+		ry = _mm_add_pd(y, _mm_mul_pd(rts, vl));
+
+		/* interleave children: left0 right0 left1 right1 */
+		_mm_storeu_ps(cx + 2*i,
+			      _mm_movelh_ps(_mm_cvtpd_ps(_mm_unpacklo_pd(lx, rx)),
+					    _mm_cvtpd_ps(_mm_unpackhi_pd(lx, rx))));
+		_mm_storeu_ps(cy + 2*i,
+			      _mm_movelh_ps(_mm_cvtpd_ps(_mm_unpacklo_pd(ly, ry)),
+					    _mm_cvtpd_ps(_mm_unpackhi_pd(ly, ry))));
+		if (cc) {
+			_mm_storeu_pd(cc + 2*i,     _mm_unpacklo_pd(lc, rtc));
+			_mm_storeu_pd(cc + 2*i + 2, _mm_unpackhi_pd(lc, rtc));
+			_mm_storeu_pd(cs + 2*i,     _mm_unpacklo_pd(ls, rts));
+			_mm_storeu_pd(cs + 2*i + 2, _mm_unpackhi_pd(ls, rts));
+		}
+	}
+	if (i < n)
+		_expand_scalar(n - i, px + i, py + i, pc + i, ps + i, l, rc, rs,
+			       cx + 2*i, cy + 2*i,
+			       cc ? cc + 2*i : NULL, cs ? cs + 2*i : NULL);
+}
+
+__attribute__((target("avx2")))
+static void _expand_avx2(unsigned long n, const float *px, const float *py,
+			 const double *pc, const double *ps, double l,
+			 double rc, double rs,
+			 float *cx, float *cy, double *cc, double *cs){
+	/* kernel: AVX2, 4 parents per step */
+
+	const __m256d vrc = _mm256_set1_pd(rc), vrs = _mm256_set1_pd(rs);
+	const __m256d vl = _mm256_set1_pd(l);
+	__m256d c, s, x, y, crc, srs, src, crs, lc, ls, rtc, rts, lx, ly, rx, ry;
+	__m256d lo, hi;
+	__m128 fl, fr;
+	unsigned long i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		c = _mm256_loadu_pd(pc + i);
+		s = _mm256_loadu_pd(ps + i);
+		x = _mm256_cvtps_pd(_mm_loadu_ps(px + i));
+		y = _mm256_cvtps_pd(_mm_loadu_ps(py + i));
+
+		crc = _mm256_mul_pd(c, vrc);	srs = _mm256_mul_pd(s, vrs);
+		src = _mm256_mul_pd(s, vrc);	crs = _mm256_mul_pd(c, vrs);
+		lc  = _mm256_add_pd(crc, srs);	ls  = _mm256_sub_pd(src, crs);
+		rtc = _mm256_sub_pd(crc, srs);	rts = _mm256_add_pd(src, crs);
+
+		lx = _mm256_sub_pd(x, _mm256_mul_pd(lc, vl));
+		ly = _mm256_add_pd(y, _mm256_mul_pd(ls, vl));
+		rx = _mm256_sub_pd(x, _mm256_mul_pd(rtc, vl));
+		ry = _mm256_add_pd(y, _mm256_mul_pd(rts, vl));
+
+		/* interleave children: left0 right0 ... left3 right3 */
+		fl = _mm256_cvtpd_ps(lx);	fr = _mm256_cvtpd_ps(rx);
+		_mm_storeu_ps(cx + 2*i,     _mm_unpacklo_ps(fl, fr));
+		_mm_storeu_ps(cx + 2*i + 4, _mm_unpackhi_ps(fl, fr));
+		fl = _mm256_cvtpd_ps(ly);	fr = _mm256_cvtpd_ps(ry);
+		_mm_storeu_ps(cy + 2*i,     _mm_unpacklo_ps(fl, fr));
+		_mm_storeu_ps(cy + 2*i + 4, _mm_unpackhi_ps(fl, fr));
+		if (cc) {
+			lo = _mm256_unpacklo_pd(lc, rtc);	/* l0 r0 l2 r2 */
+			hi = _mm256_unpackhi_pd(lc, rtc);	/* l1 r1 l3 r3 */
+			_mm256_storeu_pd(cc + 2*i,     _mm256_permute2f128_pd(lo, hi, 0x20));
+			_mm256_storeu_pd(cc + 2*i + 4, _mm256_permute2f128_pd(lo, hi, 0x31));
+			lo = _mm256_unpacklo_pd(ls, rts);
+			hi = _mm256_unpackhi_pd(ls, rts);
+			_mm256_storeu_pd(cs + 2*i,     _mm256_permute2f128_pd(lo, hi, 0x20));
+			_mm256_storeu_pd(cs + 2*i + 4, _mm256_permute2f128_pd(lo, hi, 0x31));
+		}
+	}
+	if (i < n)
+		_expand_sse2(n - i, px + i, py + i, pc + i, ps + i, l, rc, rs,
+			     cx + 2*i, cy + 2*i,
+			     cc ? cc + 2*i : NULL, cs ? cs + 2*i : NULL);
+}
+
+static int _have_sse2(void) { return __builtin_cpu_supports("sse2"); }
+static int _have_avx2(void) { return __builtin_cpu_supports("avx2"); }
+#endif
+
+static int _have_any(void) { return 1; }
+
+/* available kernels, best last */
+static const struct {
+	char *name;
+	expand_ft *expand;
+	int (*supported)(void);
+} KERNEL[] = {
+	{ "scalar", &_expand_scalar, &_have_any },
+#ifdef HAVE_X86_KERNELS
+	{ "sse2",   &_expand_sse2,   &_have_sse2 },
+	{ "avx2",   &_expand_avx2,   &_have_avx2 },
+#endif
+};
+
+static int _kernel = -1;	/* index of selected kernel, -1: not yet */
+static pthread_once_t _kernel_once = PTHREAD_ONCE_INIT;
+
+static void _kernel_auto(void){
+	if (_kernel < 0) tree_simd(NULL);
+}
+
+/***********************************************************************/
+
+const char *tree_simd  (const char *name){
+	/* Selects the kernel of tree_generate() by name ("scalar", "sse2",
+	 * "avx2") or, if name is NULL or "auto", the best one the CPU supports.
+	 * Returns the name of the selected kernel, or NULL if the requested
+	 * one is unknown or not supported, the selection is unchanged then. */
+
+	int i, NK = sizeof(KERNEL) / sizeof(KERNEL[0]);
+
+	for (i = NK - 1; i >= 0; i--) {
+		if (name && strcmp(name, "auto") != 0 && strcmp(name, KERNEL[i].name) != 0)
+			continue;
+		if ((*KERNEL[i].supported)()) {
+			_kernel = i;
+			return KERNEL[i].name;
+		}
+		if (name && strcmp(name, "auto") != 0) break;
+	}
+	return NULL;
+}
+
+/***********************************************************************/
+
+static int _level_init(level_t *lv, unsigned long n){
+	/* allocates the arrays of lv for n branches in one block */
+
+	lv->mem = malloc(n * (2 * sizeof(float) + 2 * sizeof(double)
+			      + sizeof(unsigned long)));
+	if (lv->mem == NULL) {
+		fprintf(stderr, " *** Not enough memory for %lu branches!\n", n);
+		return -1;
+	}
+	lv->c   = (double *)lv->mem;
+	lv->s   = lv->c + n;
+	lv->pos = (unsigned long *)(lv->s + n);
+	lv->x   = (float *)(lv->pos + n);
+	lv->y   = lv->x + n;
+
+	return 0;
+}
+
+/***********************************************************************/
+
+static level_t *_expand_levels(segbuf_t *sb, level_t *cur, level_t *nxt,
+			       unsigned long n, int j0, int j1, int keep,
+			       const shape_t *sh){
+	/* Expands the n branches of level j0-1 in cur level by level down to
+	 * level j1, with nxt as second scratch level, and stores the segments
+	 * of levels j0..j1 at their depth-first positions in sb: the left
+	 * child of the branch at pos follows it immediately, the right one
+	 * after the left one's subtree of S[j] segments.
+	 * Only if keep, the directions and positions of level j1 are stored.
+	 * Returns the scratch level holding level j1. */
+
+	expand_ft *expand = KERNEL[_kernel].expand;
+	level_t *t;
+	unsigned long i, p, q;
+	int j, last;
+
+	for (j = j0; j <= j1; j++) {
+		last = j == j1 && !keep;
+		(*expand)(n, cur->x, cur->y, cur->c, cur->s, sh->l[j], sh->rc, sh->rs,
+			  nxt->x, nxt->y, last ? NULL : nxt->c, last ? NULL : nxt->s);
+
+		/* scatter level j to its depth-first positions */
+		for (i = 0; i < n; i++) {
+			p = cur->pos[i] + 1;	q = p + sh->S[j];
+			sb->x0[p] = sb->x0[q] = cur->x[i];
+			sb->y0[p] = sb->y0[q] = cur->y[i];
+			sb->x1[p] = nxt->x[2*i];	sb->x1[q] = nxt->x[2*i+1];
+			sb->y1[p] = nxt->y[2*i];	sb->y1[q] = nxt->y[2*i+1];
+			sb->width[p] = sb->width[q] = sh->k[j];
+			sb->level[p] = sb->level[q] = j;
+			if (!last) { nxt->pos[2*i] = p;	nxt->pos[2*i+1] = q; }
+		}
+
+		t = cur;	cur = nxt;	nxt = t;
+		n *= 2;
+	}
+
+	return cur;
+}
+
+/***********************************************************************/
+
+static int _shape_init(shape_t *sh, const tree_param_t *tp){
+	/* computes the per level constants of the tree of tp,
+	 * multiplied like the recursion did, and the subtree sizes
+	 * after LOD pruning */
+
+	int j, D = tp->depth > 0 ? tp->depth : 0;
+
+	sh->mem = malloc((D + 1) * (sizeof(*sh->l) + sizeof(*sh->S) + sizeof(*sh->k)));
+	if (sh->mem == NULL) {
+		fprintf(stderr, " *** Not enough memory for tree levels!\n");
+		return -1;
+	}
+	sh->D = _lod(tp, &sh->stublen, &sh->stubk);
+	sh->stub = tp->stub && sh->D < D;
+	sh->rc = cos(tp->step);
+	sh->rs = sin(tp->step);
+	sh->l = (double *)sh->mem;
+	sh->S = (unsigned long *)(sh->l + D + 1);
+	sh->k = (int *)(sh->S + D + 1);
+
+	for (j = 0; j <= D; j++) {
+		sh->l[j] = j ? sh->l[j-1]*0.75 : tp->len*(double)(float)0.75;
+		sh->k[j] = j ? sh->k[j-1]*0.75 : tp->width;
+	}
+	for (j = sh->D; j >= 0; j--)
+		sh->S[j] = j < sh->D ? 2*sh->S[j+1] + 1 : 1 + sh->stub;
+
+	return 0;
+}
+
+/***********************************************************************/
+
+static int _scratch_init(scratch_t *sc, const shape_t *sh, int j0){
+	/* allocates the scratch levels of _expand_tree() for subtrees
+	 * of levels j0..D */
+
+	int h = sh->D + 1 - j0;		/* height of subtrees */
+	int T = h > BFS_HEIGHT ? h - BFS_HEIGHT : 0;
 
+	sc->top[0].mem = sc->top[1].mem = sc->sub[0].mem = sc->sub[1].mem = NULL;
+	if (_level_init(&sc->top[0], 1UL << T) || _level_init(&sc->top[1], 1UL << T) ||
+	    _level_init(&sc->sub[0], 1UL << (h - T)) || _level_init(&sc->sub[1], 1UL << (h - T))) {
+		_scratch_free(sc);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void _scratch_free(scratch_t *sc){
+	free(sc->top[0].mem);	free(sc->top[1].mem);
+	free(sc->sub[0].mem);	free(sc->sub[1].mem);
+	sc->top[0].mem = sc->top[1].mem = sc->sub[0].mem = sc->sub[1].mem = NULL;
+}
+
+/***********************************************************************/
+
+static void _copy_branch(level_t *dst, unsigned long d,
+			 const level_t *src, unsigned long s){
+	dst->x[d] = src->x[s];		dst->y[d] = src->y[s];
+	dst->c[d] = src->c[s];		dst->s[d] = src->s[s];
+	dst->pos[d] = src->pos[s];
 }
 
+static void _stubs(segbuf_t *sb, const level_t *lv, unsigned long n,
+		   const shape_t *sh){
+	/* stores the stubs ending the n branches of level D in lv */
+
+	unsigned long i, p;
+
+	for (i = 0; i < n; i++) {
+		p = lv->pos[i] + 1;
+		sb->x0[p] = lv->x[i];
+		sb->y0[p] = lv->y[i];
+		sb->x1[p] = lv->x[i]-(lv->c[i]*sh->stublen);
+		sb->y1[p] = lv->y[i]+(lv->s[i]*sh->stublen);
+		sb->width[p] = sh->stubk;
+		sb->level[p] = sh->D + 1;
+	}
+}
+
+static void _expand_tree(segbuf_t *sb, const level_t *root, unsigned long r,
+			 int j0, const shape_t *sh, scratch_t *sc){
+	/* Expands the subtree below branch r of root, of level j0-1, through
+	 * levels j0..D into sb: the top T levels first, then each of their
+	 * branches as root of a subtree of BFS_HEIGHT levels, which keeps
+	 * the scratch levels small. */
+
+	const int h = sh->D + 1 - j0;
+	const int T = h > BFS_HEIGHT ? h - BFS_HEIGHT : 0;
+	level_t *lv = &sc->top[0];
+	unsigned long i;
+
+	_copy_branch(lv, 0, root, r);
+	if (T > 0)
+		lv = _expand_levels(sb, &sc->top[0], &sc->top[1], 1, j0, j0 + T - 1, 1, sh);
+	for (i = 0; i < 1UL << T; i++) {
+		_copy_branch(&sc->sub[0], 0, lv, i);
+		if (sh->stub)
+			_stubs(sb, _expand_levels(sb, &sc->sub[0], &sc->sub[1], 1,
+						  j0 + T, sh->D, 1, sh),
+			       1UL << (h - T), sh);
+		else
+			_expand_levels(sb, &sc->sub[0], &sc->sub[1], 1, j0 + T, sh->D, 0, sh);
+	}
+}
+
+/***********************************************************************/
+
+static void _trunk(segbuf_t *sb, level_t *lv, const tree_param_t *tp){
+	/* stores the trunk into sb and as branch 0 into lv */
+
+	sb->x0[0] = tp->psz/2.;	sb->y0[0] = 1.;
+	sb->x1[0] = tp->psz/2.;	sb->y1[0] = tp->len;
+	sb->width[0] = tp->width;	sb->level[0] = 0;
 
+	lv->x[0] = sb->x1[0];	lv->y[0] = sb->y1[0];
+	lv->c[0] = cos(1.53938);	lv->s[0] = sin(1.53938);
+	lv->pos[0] = 0;
+}
+
+/***********************************************************************/
+
+static workpool_t _pool = NULL;	/* pool of tree_generate(), NULL: none */
+static int _split = 0;		/* level of roots of parallel subtrees */
+
+int tree_threads  (int nthreads, int split){
+	/* Makes tree_generate() generate the subtrees below the branches of
+	 * level split in parallel on nthreads threads (the caller's included),
+	 * if the tree is deeper than that. With split <= 0, the level is
+	 * chosen to give about 8 subtrees per thread for load balance.
+	 * nthreads <= 1 switches back to a single thread.
+	 * Not thread-safe, to be called before generating trees.
+	 * Returns 0 on success, -1 if the threads can't be started. */
+
+	workpool_destroy(_pool);
+	_pool = NULL;
+	if (nthreads > 1 && (_pool = workpool_create(nthreads - 1)) == NULL)
+		return -1;
+
+	if (split <= 0)
+		for (split = 0; 2UL << split < 8UL * (nthreads > 1 ? nthreads : 1); split++)
+			;
+	_split = split;
+
+	return 0;
+}
+
+/***********************************************************************/
+
+/* subtree generation of tree_generate(), shared by all tasks */
+typedef struct {
+	segbuf_t *sb;		/* segment buffer of whole tree */
+	const level_t *roots;	/* roots of subtrees */
+	const shape_t *sh;
+	int j0;			/* first level below roots */
+	struct {
+		segbuf_t buf;	/* segments of a subtree */
+		scratch_t sc;
+		int err;
+	} *w;			/* per worker */
+} subtrees_t;
+
+typedef struct {
+	subtrees_t *st;
+	unsigned long r;	/* index of root */
+} subtask_t;
+
+static void _subtree_task(void *arg, int worker){
+	/* task generating the subtree of a root into the worker's own
+	 * buffer, which is then copied into its depth-first place */
+
+	subtask_t *t = (subtask_t *)arg;
+	subtrees_t *st = t->st;
+	segbuf_t *wb = &st->w[worker].buf, *sb = st->sb;
+	const unsigned long n = 2 * st->sh->S[st->j0];
+	unsigned long pos = st->roots->pos[t->r], none;
+	float x, y;
+	double c, s;
+	level_t root = { &x, &y, &c, &s, &none, NULL };
+
+	if (st->w[worker].err) return;	/* out of memory before */
+	if (wb->mem == NULL || st->w[worker].sc.top[0].mem == NULL) {
+		if ((wb->mem == NULL && segbuf_init(wb, n) != 0) ||
+		    _scratch_init(&st->w[worker].sc, st->sh, st->j0) != 0) {
+			st->w[worker].err = 1;
+			return;
+		}
+	}
+
+	/* the root at position -1 of the worker's buffer */
+	_copy_branch(&root, 0, st->roots, t->r);
+	none = (unsigned long)-1;	/* children at 0 and S[j0] */
+	_expand_tree(wb, &root, 0, st->j0, st->sh, &st->w[worker].sc);
+
+	memcpy(sb->x0 + pos + 1, wb->x0, n * sizeof(*wb->x0));
+	memcpy(sb->y0 + pos + 1, wb->y0, n * sizeof(*wb->y0));
+	memcpy(sb->x1 + pos + 1, wb->x1, n * sizeof(*wb->x1));
+	memcpy(sb->y1 + pos + 1, wb->y1, n * sizeof(*wb->y1));
+	memcpy(sb->width + pos + 1, wb->width, n * sizeof(*wb->width));
+	memcpy(sb->level + pos + 1, wb->level, n * sizeof(*wb->level));
+}
+
+/***********************************************************************/
+
+static int _generate_mt(segbuf_t *sb, const shape_t *sh, const tree_param_t *tp){
+	/* Generates the tree on the threads of _pool: the levels 0.._split
+	 * here, then the subtrees below them as tasks of the pool, each
+	 * into its worker's own buffer first. */
+
+	const int nw = workpool_size(_pool);
+	const unsigned long nr = 2UL << _split;	/* number of subtrees */
+	level_t top[2], *lv;
+	subtrees_t st;
+	subtask_t *task;
+	unsigned long r;
+	int i, ret = -1;
+
+	top[0].mem = top[1].mem = NULL;
+	st.w = calloc(nw, sizeof(*st.w));
+	task = (subtask_t *) malloc(nr * sizeof(*task));
+	if (!st.w || !task || _level_init(&top[0], nr) || _level_init(&top[1], nr))
+		goto out;
+
+	_trunk(sb, &top[0], tp);
+	lv = _expand_levels(sb, &top[0], &top[1], 1, 0, _split, 1, sh);
+
+	st.sb = sb;	st.roots = lv;	st.sh = sh;	st.j0 = _split + 1;
+	for (r = 0; r < nr; r++) {
+		task[r].st = &st;
+		task[r].r = r;
+	}
+	workpool_run(_pool, &_subtree_task, task, sizeof(*task), nr);
+
+	ret = 0;
+	for (i = 0; i < nw; i++) {
+		if (st.w[i].err) {
+			fprintf(stderr, " *** Not enough memory for subtree!\n");
+			ret = -1;
+		}
+		segbuf_free(&st.w[i].buf);
+		_scratch_free(&st.w[i].sc);
+	}
+
+out:
+	if (ret != 0 && (!st.w || !task))
+		fprintf(stderr, " *** Not enough memory for subtree tasks!\n");
+	free(top[0].mem);	free(top[1].mem);
+	free(task);
+	free(st.w);
+	return ret;
+}
+
+/***********************************************************************/
+
+int tree_generate  (segbuf_t *sb, const tree_param_t *tp){
+	/* Generates the segments of the tree of tp into sb, exactly
+	 * those of tree_generate_dfs() in the same order, but level by level:
+	 * each level is a pure map of its parents to twice as many children,
+	 * expanded by the SIMD kernel selected by tree_simd().
+	 * If set up by tree_threads(), the subtrees are generated in parallel,
+	 * still into the same positions, so the result doesn't differ.
+	 * Below the level kept by LOD pruning, see tree_param_t, the branches
+	 * end in a stub each, if tp->stub, else without children; sb->pruned
+	 * counts the segments left out.
+	 * Returns 0 on success, -1 if sb is too small or out of memory. */
+
+	shape_t sh;
+	scratch_t sc;
+	level_t *root;
+	int ret = -1;
+
+	if (sb->cap < tree_numsegs(tp->depth)) {
+		fprintf(stderr, " *** Segment buffer too small for tree!\n");
+		return -1;
+	}
+	pthread_once(&_kernel_once, &_kernel_auto);
+	if (_shape_init(&sh, tp) != 0) return -1;
+
+	if (_pool != NULL && sh.D > _split) {
+		ret = _generate_mt(sb, &sh, tp);
+	} else if (_scratch_init(&sc, &sh, 0) == 0) {
+		/* the trunk is the root of it all */
+		root = &sc.sub[1];
+		_trunk(sb, root, tp);
+		_expand_tree(sb, root, 0, 0, &sh, &sc);
+		_scratch_free(&sc);
+		ret = 0;
+	}
+	if (ret == 0) {
+		sb->n = sh.D >= 0 ? 1 + 2*sh.S[0] : 1 + sh.stub;
+		sb->pruned = tree_numsegs(tp->depth) - (sh.D >= 0 ? tree_numsegs(sh.D) : 1);
+	}
+
+	free(sh.mem);
+	return ret;
+}
+
+/***********************************************************************/
+
+void tree_emit  (const segbuf_t *sb, CPLT_gc_t gc){
+	/* Draws the segments of sb to gc in buffer order. Like the recursion,
+	 * the color of a segment's level is set after drawing it, so each
+	 * segment is drawn in the color of its predecessor, only the trunk
+	 * sets its color beforehand. */
+
+	CPLT_point_t seg[2];
+	unsigned long i;
+
+	if (sb->n > 0) color(gc, 0., 0., 0., sb->level[0]);
+	for (i = 0; i < sb->n; i++) {
+		seg[0].x = sb->x0[i];	seg[0].y = sb->y0[i];
+		seg[1].x = sb->x1[i];	seg[1].y = sb->y1[i];
+
+		CPLT_set_linewidth(gc, sb->width[i]);
+		CPLT_draw_polyline(gc, 2, seg);
+		if (i > 0) color(gc, 0., 0., 0., sb->level[i]);
+	}
+}
+
+/***********************************************************************/
+
+static unsigned long *_group_order(const segbuf_t *sb){
+	/* returns the indices of sb's segments sorted by group (level, color
+	 * level) for tree_emit_grouped(), malloc'ed, or NULL if out of memory */
+
+	unsigned long *first, *order, i, g, L = 0;
+
+	for (i = 0; i < sb->n; i++)
+		if (sb->level[i] >= L) L = sb->level[i] + 1;
+
+	/* counting sort by group (level, color level) */
+	first = (unsigned long *) calloc(L * L + 1, sizeof(*first));
+	order = (unsigned long *) malloc(sb->n * sizeof(*order));
+	if (!first || !order) {
+		fprintf(stderr, " *** Not enough memory for segment groups!\n");
+		free(first);	free(order);
+		return NULL;
+	}
+	for (i = 0; i < sb->n; i++)
+		first[sb->level[i] * L + sb->level[i > 0 ? i-1 : 0] + 1]++;
+	for (g = 1; g <= L * L; g++) first[g] += first[g-1];
+	for (i = 0; i < sb->n; i++)
+		order[first[sb->level[i] * L + sb->level[i > 0 ? i-1 : 0]]++] = i;
+
+	free(first);
+	return order;
+}
 
+/***********************************************************************/
 
+int tree_emit_grouped  (const segbuf_t *sb, CPLT_gc_t gc){
+	/* Draws the segments of sb to gc like tree_emit(), in the same color
+	 * and linewidth each, but grouped by this state: level by level from
+	 * the trunk up, within a level by color, with one state change per
+	 * group instead of two per segment. The color of a segment is that
+	 * of its predecessor's level, i.e. of its parent's for a left child,
+	 * of the deepest level for a right one, so each level has two groups.
+	 * Returns 0 on success, -1 if out of memory. */
+
+	CPLT_point_t seg[2];
+	unsigned long *order, i, g;
+	long col = -1;
+	float lw = -1.;
+
+	if ((order = _group_order(sb)) == NULL) return -1;
+
+	for (g = 0; g < sb->n; g++) {
+		i = order[g];
+		if (sb->level[i > 0 ? i-1 : 0] != col) {
+			col = sb->level[i > 0 ? i-1 : 0];
+			color(gc, 0., 0., 0., col);
+		}
+		if (sb->width[i] != lw) {
+			lw = sb->width[i];
+			CPLT_set_linewidth(gc, lw);
+		}
+		seg[0].x = sb->x0[i];	seg[0].y = sb->y0[i];
+		seg[1].x = sb->x1[i];	seg[1].y = sb->y1[i];
+		CPLT_draw_polyline(gc, 2, seg);
+	}
+
+	free(order);
+	return 0;
+}
+
+/***********************************************************************/
+
+#define BATCH 4096	/* segments per CPLT_draw_segments() call */
+
+int tree_emit_batched  (const segbuf_t *sb, CPLT_gc_t gc, int grouped){
+	/* Draws the segments of sb to gc like tree_emit(), or if grouped in
+	 * the order of tree_emit_grouped(), in the same color and linewidth
+	 * each, but handed over in batches to CPLT_draw_segments(), which
+	 * changes the state only between segments that differ in it.
+	 * Returns 0 on success, -1 if out of memory. */
+
+	CPLT_point_t *seg;
+	float *lw, (*rgb)[3];
+	unsigned long *order = NULL, i, g;
+	int m;
+
+	if (grouped && (order = _group_order(sb)) == NULL) return -1;
+	seg = (CPLT_point_t *) malloc(2 * BATCH * sizeof(*seg));
+	lw  = (float *) malloc(BATCH * sizeof(*lw));
+	rgb = (float (*)[3]) malloc(BATCH * sizeof(*rgb));
+	if (!seg || !lw || !rgb) {
+		fprintf(stderr, " *** Not enough memory for segment batch!\n");
+		free(seg);	free(lw);	free(rgb);	free(order);
+		return -1;
+	}
+
+	for (g = 0; g < sb->n; g += m) {
+		for (m = 0; m < BATCH && g + m < sb->n; m++) {
+			i = order ? order[g + m] : g + m;
+			seg[2*m].x   = sb->x0[i];	seg[2*m].y   = sb->y0[i];
+			seg[2*m+1].x = sb->x1[i];	seg[2*m+1].y = sb->y1[i];
+			lw[m] = sb->width[i];
+			color_rgb(sb->level[i > 0 ? i-1 : 0], rgb[m]);
+		}
+		CPLT_draw_segments(gc, m, seg, lw, rgb);
+	}
+
+	free(seg);	free(lw);	free(rgb);	free(order);
+	return 0;
+}
+
+/***********************************************************************/
+
+static void _draw_trunk(const tree_param_t *tp, CPLT_gc_t gc){
+	/* draws the trunk of tp's tree, as tree_emit() */
+
+	CPLT_point_t seg[2];
+
+	color(gc, 0., 0., 0., 0);
+	CPLT_set_linewidth(gc, tp->width);
+	seg[0].x = tp->psz/2.;	seg[0].y = 1.;
+	seg[1].x = tp->psz/2.;	seg[1].y = tp->len;
+	CPLT_draw_polyline(gc, 2, seg);
+}
+
+/***********************************************************************/
+
+static int _branching(const tree_param_t *tp, CPLT_gc_t gc, int keep){
+	/* Draws the trunk of tp's tree and the levels up to keep above it by
+	 * CPLT_draw_branching(), with the linewidths and colors of
+	 * tree_emit(). Returns 0, or -1 if the graphics format has no
+	 * branching or out of memory, then nothing is drawn. */
+
+	const double deg = 180./M_PI;
+	float *widths, (*colors)[2][3];
+	int j, k = tp->width, ret = -1;
+
+	widths = (float *) malloc((keep + 1) * sizeof(*widths));
+	colors = (float (*)[2][3]) malloc((keep + 1) * sizeof(*colors));
+	if (!widths || !colors)
+		fprintf(stderr, " *** Not enough memory for tree levels!\n");
+	else if (CPLT_draw_branching(gc, 0., 0., 0., 0., 0., 0., -1,
+				       NULL, NULL) == 0) {
+		for (j = 0; j <= keep; j++, k = k*0.75) {
+			widths[j] = k;
+			color_rgb(j > 0 ? j-1 : 0, colors[j][0]);
+			color_rgb(keep, colors[j][1]);
+		}
+		_draw_trunk(tp, gc);
+		ret = CPLT_draw_branching(gc, tp->psz/2., tp->len,
+					  180. - 1.53938*deg,
+					  tp->len*(double)(float)0.75,
+					  tp->step*deg, 0.75, keep, widths,
+					  (const float (*)[2][3]) colors);
+	}
+	free(widths);
+	free(colors);
+
+	return ret;
+}
+
+/***********************************************************************/
+
+int tree_emit_instanced  (const tree_param_t *tp, CPLT_gc_t gc){
+	/* Draws the tree of tp to gc by the self-similarity of its levels,
+	 * so the plotfile only grows with the depth, not with the number of
+	 * segments: as a recursive branching if the graphics format has it
+	 * and LOD pruning leaves no stubs, else as one symbol per level j:
+	 * the pair of branches at the tip of their parent, the symbol's
+	 * reference point, turned by +-step from the parent's direction, its
+	 * x-axis, each placing the symbol of level j+1 at its tip. The stubs
+	 * are the symbol below the kept levels. Order, colors and linewidths
+	 * are those of tree_emit(): a left branch has the color of its
+	 * parent's level, a right one that of the deepest level, as its
+	 * predecessor is the last leaf, or stub, of its left sibling's
+	 * subtree.
+	 * Returns 0 on success, -1 if the graphics format has neither or
+	 * out of memory, then nothing is drawn. */
+
+	const int D = tp->depth > 0 ? tp->depth : 0;
+	const double rc = cos(tp->step), rs = sin(tp->step);
+	const double deg = 180./M_PI;
+	CPLT_point_t seg[2];
+	double stublen, *l;
+	int j, side, stubk, *k;
+	const int keep = _lod(tp, &stublen, &stubk);
+	const int last = keep + (tp->stub && keep < D);	/* deepest symbol */
+
+	if (last == keep && keep >= 0 && _branching(tp, gc, keep) == 0)
+		return 0;
+
+	/* lengths and linewidths of the levels, as in tree_generate_dfs() */
+	l = (double *) malloc((D + 1) * sizeof(*l));
+	k = (int *) malloc((D + 1) * sizeof(*k));
+	if (!l || !k) {
+		fprintf(stderr, " *** Not enough memory for tree levels!\n");
+		free(l);	free(k);
+		return -1;
+	}
+	l[0] = tp->len*(double)(float)0.75;	k[0] = tp->width;
+	for (j = 1; j <= D; j++) {
+		l[j] = l[j-1]*0.75;	k[j] = k[j-1]*0.75;
+	}
+
+	/* from the deepest level up, each symbol places the one below */
+	for (j = last; j >= 0; j--) {
+		if (CPLT_define_symbol(gc, j) != 0) {
+			free(l);	free(k);
+			return -1;
+		}
+		seg[0].x = 0.;	seg[0].y = 0.;
+		if (j > keep) {		/* stub, after the pruned branch */
+			color(gc, 0., 0., 0., keep > 0 ? keep : 0);
+			CPLT_set_linewidth(gc, stubk);
+			seg[1].x = stublen;	seg[1].y = 0.;
+			CPLT_draw_polyline(gc, 2, seg);
+		} else for (side = 1; side >= -1; side -= 2) {	/* left, right */
+			color(gc, 0., 0., 0., side > 0 ? (j > 0 ? j-1 : 0) : last);
+			CPLT_set_linewidth(gc, k[j]);
+			seg[1].x = l[j]*rc;	seg[1].y = side*l[j]*rs;
+			CPLT_draw_polyline(gc, 2, seg);
+			if (j < last)
+				CPLT_place_symbol(gc, j+1, seg[1].x, seg[1].y, 1.,
+						  side*tp->step*deg);
+		}
+		CPLT_end_symbol(gc);
+	}
+	free(l);
+	free(k);
+
+	/* trunk, the first level's symbol at its tip */
+	_draw_trunk(tp, gc);
+	if (last >= 0)
+		CPLT_place_symbol(gc, 0, tp->psz/2., tp->len, 1.,
+				  180. - 1.53938*deg);
+
+	return 0;
+}
+
+/***********************************************************************/
+
+static void _transformed(CPLT_gc_t gc, int j, int keep, int last,
+			 const double *l, const int *k, double rc, double rs,
+			 double stublen, int stubk){
+	/* Draws level j and the ones below it in the local coordinates of
+	 * their parent, as tree_emit_transformed() */
+
+	CPLT_point_t seg[2];
+	int side;
+
+	seg[0].x = 0.;	seg[0].y = 0.;
+	if (j > keep) {		/* stub, after the pruned branch */
+		color(gc, 0., 0., 0., keep > 0 ? keep : 0);
+		CPLT_set_linewidth(gc, stubk);
+		seg[1].x = stublen;	seg[1].y = 0.;
+		CPLT_draw_polyline(gc, 2, seg);
+		return;
+	}
+	for (side = 1; side >= -1; side -= 2) {		/* left, right */
+		color(gc, 0., 0., 0., side > 0 ? (j > 0 ? j-1 : 0) : last);
+		CPLT_set_linewidth(gc, k[j]);
+		seg[1].x = l[j]*rc;	seg[1].y = side*l[j]*rs;
+		CPLT_draw_polyline(gc, 2, seg);
+		if (j < last) {
+			CPLT_push_transform(gc);
+			CPLT_concat_matrix(gc, rc, side*rs, -side*rs, rc,
+					   seg[1].x, seg[1].y);
+			_transformed(gc, j+1, keep, last, l, k, rc, rs,
+				     stublen, stubk);
+			CPLT_pop_transform(gc);
+		}
+	}
+}
+
+/***********************************************************************/
+
+int tree_emit_transformed  (const tree_param_t *tp, CPLT_gc_t gc){
+	/* Draws the tree of tp to gc with each pair of branches in the
+	 * local coordinates of its parent: its tip the origin, its
+	 * direction the x-axis, set by CPLT_concat_matrix() between
+	 * CPLT_push_transform() and CPLT_pop_transform(). So every branch
+	 * of a level has the same coordinates, the graphics format or the
+	 * recording maps them. Order, colors, linewidths and stubs are
+	 * those of tree_emit_instanced().
+	 * Returns 0 on success, -1 if out of memory, then nothing is
+	 * drawn. */
+
+	const int D = tp->depth > 0 ? tp->depth : 0;
+	const double rc = cos(tp->step), rs = sin(tp->step);
+	const double turn = M_PI - 1.53938;	/* of the first level */
+	double stublen, *l;
+	int j, stubk, *k;
+	const int keep = _lod(tp, &stublen, &stubk);
+	const int last = keep + (tp->stub && keep < D);	/* deepest level */
+
+	/* lengths and linewidths of the levels, as in tree_generate_dfs() */
+	l = (double *) malloc((D + 1) * sizeof(*l));
+	k = (int *) malloc((D + 1) * sizeof(*k));
+	if (!l || !k) {
+		fprintf(stderr, " *** Not enough memory for tree levels!\n");
+		free(l);	free(k);
+		return -1;
+	}
+	l[0] = tp->len*(double)(float)0.75;	k[0] = tp->width;
+	for (j = 1; j <= D; j++) {
+		l[j] = l[j-1]*0.75;	k[j] = k[j-1]*0.75;
+	}
+
+	/* trunk, the first level at its tip */
+	_draw_trunk(tp, gc);
+	if (last >= 0) {
+		CPLT_push_transform(gc);
+		CPLT_concat_matrix(gc, cos(turn), sin(turn), -sin(turn),
+				   cos(turn), tp->psz/2., tp->len);
+		_transformed(gc, 0, keep, last, l, k, rc, rs, stublen, stubk);
+		CPLT_pop_transform(gc);
+	}
+	free(l);
+	free(k);
+
+	return 0;
+}
+
+/***********************************************************************/
+
+int segbuf_init  (segbuf_t *sb, unsigned long cap){
+	/* Allocates the arrays of sb for cap segments in one contiguous block,
+	 * each array aligned to 32 bytes. Returns 0 on success, -1 else. */
+
+	unsigned long c = (cap + 7) & ~7UL;	/* multiple of 8 floats */
+	char *mem;
+
+	mem = (char *) malloc(c * (5 * sizeof(float) + sizeof(unsigned char)) + 32);
+	if (mem == NULL) {
+		fprintf(stderr, " *** Not enough memory for %lu segments!\n", cap);
+		sb->mem = NULL;
+		sb->n = sb->cap = 0;
+		return -1;
+	}
+	sb->mem = mem;
+	mem += (32 - (unsigned long)mem % 32) % 32;
+	sb->x0    = (float *)mem;	mem += c * sizeof(float);
+	sb->y0    = (float *)mem;	mem += c * sizeof(float);
+	sb->x1    = (float *)mem;	mem += c * sizeof(float);
+	sb->y1    = (float *)mem;	mem += c * sizeof(float);
+	sb->width = (float *)mem;	mem += c * sizeof(float);
+	sb->level = (unsigned char *)mem;
+	sb->n = sb->pruned = 0;
+	sb->cap = cap;
+
+	return 0;
+}
+
+/***********************************************************************/
+
+void segbuf_free  (segbuf_t *sb){
+	/* Frees the arrays of sb */
+
+	free(sb->mem);
+	sb->mem = NULL;
+	sb->n = sb->cap = 0;
+}
+
+/***********************************************************************/
+
+unsigned long tree_numsegs  (int wied){
+	/* number of segments plotted by ploterplotfirst(), including trunk */
+
+	return (2UL << ((wied > 0 ? wied : 0) + 1)) - 1;
+}
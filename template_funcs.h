@@ -9,9 +9,65 @@
 #include "CPlotter.h"
 #include <math.h>
 
+/* structure-of-arrays buffer of the tree's segments, filled by
+ * tree_generate() and drawn by tree_emit() */
+typedef struct {
+	float *x0, *y0;		/* start points of segments [pix] */
+	float *x1, *y1;		/* end points of segments [pix] */
+	float *width;		/* linewidths of segments [pix] */
+	unsigned char *level;	/* depth levels j of segments */
+	unsigned long n;	/* number of segments in buffer */
+	unsigned long cap;	/* capacity of buffer [segments] */
+	unsigned long pruned;	/* number of segments left out by LOD */
+	void *mem;		/* memory block of all arrays */
+} segbuf_t;
+
+/* parameters of a tree, see tree_param_init() for the defaults */
+typedef struct {
+	unsigned int psz;	/* size [pix] of square plot area */
+	int depth;		/* depth, number of branchings below first */
+	double len;		/* length [pix] of trunk, starting at 1 pix */
+	int width;		/* linewidth [pix] of trunk */
+	double step;		/* angle step [rad] of each branching */
+	/* LOD pruning: the levels of branches shorter than min_len or thinner
+	 * than min_width [pix] are left out, with their subtrees */
+	double min_len, min_width;
+	int stub;		/* if pruned subtrees are replaced by a stub */
+	int grouped;		/* if emitted grouped by color and linewidth */
+	int instanced;		/* if emitted as one symbol per level */
+	int transformed;	/* if emitted in local coordinates by transforms */
+	int batched;		/* if emitted by batched segment calls */
+} tree_param_t;
+
 /* prototypes of own functions */
 void ploterplotfirst  (int wied,const unsigned int PSZ, CPLT_gc_t gc);
+void tree_param_init  (tree_param_t *tp, int wied, const unsigned int PSZ);
+int  tree_render  (const tree_param_t *tp, CPLT_gc_t gc, unsigned long *pruned);
+int  tree_generate  (segbuf_t *sb, const tree_param_t *tp);
+int  tree_generate_dfs  (segbuf_t *sb, const tree_param_t *tp);
+const char *tree_simd  (const char *name);
+int  tree_threads  (int nthreads, int split);
+void tree_emit  (const segbuf_t *sb, CPLT_gc_t gc);
+int  tree_emit_grouped  (const segbuf_t *sb, CPLT_gc_t gc);
+int  tree_emit_batched  (const segbuf_t *sb, CPLT_gc_t gc, int grouped);
+int  tree_emit_instanced  (const tree_param_t *tp, CPLT_gc_t gc);
+int  tree_emit_transformed  (const tree_param_t *tp, CPLT_gc_t gc);
+int  segbuf_init  (segbuf_t *sb, unsigned long cap);
+void segbuf_free  (segbuf_t *sb);
+unsigned long tree_numsegs  (int wied);
 //void dicke  (int wied,int *a);
-/* TODO */
+
+/* recursive reference implementation of ploterplotfirst(),
+ * kept for regression tests and benchmarks */
+void ploterplotfirst_rec  (int wied,const unsigned int PSZ, CPLT_gc_t gc);
+int  tree_generate_libm  (segbuf_t *sb, const tree_param_t *tp);
+void plotleft( double l,int wied,  const unsigned int PSZ,CPLT_point_t *points, int j,CPLT_gc_t gc,double windif,const float fac_l,int *a,int k,
+	double R,double G,double B);
+void plotright( double l,int wied,  const unsigned int PSZ,CPLT_point_t *points, int j,CPLT_gc_t gc,double windif,const float fac_l,int *a,int k,
+	double R,double G,double B);
+void color(CPLT_gc_t gc,double R,double G,double B,int j);
+void color_rgb(int j, float rgb[3]);
+void winkell  (double *windif);
+void winkelr  (double *windif);
 
 #endif
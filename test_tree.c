@@ -0,0 +1,1738 @@
+/***********************************************************************
+ * Regression tests of the tree generator of template_funcs.c:
+ * the plotfiles of ploterplotfirst() have to match those of the
+ * recursive reference ploterplotfirst_rec(), and the level-synchronous
+ * generator the depth-first one with every SIMD kernel and with
+ * the subtrees generated in parallel. LOD pruning must count what it
+ * leaves out, and its PNGs hardly differ from the unpruned ones.
+ * Grouped by state, the same paths must be stroked, and instanced by
+ * symbols or in local coordinates by transforms, the SVG must render
+ * the same lines, and the EPS of the recursive branching must not grow
+ * with the number of segments. The PNG's symbols, blended in as sprites,
+ * must hardly differ from drawing directly. Culled off the canvas, the
+ * PNG of a zoomed tree must stay the same.
+ * PNGs rendered on many threads at once must match the one rendered
+ * alone, "make tsan" runs these on threads under ThreadSanitizer.
+ * Written to memory, a callback or a file descriptor, the plots must
+ * be the same as the plotfiles. Drawing PNG must not malloc().
+ *
+ ***********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <gd.h>
+
+#include "CPlotter.h"
+#include "template_funcs.h"
+
+#define PSZ 600   /* size [pix] of square plot area */
+
+/* counts the calls of malloc() of the whole program, passing them on to
+ * glibc's, unless a sanitizer intercepts them */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && \
+    !defined(__SANITIZE_THREAD__)
+#define COUNT_MALLOC
+extern void *__libc_malloc(size_t size);
+static unsigned long nmalloc = 0;
+
+void *malloc(size_t size) {
+   __sync_add_and_fetch(&nmalloc, 1);
+   return __libc_malloc(size);
+}
+#endif
+
+typedef void tree_ft(int wied, const unsigned int psz, CPLT_gc_t gc);
+
+/***********************************************************************/
+
+void blank_date(char *buf) {
+   /* blanks the EPS creation date in the plot buf, as it differs
+    * between runs */
+
+   char *cp;
+
+   if ((cp = strstr(buf, "%%CreationDate: ")) != NULL)
+      while (*cp && *cp != '\n') *cp++ = ' ';
+}
+
+/***********************************************************************/
+
+char *read_plotfile(char *plotfilename, long *len) {
+   /* reads whole plotfile into malloc'ed buffer, the EPS creation date
+    * is blanked since it differs between runs */
+
+   FILE *fp;
+   char *buf;
+
+   if ((fp = fopen(plotfilename, "rb")) == NULL) return NULL;
+   fseek(fp, 0, SEEK_END);
+   *len = ftell(fp);
+   rewind(fp);
+   if ((buf = (char *)malloc(*len + 1)) == NULL) { fclose(fp); return NULL; }
+   *len = fread(buf, 1, *len, fp);
+   buf[*len] = '\0';
+   fclose(fp);
+   blank_date(buf);
+
+   return buf;
+}
+
+/***********************************************************************/
+
+char *render(tree_ft *tree, int wied, char *plotfilename, long *len) {
+   /* renders tree of depth wied into plotfilename, returns its content */
+
+   CPLT_gc_t gc;
+
+   if ((gc = CPLT_init_graphics(PSZ, PSZ, plotfilename)) == NULL) return NULL;
+   (*tree)(wied, PSZ, gc);
+   CPLT_finish_graphics(gc);
+
+   return read_plotfile(plotfilename, len);
+}
+
+/***********************************************************************/
+
+int test_same_as_recursion(char *suffix, int maxdepth) {
+   /* plotfiles of iterative and recursive generator must be identical */
+
+   char plotfilename[40];
+   char *ref, *out;
+   long lref, lout;
+   int wied, fails = 0;
+
+   sprintf(plotfilename, "test_tree.%s", suffix);
+   for (wied = 0; wied <= maxdepth; wied++) {
+      ref = render(&ploterplotfirst_rec, wied, plotfilename, &lref);
+      out = render(&ploterplotfirst, wied, plotfilename, &lout);
+      if (!ref || !out || lref != lout || memcmp(ref, out, lref) != 0) {
+         fprintf(stderr, " *** FAIL: %s, depth %d differs from recursion\n",
+                 suffix, wied);
+         fails++;
+      }
+      free(ref);
+      free(out);
+   }
+   remove(plotfilename);
+   printf("same segments as recursion, %s:%*s %s (depth 0-%d)\n", suffix,
+          (int)(12 - strlen(suffix)), "", fails ? "FAILED" : "ok", maxdepth);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+int test_rotation_error(int maxdepth, double tol) {
+   /* the points of the rotation kernel of tree_generate() must not drift
+    * more than tol [pix] from those of tree_generate_libm(), which calls
+    * cos()/sin() for every branch */
+
+   segbuf_t sb, ref;
+   tree_param_t tp;
+   unsigned long i;
+   double d, maxerr = 0.;
+   int fails = 0;
+
+   tree_param_init(&tp, maxdepth, PSZ);
+   if (segbuf_init(&sb, tree_numsegs(maxdepth)) != 0 ||
+       segbuf_init(&ref, tree_numsegs(maxdepth)) != 0) return 1;
+   tree_generate(&sb, &tp);
+   tree_generate_libm(&ref, &tp);
+
+   if (sb.n != ref.n) fails++;
+   for (i = 0; i < sb.n && !fails; i++) {
+      d = fabs(sb.x1[i] - ref.x1[i]);
+      if (d > maxerr) maxerr = d;
+      d = fabs(sb.y1[i] - ref.y1[i]);
+      if (d > maxerr) maxerr = d;
+   }
+   if (maxerr > tol) fails++;
+   segbuf_free(&sb);
+   segbuf_free(&ref);
+
+   printf("accumulated rotation error:               %s (depth %d, %.2g <= %g pix)\n",
+          fails ? "FAILED" : "ok", maxdepth, maxerr, tol);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+int same_segments(const segbuf_t *sb, const segbuf_t *ref) {
+   /* returns 1 if sb and ref hold bit for bit the same segments */
+
+   unsigned long n = sb->n;
+
+   return sb->n == ref->n &&
+          memcmp(sb->x0, ref->x0, n * sizeof(float)) == 0 &&
+          memcmp(sb->y0, ref->y0, n * sizeof(float)) == 0 &&
+          memcmp(sb->x1, ref->x1, n * sizeof(float)) == 0 &&
+          memcmp(sb->y1, ref->y1, n * sizeof(float)) == 0 &&
+          memcmp(sb->width, ref->width, n * sizeof(float)) == 0 &&
+          memcmp(sb->level, ref->level, n) == 0;
+}
+
+/***********************************************************************/
+
+int test_same_as_dfs(char *label, int maxdepth, const tree_param_t *base) {
+   /* the level-synchronous tree_generate() must produce bit for bit the
+    * segments of the depth-first tree_generate_dfs(), for the trees of
+    * depth 0..maxdepth with the other parameters of base, if not NULL */
+
+   segbuf_t sb, ref;
+   tree_param_t tp;
+   int wied, fails = 0;
+
+   if (base) tp = *base;
+   else tree_param_init(&tp, 0, PSZ);
+   if (segbuf_init(&sb, tree_numsegs(maxdepth)) != 0 ||
+       segbuf_init(&ref, tree_numsegs(maxdepth)) != 0) return 1;
+   for (wied = 0; wied <= maxdepth; wied++) {
+      sb.n = ref.n = 0;
+      tp.depth = wied;
+      if (tree_generate(&sb, &tp) != 0 ||
+          tree_generate_dfs(&ref, &tp) != 0 || !same_segments(&sb, &ref)) {
+         fprintf(stderr, " *** FAIL: %s, depth %d differs from depth-first\n",
+                 label, wied);
+         fails++;
+      }
+   }
+   segbuf_free(&sb);
+   segbuf_free(&ref);
+   printf("same segments as depth-first, %s:%*s %s (depth 0-%d)\n", label,
+          (int)(11 - strlen(label)), "", fails ? "FAILED" : "ok", maxdepth);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+int test_kernel(char *kernel, int maxdepth) {
+   /* each SIMD kernel must give the segments of tree_generate_dfs() */
+
+   int fails;
+
+   if (tree_simd(kernel) == NULL) {
+      printf("same segments as depth-first, %s:%*s skipped (no CPU support)\n",
+             kernel, (int)(11 - strlen(kernel)), "");
+      return 0;
+   }
+   fails = test_same_as_dfs(kernel, maxdepth, NULL);
+   tree_simd(NULL);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+int test_threads(int nthreads, int split, int maxdepth) {
+   /* the subtrees generated in parallel must be merged in depth-first
+    * order, i.e. give the same segments and plotfiles as one thread */
+
+   char label[40];
+   int fails;
+
+   if (tree_threads(nthreads, split) != 0) return 1;
+   sprintf(label, "%dx%d", nthreads, split);
+   fails = test_same_as_dfs(label, maxdepth, NULL);
+   fails += test_same_as_recursion("eps", 10);
+   fails += test_same_as_recursion("svg", 10);
+   tree_threads(1, 0);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+int test_params(int maxdepth) {
+   /* trees of other size, trunk and angle step than the template's,
+    * as rendered by the CLI, must be generated the same way */
+
+   tree_param_t tp;
+   int fails;
+
+   tree_param_init(&tp, 0, 2 * PSZ);
+   tp.len = 243.5;
+   tp.width = 33;
+   tp.step = 0.51;
+   fails = test_same_as_dfs("params", maxdepth, &tp);
+   if (tree_threads(3, 0) != 0) return fails + 1;
+   fails += test_same_as_dfs("params 3x0", maxdepth, &tp);
+   tree_threads(1, 0);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+int test_lod_count(int maxdepth) {
+   /* LOD pruning must leave out whole levels, with or without stubs,
+    * the same way in both generators, and count them */
+
+   tree_param_t tp;
+   segbuf_t sb;
+   int keep, fails = 0;
+
+   tree_param_init(&tp, maxdepth, PSZ);
+   tp.min_len = 1.;               /* levels 0..15 are longer */
+   if (segbuf_init(&sb, tree_numsegs(maxdepth)) != 0) return 1;
+   for (tp.stub = 0; tp.stub <= 1; tp.stub++) {
+      keep = maxdepth < 15 ? maxdepth : 15;
+      if (tree_generate(&sb, &tp) != 0 ||
+          sb.pruned != tree_numsegs(maxdepth) - tree_numsegs(keep) ||
+          sb.n != tree_numsegs(keep) + (tp.stub && keep < maxdepth ? 2UL << keep : 0))
+         fails++;
+   }
+   segbuf_free(&sb);
+
+   tp.min_len = 2.;
+   tp.min_width = 1.;
+   tp.stub = 1;
+   fails += test_same_as_dfs("lod stub", maxdepth, &tp);
+   tp.len = 1.;                   /* only the trunk is kept */
+   fails += test_same_as_dfs("lod trunk", maxdepth, &tp);
+   if (tree_threads(3, 2) != 0) return fails + 1;
+   tp.len = 119.;
+   fails += test_same_as_dfs("lod 3x2", maxdepth, &tp);
+   tree_threads(1, 0);
+
+   printf("pruned segments counted:                  %s (depth %d)\n",
+          fails ? "FAILED" : "ok", maxdepth);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+gdImagePtr read_png(char *plotfilename) {
+   /* reads the PNG plotfilename back and removes it */
+
+   gdImagePtr img;
+   FILE *fp;
+
+   if ((fp = fopen(plotfilename, "rb")) == NULL) return NULL;
+   img = gdImageCreateFromPng(fp);
+   fclose(fp);
+   remove(plotfilename);
+
+   return img;
+}
+
+gdImagePtr render_png(const tree_param_t *tp, char *plotfilename) {
+   /* renders the tree of tp into PNG plotfilename and reads it back */
+
+   CPLT_gc_t gc;
+
+   if ((gc = CPLT_init_graphics(tp->psz, tp->psz, plotfilename)) == NULL)
+      return NULL;
+   tree_render(tp, gc, NULL);
+   CPLT_finish_graphics(gc);
+
+   return read_png(plotfilename);
+}
+
+/***********************************************************************/
+
+int test_lod_image(int wied, double min_len, int stub, double tol) {
+   /* the PNG of the pruned tree must not differ from the unpruned one
+    * in more than the fraction tol of the tree's pixels */
+
+   tree_param_t tp;
+   gdImagePtr full, lod;
+   char label[64];
+   int x, y, cf, cl, ink = 0, diff = 0, fails = 0;
+
+   tree_param_init(&tp, wied, PSZ);
+   full = render_png(&tp, "test_tree_full.png");
+   tp.min_len = min_len;
+   tp.stub = stub;
+   lod = render_png(&tp, "test_tree_lod.png");
+   if (!full || !lod) return 1;
+
+   for (y = 0; y < tp.psz; y++)
+      for (x = 0; x < tp.psz; x++) {
+         cf = gdImageGetTrueColorPixel(full, x, y) & 0xFFFFFF;
+         cl = gdImageGetTrueColorPixel(lod, x, y) & 0xFFFFFF;
+         if (cf != 0xFFFFFF) ink++;
+         if (cf != cl) diff++;
+      }
+   gdImageDestroy(full);
+   gdImageDestroy(lod);
+   if (diff > tol * ink) fails++;
+
+   sprintf(label, "PNG pruned below %g pix%s:", min_len, stub ? ", stub" : "");
+   printf("%-41s %s (depth %d, %.2f%% <= %g%% pixels differ)\n", label,
+          fails ? "FAILED" : "ok", wied, 100. * diff / ink, 100. * tol);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+int cmp_str(const void *a, const void *b) {
+   return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+char **eps_strokes(char *buf, unsigned long *n, unsigned long *changes) {
+   /* splits the EPS plotfile buf into its strokes, each prefixed with
+    * the color and linewidth in effect, the segments stroked by SG
+    * rewritten as paths, returns them sorted and counts the color and
+    * linewidth settings in *changes */
+
+   char **strokes, *line, *col = "", *lw = "", *path = NULL;
+   char *saved[2] = {"", ""}, seg[4][16];
+   unsigned long max = 0;
+   int len = 0;
+
+   for (line = buf; *line; line++) max += *line == '\n';
+   if ((strokes = (char **)malloc((max + 1) * sizeof(char *))) == NULL)
+      return NULL;
+   *n = *changes = 0;
+   for (line = strtok(buf, "\n"); line; line = strtok(NULL, "\n")) {
+      if (strcmp(line, "n") == 0) path = line;
+      else if (strcmp(line, "g") == 0) {
+         saved[0] = col;
+         saved[1] = lw;
+      } else if (strcmp(line, "G") == 0) {
+         col = saved[0];
+         lw = saved[1];
+      } else if (sscanf(line, "%15s %15s %15s %15s SG%n",
+                        seg[0], seg[1], seg[2], seg[3], &len) == 4 &&
+                 line[len] == '\0') {
+         strokes[*n] = (char *)malloc(strlen(col) + strlen(lw) + 80);
+         if (strokes[*n] == NULL) break;
+         sprintf(strokes[(*n)++], "%s %s n %s %s m %s %s l", col, lw,
+                 seg[0], seg[1], seg[2], seg[3]);
+      } else if (path == NULL && strlen(line) > 2 &&
+               strcmp(line + strlen(line) - 2, " c") == 0) {
+         col = line;
+         ++*changes;
+      } else if (path == NULL && strlen(line) > 2 &&
+                 strcmp(line + strlen(line) - 2, " w") == 0) {
+         lw = line;
+         ++*changes;
+      } else if (path && strcmp(line, "s") == 0) {
+         /* rejoin the path's lines, preceded by color and linewidth */
+         for (line = path; line[1] != '\0' || line[2] != 's'; line++)
+            if (*line == '\0') *line = ' ';
+         strokes[*n] = (char *)malloc(strlen(col) + strlen(lw) + strlen(path) + 3);
+         if (strokes[*n] == NULL) break;
+         sprintf(strokes[(*n)++], "%s %s %s", col, lw, path);
+         path = NULL;
+      }
+   }
+   qsort(strokes, *n, sizeof(char *), &cmp_str);
+
+   return strokes;
+}
+
+/***********************************************************************/
+
+int test_grouped(int maxdepth, int grouped, int batched) {
+   /* grouped by state and/or batched, the EPS must stroke the same paths
+    * with the same color and linewidth as plain in depth-first order.
+    * Grouped it takes fewer changes; batched in depth-first order just as
+    * many as plain, whose redundant ones CPlotter drops, but for the two
+    * after each batch's restore of the state */
+
+   tree_param_t tp;
+   CPLT_gc_t gc;
+   char *buf[2], **strokes[2], label[64];
+   unsigned long i, n[2] = {0, 0}, changes[2] = {0, 0};
+   long len;
+   int g, wied, fails = 0;
+
+   for (wied = 0; wied <= maxdepth; wied++) {
+      tree_param_init(&tp, wied, PSZ);
+      for (g = 0; g <= 1; g++) {
+         tp.grouped = g ? grouped : 0;
+         tp.batched = g ? batched : 0;
+         strokes[g] = NULL;
+         buf[g] = NULL;
+         if ((gc = CPLT_init_graphics(PSZ, PSZ, "test_tree.eps")) == NULL)
+            continue;
+         tree_render(&tp, gc, NULL);
+         CPLT_finish_graphics(gc);
+         if ((buf[g] = read_plotfile("test_tree.eps", &len)) != NULL)
+            strokes[g] = eps_strokes(buf[g], &n[g], &changes[g]);
+      }
+      if (!strokes[0] || !strokes[1] || n[0] != n[1] ||
+          (wied > 1 && grouped && changes[1] >= changes[0]) ||
+          (!grouped && changes[1] > changes[0] + 2 * (n[1] / 4096 + 1)))
+         fails++;
+      for (i = 0; strokes[0] && strokes[1] && i < n[0] && i < n[1]; i++)
+         if (strcmp(strokes[0][i], strokes[1][i]) != 0) {
+            fprintf(stderr, " *** FAIL: grouped %d batched %d, depth %d "
+                    "strokes '%s'\n", grouped, batched, wied, strokes[1][i]);
+            fails++;
+            break;
+         }
+      for (g = 0; g <= 1; g++) {
+         for (i = 0; strokes[g] && i < n[g]; i++) free(strokes[g][i]);
+         free(strokes[g]);
+         free(buf[g]);
+      }
+   }
+   remove("test_tree.eps");
+   sprintf(label, "same strokes%s%s:", grouped ? " grouped by state" : "",
+           batched ? (grouped ? ", batched" : " batched") : "");
+   printf("%-41s %s (depth 0-%d, %lu instead of %lu changes)\n", label,
+          fails ? "FAILED" : "ok", maxdepth, changes[1], changes[0]);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+/* a <line> of a SVG plotfile, with its stroke color and width */
+typedef struct {
+   double x1, y1, x2, y2;
+   char stroke[8];
+   int width;
+} svgline_t;
+
+/* affine map of SVG's transform attribute: x' = a x + c y + e,
+ * y' = b x + d y + f */
+typedef struct { double a, b, c, d, e, f; } affine_t;
+
+affine_t affine_mul(affine_t m, affine_t t) {
+   /* returns m applied after t */
+
+   affine_t r;
+
+   r.a = m.a * t.a + m.c * t.b;   r.c = m.a * t.c + m.c * t.d;
+   r.b = m.b * t.a + m.d * t.b;   r.d = m.b * t.c + m.d * t.d;
+   r.e = m.a * t.e + m.c * t.f + m.e;
+   r.f = m.b * t.e + m.d * t.f + m.f;
+
+   return r;
+}
+
+affine_t svg_transform(const char *cp, affine_t m) {
+   /* returns m followed by the translate/rotate/scale/matrix list at cp */
+
+   affine_t t;
+   double u, v;
+   int len;
+
+   while (*cp && *cp != '"') {
+      t.a = t.d = 1.;  t.b = t.c = t.e = t.f = 0.;
+      if (sscanf(cp, " translate(%lf,%lf)%n", &u, &v, &len) == 2) {
+         t.e = u;  t.f = v;
+      } else if (sscanf(cp, " rotate(%lf)%n", &u, &len) == 1) {
+         t.a = t.d = cos(u * M_PI / 180.);
+         t.b = sin(u * M_PI / 180.);  t.c = -t.b;
+      } else if (sscanf(cp, " scale(%lf)%n", &u, &len) == 1) {
+         t.a = t.d = u;
+      } else if (sscanf(cp, " matrix(%lf,%lf,%lf,%lf,%lf,%lf)%n", &t.a, &t.b,
+                        &t.c, &t.d, &t.e, &t.f, &len) != 6) break;
+      m = affine_mul(m, t);
+      cp += len;
+   }
+
+   return m;
+}
+
+const char *svg_group_end(const char *el) {
+   /* returns the </g> closing the <g> at el, or NULL */
+
+   int depth = 0;
+
+   for (; (el = strchr(el, '<')) != NULL; el++)
+      if (strncmp(el, "<g ", 3) == 0 || strncmp(el, "<g>", 3) == 0) depth++;
+      else if (strncmp(el, "</g>", 4) == 0 && --depth == 0) return el;
+
+   return NULL;
+}
+
+int svg_lines(const char *svg, const char *cp, const char *end, affine_t m,
+              svgline_t *lines, int n, int max) {
+   /* appends the <line>s and the segments of unfilled <path>s rendered
+    * from cp to end of the SVG plotfile svg to lines[n..max-1], mapped by
+    * m, the <use>d symbols and transformed <g>s expanded, returns the new
+    * number of lines or -1 on error */
+
+   const char *el, *at;
+   char ref[40];
+   double x1, y1, x2, y2;
+   svgline_t *ln;
+   int len, width;
+
+   while (n >= 0 && (cp = strchr(cp, '<')) != NULL && cp < end) {
+      el = cp++;
+      if (strncmp(el, "<symbol", 7) == 0) {   /* defined, not rendered */
+         if ((cp = strstr(el, "</symbol>")) == NULL) return -1;
+      } else if (strncmp(el, "<line", 5) == 0) {
+         if (n >= max ||
+             sscanf(el, "<line x1=\"%lf\" y1=\"%lf\" x2=\"%lf\" y2=\"%lf\"",
+                    &x1, &y1, &x2, &y2) != 4 ||
+             (at = strstr(el, "stroke=\"#")) == NULL) return -1;
+         ln = &lines[n++];
+         ln->x1 = m.a * x1 + m.c * y1 + m.e;  ln->y1 = m.b * x1 + m.d * y1 + m.f;
+         ln->x2 = m.a * x2 + m.c * y2 + m.e;  ln->y2 = m.b * x2 + m.d * y2 + m.f;
+         sprintf(ln->stroke, "%.6s", at + 9);
+         at = strstr(el, "stroke-width=\"");
+         ln->width = at && at < strchr(el, '>') ? atoi(at + 14) : 1;
+      } else if (strncmp(el, "<path d=\"", 9) == 0 &&   /* M x y L x y ... */
+                 (at = strstr(el, "\" fill=\"none\" ")) != NULL &&
+                 at < strchr(el, '>')) {
+         if ((at = strstr(at, "stroke=\"#")) == NULL) return -1;
+         sprintf(ref, "%.6s", at + 9);
+         at = strstr(at, "stroke-width=\"");
+         width = at && at < strchr(el, '>') ? atoi(at + 14) : 1;
+         for (cp = el + 9; sscanf(cp, " M %lf %lf L %lf %lf%n",
+                                  &x1, &y1, &x2, &y2, &len) == 4; cp += len) {
+            if (n >= max) return -1;
+            ln = &lines[n++];
+            ln->x1 = m.a * x1 + m.c * y1 + m.e;  ln->y1 = m.b * x1 + m.d * y1 + m.f;
+            ln->x2 = m.a * x2 + m.c * y2 + m.e;  ln->y2 = m.b * x2 + m.d * y2 + m.f;
+            strcpy(ln->stroke, ref);
+            ln->width = width;
+         }
+      } else if (strncmp(el, "<use", 4) == 0) {
+         if ((at = strstr(el, "xlink:href=\"#")) == NULL) return -1;
+         sprintf(ref, "<symbol id=\"%.*s\"", (int)strcspn(at + 13, "\""),
+                 at + 13);
+         if ((at = strstr(el, "transform=\"")) == NULL ||
+             (el = strstr(svg, ref)) == NULL) return -1;
+         n = svg_lines(svg, strchr(el, '>'), strstr(el, "</symbol>"),
+                       svg_transform(at + 11, m), lines, n, max);
+      } else if (strncmp(el, "<g transform=\"", 14) == 0) {
+         if ((cp = svg_group_end(el)) == NULL) return -1;
+         n = svg_lines(svg, strchr(el, '>'), cp, svg_transform(el + 14, m),
+                       lines, n, max);
+      }
+   }
+
+   return n;
+}
+
+/***********************************************************************/
+
+int test_instanced(int maxdepth, double tol) {
+   /* instanced by symbols, the SVG must render the lines of the plain
+    * SVG, in the same order, colors and widths, and at the same points
+    * up to the rounding of the symbols' coords and transforms by tol */
+
+   const affine_t id = { 1., 0., 0., 1., 0., 0. };
+   tree_param_t tp;
+   CPLT_gc_t gc;
+   char *svg[2];
+   svgline_t *lines[2];
+   long len, size[2] = {0, 0};
+   double maxerr = 0.;
+   int g, i, wied, stub, max, n[2] = {0, 0}, fails = 0;
+
+   max = tree_numsegs(maxdepth) + (2 << maxdepth);
+   lines[0] = (svgline_t *)malloc(max * sizeof(svgline_t));
+   lines[1] = (svgline_t *)malloc(max * sizeof(svgline_t));
+   if (!lines[0] || !lines[1]) return 1;
+
+   for (stub = 0; stub <= 1; stub++)
+      for (wied = 0; wied <= maxdepth; wied++) {
+         tree_param_init(&tp, wied, PSZ);
+         tp.min_len = 4. * stub;      /* keeps levels 0-10 */
+         tp.stub = stub;
+         for (g = 0; g <= 1; g++) {
+            tp.instanced = g;
+            svg[g] = NULL;
+            if ((gc = CPLT_init_graphics(PSZ, PSZ, "test_tree.svg")) == NULL)
+               continue;
+            tree_render(&tp, gc, NULL);
+            CPLT_finish_graphics(gc);
+            if ((svg[g] = read_plotfile("test_tree.svg", &size[g])) != NULL)
+               n[g] = svg_lines(svg[g], svg[g], svg[g] + size[g], id,
+                                lines[g], 0, max);
+            free(svg[g]);
+         }
+         if (!svg[0] || !svg[1] || n[0] <= 0 || n[0] != n[1]) fails++;
+         for (i = 0; i < n[0] && i < n[1]; i++) {
+            if (strcmp(lines[0][i].stroke, lines[1][i].stroke) != 0 ||
+                lines[0][i].width != lines[1][i].width) fails++;
+            maxerr = fmax(maxerr, fabs(lines[0][i].x1 - lines[1][i].x1));
+            maxerr = fmax(maxerr, fabs(lines[0][i].y1 - lines[1][i].y1));
+            maxerr = fmax(maxerr, fabs(lines[0][i].x2 - lines[1][i].x2));
+            maxerr = fmax(maxerr, fabs(lines[0][i].y2 - lines[1][i].y2));
+         }
+         if (fails) {
+            fprintf(stderr, " *** FAIL: instanced, depth %d%s differs\n",
+                    wied, stub ? " pruned" : "");
+            break;
+         }
+      }
+   if (maxerr > tol) fails++;
+   free(lines[0]);
+   free(lines[1]);
+   remove("test_tree.svg");
+
+   len = size[0] / (size[1] ? size[1] : 1);
+   printf("same lines instanced by symbols:          %s (depth 0-%d, %.2g <= %g "
+          "pix, %ldx smaller)\n", fails ? "FAILED" : "ok", maxdepth, maxerr,
+          tol, len);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+char *render_tree(const tree_param_t *tp, char *plotfilename, long *len) {
+   /* renders the tree of tp by tree_render(), returns the plotfile */
+
+   CPLT_gc_t gc;
+
+   if ((gc = CPLT_init_graphics(tp->psz, tp->psz, plotfilename)) == NULL)
+      return NULL;
+   tree_render(tp, gc, NULL);
+   CPLT_finish_graphics(gc);
+
+   return read_plotfile(plotfilename, len);
+}
+
+/***********************************************************************/
+
+int count_str(const char *buf, const char *str) {
+   /* returns the number of occurrences of str in buf */
+
+   int n = 0;
+
+   for (; (buf = strstr(buf, str)) != NULL; buf += strlen(str)) n++;
+
+   return n;
+}
+
+int test_transformed(int maxdepth, double tol, int wied, double ptol) {
+   /* drawn in local coordinates by transforms, the SVG must render the
+    * lines of the plain SVG, in the same order, colors and widths, and
+    * at the same points up to the rounding of the transforms by tol, the
+    * EPS must restore each saved matrix, also replayed from a recording,
+    * and the PNG of depth wied differ in at most the fraction ptol of
+    * the tree's pixels */
+
+   const affine_t id = { 1., 0., 0., 1., 0., 0. };
+   tree_param_t tp;
+   CPLT_gc_t gc;
+   gdImagePtr img[2];
+   char *svg[2], *buf[2];
+   svgline_t *lines[2];
+   long len[2], size[2] = {0, 0};
+   double maxerr = 0.;
+   int g, i, x, y, c0, c1, ink, diff, stub, max, n[2] = {0, 0}, fails = 0;
+
+   max = tree_numsegs(maxdepth) + (2 << maxdepth);
+   lines[0] = (svgline_t *)malloc(max * sizeof(svgline_t));
+   lines[1] = (svgline_t *)malloc(max * sizeof(svgline_t));
+   if (!lines[0] || !lines[1]) return 1;
+
+   for (stub = 0; stub <= 1; stub++)
+      for (i = 0; i <= maxdepth; i++) {
+         tree_param_init(&tp, i, PSZ);
+         tp.min_len = 4. * stub;      /* keeps levels 0-10 */
+         tp.stub = stub;
+         for (g = 0; g <= 1; g++) {
+            tp.transformed = g;
+            svg[g] = render_tree(&tp, "test_tree.svg", &size[g]);
+            if (svg[g] != NULL)
+               n[g] = svg_lines(svg[g], svg[g], svg[g] + size[g], id,
+                                lines[g], 0, max);
+            free(svg[g]);
+         }
+         if (!svg[0] || !svg[1] || n[0] <= 0 || n[0] != n[1]) fails++;
+         for (g = 0; g < n[0] && g < n[1]; g++) {
+            if (strcmp(lines[0][g].stroke, lines[1][g].stroke) != 0 ||
+                lines[0][g].width != lines[1][g].width) fails++;
+            maxerr = fmax(maxerr, fabs(lines[0][g].x1 - lines[1][g].x1));
+            maxerr = fmax(maxerr, fabs(lines[0][g].y1 - lines[1][g].y1));
+            maxerr = fmax(maxerr, fabs(lines[0][g].x2 - lines[1][g].x2));
+            maxerr = fmax(maxerr, fabs(lines[0][g].y2 - lines[1][g].y2));
+         }
+         if (fails) {
+            fprintf(stderr, " *** FAIL: transformed, depth %d%s differs\n",
+                    i, stub ? " pruned" : "");
+            break;
+         }
+      }
+   if (maxerr > tol) fails++;
+   free(lines[0]);
+   free(lines[1]);
+   remove("test_tree.svg");
+
+   /* EPS: as many matrices restored as saved, the same when replayed */
+   tree_param_init(&tp, wied, PSZ);
+   tp.transformed = 1;
+   buf[0] = render_tree(&tp, "test_tree.eps", &len[0]);
+   buf[1] = NULL;
+   if ((gc = CPLT_init_recording(PSZ, PSZ)) != NULL) {
+      tree_render(&tp, gc, NULL);
+      if (CPLT_replay(gc, "test_tree.eps") == 0)
+         buf[1] = read_plotfile("test_tree.eps", &len[1]);
+      CPLT_finish_graphics(gc);
+   }
+   remove("test_tree.eps");
+   if (!buf[0] || !buf[1] || len[0] != len[1] ||
+       memcmp(buf[0], buf[1], len[0]) != 0 ||
+       count_str(buf[0], "matrix currentmatrix\n") != (2 << wied) - 1 ||
+       count_str(buf[0], "setmatrix\n") != (2 << wied) - 1) fails++;
+   free(buf[0]);
+   free(buf[1]);
+
+   /* PNG: the same pixels but for the rounding of the mapped points */
+   tp.transformed = 0;
+   img[0] = render_png(&tp, "test_tree.png");
+   tp.transformed = 1;
+   img[1] = render_png(&tp, "test_tree.png");
+   if (!img[0] || !img[1]) return 1;
+   for (ink = diff = y = 0; y < PSZ; y++)
+      for (x = 0; x < PSZ; x++) {
+         c0 = gdImageGetTrueColorPixel(img[0], x, y) & 0xFFFFFF;
+         c1 = gdImageGetTrueColorPixel(img[1], x, y) & 0xFFFFFF;
+         if (c0 != 0xFFFFFF) ink++;
+         if (c0 != c1) diff++;
+      }
+   gdImageDestroy(img[0]);
+   gdImageDestroy(img[1]);
+   if (diff > ptol * ink) fails++;
+
+   printf("same lines in local coords, transformed:  %s (depth 0-%d, %.2g <= %g "
+          "pix, PNG %.2f%% <= %g%% pixels differ)\n", fails ? "FAILED" : "ok",
+          maxdepth, maxerr, tol, 100. * diff / ink, 100. * ptol);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+int test_branching(int maxdepth) {
+   /* instanced, the EPS only grows with the linewidths and colors of the
+    * levels of the recursive branching, with stubs it falls back to a
+    * procedure per level, smaller than the plain segments */
+
+   tree_param_t tp;
+   char *buf[2];
+   long len[2], grow;
+   int fails = 0;
+
+   tree_param_init(&tp, 1, PSZ);
+   tp.instanced = 1;
+   buf[0] = render_tree(&tp, "test_tree.eps", &len[0]);
+   tp.depth = maxdepth;
+   buf[1] = render_tree(&tp, "test_tree.eps", &len[1]);
+   grow = (len[1] - len[0]) / (maxdepth - 1);
+   if (!buf[0] || !buf[1] || !strstr(buf[1], "\nBR\n") || grow > 64) fails++;
+   free(buf[0]);
+   free(buf[1]);
+
+   tp.min_len = 4.;
+   tp.stub = 1;
+   buf[0] = render_tree(&tp, "test_tree.eps", &len[0]);
+   tp.instanced = 0;
+   buf[1] = render_tree(&tp, "test_tree.eps", &len[1]);
+   if (!buf[0] || !buf[1] || !strstr(buf[0], "\n/Sym0 {\n") ||
+       strstr(buf[0], "\nBR\n") || len[0] >= len[1]) fails++;
+   free(buf[0]);
+   free(buf[1]);
+   remove("test_tree.eps");
+
+   printf("EPS branching grows with levels only:     %s (depth 1-%d, "
+          "%ld <= 64 bytes per level)\n", fails ? "FAILED" : "ok",
+          maxdepth, grow);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+void draw_markers(CPLT_gc_t gc, int placed) {
+   /* draws the 8 forms of markers in a grid, its left half on black,
+    * directly or each form defined once as a symbol placed there */
+
+   CPLT_point_t black[4] = { {0., 0.}, {PSZ / 2, 0.}, {PSZ / 2, PSZ},
+                             {0., PSZ} };
+   int m, x, y;
+
+   CPLT_set_color(gc, 0., 0., 0.);
+   CPLT_draw_filledPolygon(gc, 4, black);
+   CPLT_set_linewidth(gc, 2.);
+   for (m = 0; placed && m < 8; m++) {
+      CPLT_define_symbol(gc, m);
+      CPLT_set_color(gc, 0.1 * m, 0.9 - 0.1 * m, 0.6);
+      CPLT_draw_marker(gc, 0., 0., 15, m);
+      CPLT_end_symbol(gc);
+   }
+   for (y = 20; y < PSZ; y += 40)
+      for (x = 20; x < PSZ; x += 40) {
+         m = (x / 40 + y / 40) % 8;
+         if (placed) {
+            CPLT_place_symbol(gc, m, x, y, 1., 0.);
+         } else {
+            CPLT_set_color(gc, 0.1 * m, 0.9 - 0.1 * m, 0.6);
+            CPLT_draw_marker(gc, x, y, 15, m);
+         }
+      }
+}
+
+gdImagePtr render_markers(int placed, char *plotfilename) {
+   /* draws the markers into PNG plotfilename and reads it back */
+
+   CPLT_gc_t gc;
+
+   if ((gc = CPLT_init_graphics(PSZ, PSZ, plotfilename)) == NULL)
+      return NULL;
+   draw_markers(gc, placed);
+   CPLT_finish_graphics(gc);
+
+   return read_png(plotfilename);
+}
+
+int test_symbols(int wied, double tol) {
+   /* placed as sprites at whole pixels, the PNG's symbols must match
+    * the markers drawn directly up to the rounding of their alpha, on
+    * white as on black, i.e. without a halo; instanced, turned and
+    * scaled, the tree's PNG is resampled at each level, which blurs it,
+    * but it must not move more than the fraction tol of its ink between
+    * blocks of 8x8 pixels of the plain one. Replayed, the symbols' EPS
+    * must be the one drawn. */
+
+   tree_param_t tp;
+   gdImagePtr img[2];
+   CPLT_gc_t gc;
+   char *buf[2];
+   long len[2];
+   double ink[2], total = 0., moved = 0.;
+   int i, x, y, bx, by, c0, c1, d, maxd = 0, fails = 0;
+
+   img[0] = render_markers(0, "test_tree.png");
+   img[1] = render_markers(1, "test_tree.png");
+   if (!img[0] || !img[1]) return 1;
+   for (y = 0; y < PSZ; y++)
+      for (x = 0; x < PSZ; x++) {
+         c0 = gdImageGetTrueColorPixel(img[0], x, y);
+         c1 = gdImageGetTrueColorPixel(img[1], x, y);
+         for (i = 0; i < 24; i += 8) {
+            d = abs(((c0 >> i) & 0xFF) - ((c1 >> i) & 0xFF));
+            if (d > maxd) maxd = d;
+         }
+      }
+   gdImageDestroy(img[0]);
+   gdImageDestroy(img[1]);
+   if (maxd > 2) fails++;
+
+   tree_param_init(&tp, wied, PSZ);
+   img[0] = render_png(&tp, "test_tree.png");
+   tp.instanced = 1;
+   img[1] = render_png(&tp, "test_tree.png");
+   if (!img[0] || !img[1]) return 1;
+   for (by = 0; by < PSZ; by += 8)
+      for (bx = 0; bx < PSZ; bx += 8) {
+         ink[0] = ink[1] = 0.;
+         for (y = by; y < by + 8 && y < PSZ; y++)
+            for (x = bx; x < bx + 8 && x < PSZ; x++) {
+               c0 = gdImageGetTrueColorPixel(img[0], x, y);
+               c1 = gdImageGetTrueColorPixel(img[1], x, y);
+               for (i = 0; i < 24; i += 8) {
+                  ink[0] += 255 - ((c0 >> i) & 0xFF);
+                  ink[1] += 255 - ((c1 >> i) & 0xFF);
+               }
+            }
+         total += ink[0];
+         moved += fabs(ink[0] - ink[1]);
+      }
+   gdImageDestroy(img[0]);
+   gdImageDestroy(img[1]);
+   if (moved > tol * total) fails++;
+
+   if ((gc = CPLT_init_recording(PSZ, PSZ)) == NULL) return 1;
+   draw_markers(gc, 1);
+   buf[0] = CPLT_replay(gc, "test_tree.eps") == 0 ?
+            read_plotfile("test_tree.eps", &len[0]) : NULL;
+   CPLT_finish_graphics(gc);
+   buf[1] = NULL;
+   if ((gc = CPLT_init_graphics(PSZ, PSZ, "test_tree.eps")) != NULL) {
+      draw_markers(gc, 1);
+      CPLT_finish_graphics(gc);
+      buf[1] = read_plotfile("test_tree.eps", &len[1]);
+   }
+   if (!buf[0] || !buf[1] || len[0] != len[1] ||
+       memcmp(buf[0], buf[1], len[0]) != 0 ||
+       count_str(buf[1], " Sym") != (PSZ / 40) * (PSZ / 40)) fails++;
+   free(buf[0]);
+   free(buf[1]);
+   remove("test_tree.eps");
+
+   printf("PNG symbols as sprites:                   %s (markers %d <= 2 "
+          "levels, depth %d %.1f%% <= %g%% ink moved)\n",
+          fails ? "FAILED" : "ok", maxd, wied, 100. * moved / total,
+          100. * tol);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+long render_zoomed(const tree_param_t *tp, int cull, char *plotfilename,
+                   gdImagePtr *img) {
+   /* renders the tree of tp zoomed 8x into its crown, and a long sine
+    * wave across, with culling or not, into plotfilename, returns its
+    * size and for a PNG reads it back to *img */
+
+   CPLT_point_t *wave;
+   CPLT_gc_t gc;
+   long len = -1;
+   char *buf;
+   int i, n = 100000;
+
+   if ((wave = (CPLT_point_t *)malloc(n * sizeof(*wave))) == NULL) return -1;
+   for (i = 0; i < n; i++) {
+      wave[i].x = PSZ * (i / (n - 1.));
+      wave[i].y = PSZ * (0.7 + 0.2 * sin(i * 0.01));
+   }
+   if ((gc = CPLT_init_graphics(PSZ, PSZ, plotfilename)) != NULL) {
+      CPLT_set_culling(gc, cull);
+      CPLT_push_transform(gc);
+      CPLT_concat_matrix(gc, 8., 0., 0., 8., -7. * 0.5 * PSZ, -7. * 0.7 * PSZ);
+      tree_render(tp, gc, NULL);
+      CPLT_set_color(gc, 0., 0., 1.);
+      CPLT_set_linewidth(gc, 0.5);
+      CPLT_draw_polyline(gc, n, wave);
+      CPLT_pop_transform(gc);
+      CPLT_finish_graphics(gc);
+      if (img != NULL) {
+         *img = read_png(plotfilename);
+      } else if ((buf = read_plotfile(plotfilename, &len)) != NULL) {
+         free(buf);
+         remove(plotfilename);
+      }
+   }
+   free(wave);
+
+   return len;
+}
+
+int test_culling(int wied) {
+   /* zoomed into the tree, drawn plain, batched and transformed, the
+    * culled PNG must be the same as the unculled one pixel for pixel,
+    * and the culled SVG smaller, much so unless transformed, as the
+    * transforms of the subtrees off the canvas are kept */
+
+   tree_param_t tp;
+   gdImagePtr img[2];
+   long len[2];
+   double ratio = 1e30;
+   int v, x, y, diff = 0, fails = 0;
+
+   for (v = 0; v < 3; v++) {
+      tree_param_init(&tp, wied, PSZ);
+      tp.batched = v == 1;
+      tp.transformed = v == 2;
+      render_zoomed(&tp, 0, "test_tree.png", &img[0]);
+      render_zoomed(&tp, 1, "test_tree.png", &img[1]);
+      if (!img[0] || !img[1]) return 1;
+      for (y = 0; y < PSZ; y++)
+         for (x = 0; x < PSZ; x++)
+            diff += gdImageGetTrueColorPixel(img[0], x, y) !=
+                    gdImageGetTrueColorPixel(img[1], x, y);
+      gdImageDestroy(img[0]);
+      gdImageDestroy(img[1]);
+      len[0] = render_zoomed(&tp, 0, "test_tree.svg", NULL);
+      len[1] = render_zoomed(&tp, 1, "test_tree.svg", NULL);
+      if (len[0] <= 0 || len[1] <= 0 || len[1] >= len[0]) fails++;
+      else if (!tp.transformed) ratio = fmin(ratio, (double) len[0] / len[1]);
+   }
+   if (diff || ratio < 4.) fails++;
+
+   printf("culled off the canvas, zoomed 8x:         %s (depth %d, %d pixels "
+          "differ, SVG %.1fx >= 4x smaller)\n", fails ? "FAILED" : "ok", wied,
+          diff, ratio);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+int test_batched(int maxdepth, int wied) {
+   /* batched, the SVG must render the same lines as plain, in the same
+    * order, colors and widths, and the PNG of depth wied the same pixels */
+
+   const affine_t id = { 1., 0., 0., 1., 0., 0. };
+   tree_param_t tp;
+   gdImagePtr img[2];
+   char *svg[2];
+   svgline_t *lines[2];
+   long size[3] = {0, 0, 0};
+   int b, i, x, y, max, n[2] = {0, 0}, diff = 0, fails = 0;
+
+   max = tree_numsegs(maxdepth);
+   lines[0] = (svgline_t *)malloc(max * sizeof(svgline_t));
+   lines[1] = (svgline_t *)malloc(max * sizeof(svgline_t));
+   if (!lines[0] || !lines[1]) return 1;
+
+   for (tp.depth = 0; tp.depth <= maxdepth && !fails; tp.depth++) {
+      tree_param_init(&tp, tp.depth, PSZ);
+      for (b = 0; b <= 1; b++) {
+         tp.batched = b;
+         n[b] = -1;
+         if ((svg[b] = render_tree(&tp, "test_tree.svg", &size[b])) != NULL)
+            n[b] = svg_lines(svg[b], svg[b], svg[b] + size[b], id,
+                             lines[b], 0, max);
+         free(svg[b]);
+      }
+      if (n[0] <= 0 || n[0] != n[1]) fails++;
+      for (i = 0; i < n[0] && i < n[1]; i++)
+         if (lines[0][i].x1 != lines[1][i].x1 ||
+             lines[0][i].y1 != lines[1][i].y1 ||
+             lines[0][i].x2 != lines[1][i].x2 ||
+             lines[0][i].y2 != lines[1][i].y2 ||
+             strcmp(lines[0][i].stroke, lines[1][i].stroke) != 0 ||
+             lines[0][i].width != lines[1][i].width) {
+            fprintf(stderr, " *** FAIL: batched, depth %d line %d differs\n",
+                    tp.depth, i);
+            fails++;
+            break;
+         }
+   }
+   tp.depth = maxdepth;
+   tp.grouped = 1;
+   free(render_tree(&tp, "test_tree.svg", &size[2]));
+   free(lines[0]);
+   free(lines[1]);
+   remove("test_tree.svg");
+
+   tree_param_init(&tp, wied, PSZ);
+   img[0] = render_png(&tp, "test_tree.png");
+   tp.batched = 1;
+   img[1] = render_png(&tp, "test_tree.png");
+   if (!img[0] || !img[1]) return fails + 1;
+   for (y = 0; y < tp.psz; y++)
+      for (x = 0; x < tp.psz; x++)
+         diff += gdImageGetTrueColorPixel(img[0], x, y) !=
+                 gdImageGetTrueColorPixel(img[1], x, y);
+   gdImageDestroy(img[0]);
+   gdImageDestroy(img[1]);
+   if (diff) fails++;
+
+   printf("same lines and pixels batched:            %s (depth 0-%d, SVG "
+          "%.1fx, grouped %.0fx smaller)\n", fails ? "FAILED" : "ok",
+          maxdepth, (double)size[0] / (size[1] ? size[1] : 1),
+          (double)size[0] / (size[2] ? size[2] : 1));
+
+   return fails;
+}
+
+/***********************************************************************/
+
+int test_replay(int wied, int multi) {
+   /* the tree recorded once and replayed, or if multi drawn once into
+    * all formats in parallel, must give the same plotfiles as drawn
+    * directly, byte for byte resp. pixel for pixel */
+
+   char *suffix[3] = { "eps", "svg", "png" };
+   char name[3][40], *files[3], *buf[3];
+   tree_param_t tp;
+   CPLT_gc_t gc;
+   gdImagePtr img[2];
+   long len[3];
+   int i, x, y, diff, fails = 0;
+
+   for (i = 0; i < 3; i++) {
+      sprintf(name[i], "test_tree.%s", suffix[i]);
+      files[i] = name[i];
+   }
+   tree_param_init(&tp, wied, PSZ);
+   gc = multi ? CPLT_init_graphics_multi(PSZ, PSZ, files, 3)
+              : CPLT_init_recording(PSZ, PSZ);
+   if (gc == NULL) return 1;
+   tree_render(&tp, gc, NULL);
+   if (multi) CPLT_finish_graphics(gc);
+
+   /* read back the plotfiles before drawing them directly */
+   for (i = 0; i < 2; i++)
+      buf[i] = multi || CPLT_replay(gc, files[i]) == 0 ?
+               read_plotfile(files[i], &len[i]) : NULL;
+   img[1] = multi || CPLT_replay(gc, files[2]) == 0 ? read_png(files[2])
+                                                    : NULL;
+   if (!multi) CPLT_finish_graphics(gc);
+
+   for (i = 0; i < 2; i++) {
+      buf[2] = render_tree(&tp, files[i], &len[2]);
+      if (!buf[i] || !buf[2] || len[i] != len[2] ||
+          memcmp(buf[i], buf[2], len[2]) != 0) fails++;
+      free(buf[i]);
+      free(buf[2]);
+      remove(files[i]);
+   }
+   img[0] = render_png(&tp, files[2]);
+   if (!img[0] || !img[1]) fails++;
+   for (diff = 0, y = 0; img[0] && img[1] && y < tp.psz; y++)
+      for (x = 0; x < tp.psz; x++)
+         diff += gdImageGetTrueColorPixel(img[0], x, y) !=
+                 gdImageGetTrueColorPixel(img[1], x, y);
+   if (diff) fails++;
+   if (img[0]) gdImageDestroy(img[0]);
+   if (img[1]) gdImageDestroy(img[1]);
+
+   printf("same plotfiles %-26s %s (depth %d, eps, svg, png)\n",
+          multi ? "drawn in parallel:" : "replayed from recording:",
+          fails ? "FAILED" : "ok", wied);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+int test_elided(int maxdepth) {
+   /* plain in depth-first order the tree sets color and linewidth for
+    * each segment, CPlotter must pass on only those, which change them */
+
+   tree_param_t tp;
+   CPLT_gc_t gc;
+   char *buf, *line, *prev[2] = {"", ""};
+   unsigned long calls = 0, changes = 0;
+   long len, saved = 0;
+   int wied, k, fails = 0;
+
+   for (wied = 0; wied <= maxdepth; wied++) {
+      tree_param_init(&tp, wied, PSZ);
+      if ((gc = CPLT_init_graphics(PSZ, PSZ, "test_tree.eps")) == NULL) {
+         fails++;
+         continue;
+      }
+      tree_render(&tp, gc, NULL);
+      CPLT_finish_graphics(gc);
+      if ((buf = read_plotfile("test_tree.eps", &len)) == NULL) {
+         fails++;
+         continue;
+      }
+      prev[0] = prev[1] = "";
+      for (line = strtok(buf, "\n"); line; line = strtok(NULL, "\n")) {
+         if (strlen(line) < 3 || line[strlen(line) - 2] != ' ') continue;
+         if (strcmp(line + strlen(line) - 2, " c") == 0) k = 0;
+         else if (strcmp(line + strlen(line) - 2, " w") == 0) k = 1;
+         else if (strcmp(line + strlen(line) - 2, " l") == 0) {
+            calls += 2;   /* the segment's linewidth and color */
+            continue;
+         } else continue;
+         if (strcmp(line, prev[k]) == 0) fails++;
+         prev[k] = line;
+         changes++;
+         saved += strlen(line) + 1;
+      }
+      free(buf);
+   }
+   remove("test_tree.eps");
+   /* bytes saved: those of the settings dropped, of about the same size */
+   saved = changes ? saved / changes * (calls - changes) : 0;
+   printf("%-41s %s (depth 0-%d, %lu of %lu passed on, %ld bytes less)\n",
+          "redundant state changes dropped:", fails ? "FAILED" : "ok",
+          maxdepth, changes, calls, saved);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+typedef struct {
+   tree_param_t tp;
+   char plotfilename[32];
+   int fail;
+} pngjob_t;
+
+void *render_titled(void *arg) {
+   /* thread: renders the tree of the job with a title into its PNG */
+
+   pngjob_t *job = (pngjob_t *)arg;
+   CPLT_gc_t gc;
+
+   if ((gc = CPLT_init_graphics(job->tp.psz, job->tp.psz,
+                                job->plotfilename)) == NULL) {
+      job->fail = 1;
+      return NULL;
+   }
+   CPLT_set_fontsize(gc, 16);
+   CPLT_draw_text(gc, 0.5 * job->tp.psz, job->tp.psz - 20., "s", 0., "Baum");
+   if (tree_render(&job->tp, gc, NULL) != 0) job->fail = 1;
+   CPLT_finish_graphics(gc);
+
+   return NULL;
+}
+
+int test_png_threads(int nthreads, int wied) {
+   /* nthreads PNGs of the tree with a title, rendered concurrently from
+    * the start, font discovery included, must match the one rendered
+    * alone pixel for pixel */
+
+   pngjob_t *jobs;
+   pthread_t *tids;
+   gdImagePtr img[2];
+   int i, x, y, started, fails = 0;
+
+   jobs = (pngjob_t *) malloc((nthreads + 1) * sizeof(*jobs));
+   tids = (pthread_t *) malloc(nthreads * sizeof(*tids));
+   if (jobs == NULL || tids == NULL) return 1;
+   for (i = 0; i <= nthreads; i++) {
+      tree_param_init(&jobs[i].tp, wied, PSZ);
+      sprintf(jobs[i].plotfilename, "test_tree_%d.png", i);
+      jobs[i].fail = 0;
+   }
+   for (started = 0; started < nthreads; started++)
+      if (pthread_create(&tids[started], NULL, &render_titled,
+                         &jobs[started]) != 0) {
+         fails++;
+         break;
+      }
+   for (i = 0; i < started; i++) pthread_join(tids[i], NULL);
+   render_titled(&jobs[nthreads]);
+
+   img[0] = read_png(jobs[nthreads].plotfilename);
+   if (img[0] == NULL || jobs[nthreads].fail) fails++;
+   for (i = 0; i < started; i++) {
+      img[1] = read_png(jobs[i].plotfilename);
+      if (img[1] == NULL || jobs[i].fail) fails++;
+      for (y = 0; img[0] && img[1] && y < PSZ; y++)
+         for (x = 0; x < PSZ; x++)
+            if (gdImageGetTrueColorPixel(img[0], x, y) !=
+                gdImageGetTrueColorPixel(img[1], x, y)) {
+               fails++;
+               y = PSZ;
+               break;
+            }
+      if (img[1]) gdImageDestroy(img[1]);
+      remove(jobs[i].plotfilename);
+   }
+   if (img[0]) gdImageDestroy(img[0]);
+   remove(jobs[nthreads].plotfilename);
+   free(jobs);
+   free(tids);
+
+   printf("same PNGs rendered on %2d threads at once: %s (depth %d)\n",
+          nthreads, fails ? "FAILED" : "ok", wied);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+typedef struct {
+   char *buf;
+   size_t len, max;
+} sinkbuf_t;
+
+long sink_write(void *arg, const char *data, size_t len) {
+   /* write callback of test_sinks(), appends data to the sinkbuf_t arg */
+
+   sinkbuf_t *sb = (sinkbuf_t *)arg;
+   char *buf;
+
+   if (sb->len + len + 1 > sb->max) {
+      if ((buf = (char *) realloc(sb->buf, 2 * (sb->len + len + 1))) == NULL)
+         return 0;
+      sb->buf = buf;
+      sb->max = 2 * (sb->len + len + 1);
+   }
+   memcpy(sb->buf + sb->len, data, len);
+   sb->len += len;
+   sb->buf[sb->len] = '\0';
+
+   return len;
+}
+
+int test_sinks(int wied) {
+   /* the tree written through a large buffer, into memory, to a callback,
+    * to a file descriptor and by a writer thread through small buffers
+    * must give the same plot as the plotfile */
+
+   char *suffix[3] = { "eps", "svg", "png" };
+   char name[40], *ref, *buf;
+   tree_param_t tp;
+   CPLT_gc_t gc;
+   sinkbuf_t sb;
+   size_t size;
+   long len, reflen;
+   int i, k, fd, fails = 0;
+
+   tree_param_init(&tp, wied, PSZ);
+   for (i = 0; i < 3; i++) {
+      sprintf(name, "test_tree.%s", suffix[i]);
+      if ((ref = render_tree(&tp, name, &reflen)) == NULL) {
+         fails++;
+         continue;
+      }
+      for (k = 0; k < 5; k++) {
+         buf = NULL;
+         len = size = 0;
+         sb.buf = NULL;
+         sb.len = sb.max = 0;
+         fd = -1;
+         switch (k) {
+            case 0:
+               gc = CPLT_init_graphics_buffered(PSZ, PSZ, name, 0);
+               break;
+            case 1:
+               gc = CPLT_init_graphics_memory(PSZ, PSZ, name, &buf, &size);
+               break;
+            case 2:
+               gc = CPLT_init_graphics_callback(PSZ, PSZ, name,
+                                                &sink_write, &sb);
+               break;
+            case 3:
+               remove(name);
+               fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+               gc = fd < 0 ? NULL : CPLT_init_graphics_fd(PSZ, PSZ, name, fd);
+               break;
+            default:
+               gc = CPLT_init_graphics_async(PSZ, PSZ, name, 1000);
+         }
+         if (gc == NULL) {
+            fails++;
+            continue;
+         }
+         tree_render(&tp, gc, NULL);
+         CPLT_finish_graphics(gc);
+         if (k == 1) len = size;
+         if (k == 2) {
+            buf = sb.buf;
+            len = sb.len;
+         }
+         if (fd >= 0 && close(fd) != 0) fails++;   /* still open */
+         if (k == 0 || k >= 3) buf = read_plotfile(name, &len);
+         else if (buf != NULL) blank_date(buf);
+         if (buf == NULL || len != reflen || memcmp(buf, ref, len) != 0) {
+            fprintf(stderr, " *** FAIL: sink %d, %s differs\n", k, name);
+            fails++;
+         }
+         free(buf);
+      }
+      free(ref);
+      remove(name);
+   }
+
+   printf("same plots from file, memory, callback:   %s (depth %d, eps, svg, "
+          "png, also fd, async)\n", fails ? "FAILED" : "ok", wied);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+int test_stats(int wied) {
+   /* built with CPLT_STATS, the counters must add up: the points of the
+    * segments drawn, the bytes of the EPS up to its trailer, written to
+    * memory or a callback */
+
+   char *trailer = "\nshowpage\n%%EOF\n", *buf;
+   tree_param_t tp;
+   CPLT_gc_t gc;
+   CPLT_stats_t st;
+   sinkbuf_t sb;
+   size_t size;
+   unsigned long segs;
+   int k, fails = 0;
+
+   tree_param_init(&tp, wied, PSZ);
+   for (k = 0; k < 2; k++) {
+      buf = NULL;
+      sb.buf = NULL;
+      sb.len = sb.max = 0;
+      gc = k == 0
+         ? CPLT_init_graphics_memory(PSZ, PSZ, "test_tree.eps", &buf, &size)
+         : CPLT_init_graphics_callback(PSZ, PSZ, "test_tree.eps",
+                                       &sink_write, &sb);
+      if (gc == NULL) return 1;
+      tree_render(&tp, gc, NULL);
+      if (CPLT_get_stats(gc, &st) != 0) {
+         CPLT_finish_graphics(gc);
+         free(buf);
+         free(sb.buf);
+         printf("performance counters:                     "
+                "skipped, not built with CPLT_STATS\n");
+         return 0;
+      }
+      CPLT_finish_graphics(gc);
+      if (k == 1) {
+         buf = sb.buf;
+         size = sb.len;
+      }
+      segs = st.calls[CPLT_PolylineFunc];
+      if (st.calls[CPLT_InitFunc] != 1 || st.calls[CPLT_FinishFunc] != 0
+          || segs == 0 || st.points != 2 * segs || st.elided == 0
+          || st.secs[CPLT_PolylineFunc] <= 0.
+          || st.bytes + strlen(trailer) != size) {
+         fprintf(stderr, " *** FAIL: stats %d: %lu segments, %lu points, "
+                 "%lu of %lu bytes\n", k, segs, st.points, st.bytes,
+                 (unsigned long) size);
+         fails++;
+      }
+      free(buf);
+   }
+
+   printf("performance counters:                     %s (depth %d, %lu "
+          "segments, %lu elided)\n", fails ? "FAILED" : "ok", wied, segs,
+          st.elided);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+int test_trace(int wied, int calls) {
+   /* traced, the EPS and PNG of the tree must give a JSON array of
+    * events, one per line, of all its segments in events of up to calls
+    * calls, and of the PNG encoding */
+
+   char *name[2] = { "test_tree.eps", "test_tree.png" };
+   char *buf, *cp, *ep, *ap;
+   tree_param_t tp;
+   unsigned long n, segs = 0, events = 0, traced = 0, encodes = 0;
+   long len;
+   int i, fails = 0;
+
+   tree_param_init(&tp, wied, PSZ);
+   if (CPLT_trace("test_tree.json", calls) != 0) return 1;
+   for (i = 0; i < 2; i++) {
+      if ((buf = render_tree(&tp, name[i], &len)) == NULL) {
+         fails++;
+         continue;
+      }
+      /* the segments are drawn as polylines, one lineto each in EPS */
+      if (i == 0)
+         for (cp = buf; (cp = strstr(cp, " l\n")) != NULL; cp++) segs++;
+      free(buf);
+      remove(name[i]);
+   }
+   if (CPLT_trace(NULL, 0) != 0 || CPLT_trace("/nonexistent/x", 1) == 0)
+      fails++;
+
+   if ((buf = read_plotfile("test_tree.json", &len)) == NULL) return 1;
+   if (buf[0] != '[' || strcmp(buf + len - 3, "\n]\n") != 0) fails++;
+   for (cp = buf; (cp = strstr(cp, "{\"name\":\"")) != NULL; cp = ep) {
+      if ((ep = strchr(cp, '\n')) == NULL) ep = buf + len;
+      events++;
+      if (strncmp(cp + 9, "PNG encode\"", 11) == 0) encodes++;
+      if ((ap = strstr(cp, "\"args\":{")) == NULL || ap > ep) continue;
+      /* the busy time, then the number of calls of each function */
+      n = 0;
+      for (ap = strchr(ap, ','); ap && ap < ep; ap = strchr(ap + 1, ',')) {
+         n += strtoul(strchr(ap, ':') + 1, NULL, 10);
+         if (strncmp(ap, ",\"polyline\":", 12) == 0)
+            traced += strtoul(ap + 12, NULL, 10);
+      }
+      if (n == 0 || n > calls) fails++;
+   }
+   if (segs == 0 || traced != 2 * segs || encodes != 1) fails++;
+   free(buf);
+   remove("test_tree.json");
+
+   printf("trace of the calls:                       %s (depth %d, %lu "
+          "events, %lu of %lu polylines)\n", fails ? "FAILED" : "ok", wied,
+          events, traced, 2 * segs);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+void draw_trace(CPLT_gc_t gc, int n, CPLT_point_t pts[], int path, int fill) {
+   /* draws the n points pts as polyline or filled polygon, or streamed
+    * as path */
+
+   int i;
+
+   if (!path) {
+      if (fill) CPLT_draw_filledPolygon(gc, n, pts);
+      else CPLT_draw_polyline(gc, n, pts);
+      return;
+   }
+   CPLT_path_begin(gc);
+   CPLT_path_moveto(gc, pts[0].x, pts[0].y);
+   for (i = 1; i < n; i++) CPLT_path_lineto(gc, pts[i].x, pts[i].y);
+   if (fill) CPLT_path_fill(gc);
+   else CPLT_path_stroke(gc);
+}
+
+int test_paths(int n, double tol) {
+   /* a trace of n points streamed as path must give the same EPS and
+    * PNG as drawn as polyline, also when replayed from a recording,
+    * filled the same EPS and a PNG differing
+    * in at most the fraction tol of the pixels of its antialiased edges,
+    * and PNG must draw it without calling malloc() */
+
+   static CPLT_point_t pts[100000], star[10];
+   char *buf[3];
+   gdImagePtr img[2];
+   CPLT_gc_t gc;
+   long len[3];
+   int i, k, fill, x, y, c0, c1, ink, diff, fails = 0;
+   double fdiff = 0.;
+#ifdef COUNT_MALLOC
+   unsigned long before, mallocs;
+#endif
+
+   if (n > 100000) n = 100000;
+   for (i = 0; i < n; i++) {
+      pts[i].x = 300. + 280. * cos(i * 0.01) * i / n;
+      pts[i].y = 300. + 280. * sin(i * 0.0131) * i / n;
+   }
+   for (i = 0; i < 10; i++) {   /* star, concave */
+      star[i].x = 300. + (i % 2 ? 100. : 250.) * cos(i * M_PI / 5. + 0.3);
+      star[i].y = 300. + (i % 2 ? 100. : 250.) * sin(i * M_PI / 5. + 0.3);
+   }
+
+   /* EPS: the same operators, also replayed from a recording */
+   for (fill = 0; fill < 2; fill++) {
+      for (k = 0; k < 3; k++) {
+         gc = k < 2 ? CPLT_init_graphics(PSZ, PSZ, "test_tree.eps")
+                    : CPLT_init_recording(PSZ, PSZ);
+         if (gc == NULL) return 1;
+         draw_trace(gc, fill ? 10 : n, fill ? star : pts, k > 0, fill);
+         if (k == 2 && CPLT_replay(gc, "test_tree.eps") != 0) fails++;
+         CPLT_finish_graphics(gc);
+         buf[k] = read_plotfile("test_tree.eps", &len[k]);
+         remove("test_tree.eps");
+      }
+      for (k = 1; k < 3; k++)
+         if (!buf[0] || !buf[k] || len[0] != len[k]
+             || memcmp(buf[0], buf[k], len[0]) != 0) fails++;
+      for (k = 0; k < 3; k++) free(buf[k]);
+   }
+
+   /* PNG: the same lines, the area's edges antialiased */
+   for (fill = 0; fill < 2; fill++) {
+      for (k = 0; k < 2; k++) {
+         if ((gc = CPLT_init_graphics(PSZ, PSZ, "test_tree.png")) == NULL)
+            return 1;
+         draw_trace(gc, fill ? 10 : n, fill ? star : pts, k, fill);
+         CPLT_finish_graphics(gc);
+         img[k] = read_png("test_tree.png");
+      }
+      if (!img[0] || !img[1]) return 1;
+      for (ink = diff = y = 0; y < PSZ; y++)
+         for (x = 0; x < PSZ; x++) {
+            c0 = gdImageGetTrueColorPixel(img[0], x, y) & 0xFFFFFF;
+            c1 = gdImageGetTrueColorPixel(img[1], x, y) & 0xFFFFFF;
+            if (c0 != 0xFFFFFF) ink++;
+            if (c0 != c1) diff++;
+         }
+      gdImageDestroy(img[0]);
+      gdImageDestroy(img[1]);
+      if (fill) fdiff = (double) diff / ink;
+      if (fill ? diff > tol * ink : diff > 0) fails++;
+   }
+
+#ifdef COUNT_MALLOC
+   /* PNG: once warmed up, streaming needs no memory */
+   if ((gc = CPLT_init_graphics(PSZ, PSZ, "test_tree.png")) == NULL) return 1;
+   draw_trace(gc, 10, star, 1, 1);
+   before = nmalloc;
+   draw_trace(gc, n, pts, 1, 0);
+   draw_trace(gc, n, pts, 1, 1);
+   mallocs = nmalloc - before;
+   CPLT_finish_graphics(gc);
+   remove("test_tree.png");
+   if (mallocs > 0) fails++;
+#endif
+
+   printf("same lines streamed as path:              %s (%d points, filled "
+          "%.2f%% <= %g%% pixels differ)\n", fails ? "FAILED" : "ok", n,
+          100. * fdiff, 100. * tol);
+
+   return fails;
+}
+
+/***********************************************************************/
+
+int test_scratch(int reps) {
+   /* once warmed up, PNG draws polylines, polygons and curves of any
+    * number of points without calling malloc(), as their GD-points are
+    * bump allocated in the gc's scratch memory */
+
+#ifdef COUNT_MALLOC
+   static CPLT_point_t pts[2000];
+   int npts[3] = { 2, 100, 2000 };
+   CPLT_gc_t gc;
+   unsigned long before = 0, calls = 0;
+   int i, j, k, fails = 0;
+
+   for (i = 0; i < 2000; i++) {
+      pts[i].x = 300. + 250. * cos(i * 0.01);
+      pts[i].y = 300. + 250. * sin(i * 0.013);
+   }
+   if ((gc = CPLT_init_graphics(PSZ, PSZ, "test_tree.png")) == NULL)
+      return 1;
+   for (k = 0; k <= reps; k++) {
+      if (k == 1) before = nmalloc;   /* the first round warms up */
+      for (j = 0; j < 3; j++) {
+         CPLT_draw_polyline(gc, npts[j], pts);
+         CPLT_draw_polygon(gc, npts[j], pts);
+         CPLT_draw_filledPolygon(gc, npts[j], pts);
+         calls += k > 0 ? 3 : 0;
+      }
+      CPLT_draw_curve(gc, pts);
+      calls += k > 0;
+   }
+   if (nmalloc != before) fails++;
+   printf("PNG drawing without malloc:               %s (%lu of %lu calls)\n",
+          fails ? "FAILED" : "ok", nmalloc - before, calls);
+   CPLT_finish_graphics(gc);
+   remove("test_tree.png");
+
+   return fails;
+#else
+   printf("PNG drawing without malloc:               skipped, not counted\n");
+   return 0;
+#endif
+}
+
+/***********************************************************************/
+
+int main(int argc, char *argv[]) {
+
+   int fails = 0;
+
+   /* first, so the PNG font discovery happens on its threads */
+   fails += test_png_threads(16, 12);
+   if (argc > 1 && strcmp(argv[1], "threads") == 0) {
+      /* only those on threads, e.g. under ThreadSanitizer */
+      fails += test_threads(4, 0, 14);
+      fails += test_replay(10, 1);
+      fails += test_sinks(10);
+      printf("%s\n", fails ? "Tests FAILED." : "All tests passed.");
+      return fails ? 1 : 0;
+   }
+   fails += test_same_as_recursion("eps", 12);
+   fails += test_same_as_recursion("svg", 12);
+   fails += test_rotation_error(20, 1e-3);
+   fails += test_kernel("scalar", 16);
+   fails += test_kernel("sse2", 16);
+   fails += test_kernel("avx2", 16);
+   fails += test_threads(4, 0, 16);
+   fails += test_threads(3, 1, 16);
+   fails += test_threads(2, 9, 16);
+   fails += test_params(14);
+   fails += test_lod_count(16);
+   fails += test_lod_image(16, 1., 0, 0.06);
+   fails += test_lod_image(16, 1., 1, 0.02);
+   fails += test_elided(14);
+   fails += test_sinks(12);
+   fails += test_scratch(100);
+   fails += test_stats(12);
+   fails += test_trace(12, 50);
+   fails += test_paths(100000, 0.05);
+   fails += test_grouped(14, 1, 0);
+   fails += test_grouped(14, 0, 1);
+   fails += test_grouped(14, 1, 1);
+   fails += test_instanced(14, 0.1);
+   fails += test_transformed(14, 0.1, 12, 0.01);
+   fails += test_branching(24);
+   fails += test_symbols(14, 0.08);
+   fails += test_culling(14);
+   fails += test_batched(14, 14);
+   fails += test_replay(12, 0);
+   fails += test_replay(12, 1);
+
+   printf("%s\n", fails ? "Tests FAILED." : "All tests passed.");
+
+   return fails ? 1 : 0;
+}
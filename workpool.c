@@ -0,0 +1,319 @@
+/***********************************************************************
+ * work-stealing thread pool for the tree generator and renderer:
+ * every worker thread owns a deque of tasks, takes its own tasks from
+ * the back and, if it has none left, steals from the front of the
+ * others' deques. The thread calling workpool_run() helps with its
+ * own tasks until all are done, so runs may be nested in tasks and
+ * issued by several threads at once.
+ *
+ ***********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "workpool.h"
+
+/* tasks of one workpool_run() call */
+typedef struct {
+	unsigned long pending;	/* tasks not finished yet */
+} batch_t;
+
+typedef struct {
+	work_ft *fn;
+	void *arg;
+	batch_t *batch;
+} task_t;
+
+/* deque of tasks, circular with capacity a power of 2 */
+typedef struct {
+	pthread_mutex_t mtx;
+	task_t *buf;
+	unsigned long head, tail;	/* front and back, tail - head tasks */
+	unsigned long cap;
+} deque_t;
+
+struct workpool {
+	int nthreads;		/* number of worker threads */
+	pthread_t *tid;
+	deque_t *dq;		/* deques of workers */
+	pthread_mutex_t mtx;	/* protects queued, quit and batches */
+	pthread_cond_t work;	/* signalled if tasks are queued */
+	pthread_cond_t done;	/* signalled if a batch is done */
+	unsigned long queued;	/* tasks in all deques */
+	int quit;
+};
+
+/* pool and index of the calling thread, if it is a worker */
+static __thread workpool_t _self_wp = NULL;
+static __thread int _self_id = -1;
+
+/***********************************************************************/
+
+static int _push(deque_t *dq, const task_t *t){
+	/* appends t to the back of dq, returns -1 if out of memory */
+
+	task_t *buf;
+	unsigned long i, cap;
+
+	pthread_mutex_lock(&dq->mtx);
+	if (dq->tail - dq->head == dq->cap) {
+		cap = dq->cap ? 2 * dq->cap : 64;
+		if ((buf = (task_t *) malloc(cap * sizeof(*buf))) == NULL) {
+			pthread_mutex_unlock(&dq->mtx);
+			return -1;
+		}
+		for (i = dq->head; i != dq->tail; i++)
+			buf[i & (cap - 1)] = dq->buf[i & (dq->cap - 1)];
+		free(dq->buf);
+		dq->buf = buf;
+		dq->cap = cap;
+	}
+	dq->buf[dq->tail++ & (dq->cap - 1)] = *t;
+	pthread_mutex_unlock(&dq->mtx);
+
+	return 0;
+}
+
+/***********************************************************************/
+
+static int _pop(deque_t *dq, int back, const batch_t *batch, task_t *t){
+	/* removes a task from the back (own) or the front (stolen) of dq
+	 * into t, only one of batch unless that is NULL,
+	 * returns 0 if there was none */
+
+	unsigned long i;
+	int got = 0;
+
+	pthread_mutex_lock(&dq->mtx);
+	if (dq->tail != dq->head) {
+		i = back ? dq->tail - 1 : dq->head;
+		if (batch == NULL || dq->buf[i & (dq->cap - 1)].batch == batch) {
+			*t = dq->buf[i & (dq->cap - 1)];
+			if (back) dq->tail--;
+			else      dq->head++;
+			got = 1;
+		}
+	}
+	pthread_mutex_unlock(&dq->mtx);
+
+	return got;
+}
+
+/***********************************************************************/
+
+static int _take(workpool_t wp, int id, const batch_t *batch, task_t *t){
+	/* takes a task into t for the thread with index id: one of its own
+	 * if it is a worker, else steals one, returns 0 if there is none.
+	 * A thread waiting in workpool_run() only takes tasks of its batch,
+	 * so it never runs a second task with the same index concurrently
+	 * to one it is nested in or to another caller's. */
+
+	int i, got = 0;
+
+	if (id >= 0 && id < wp->nthreads) got = _pop(&wp->dq[id], 1, batch, t);
+	for (i = 1; i <= wp->nthreads && !got; i++)
+		got = _pop(&wp->dq[(id + i) % wp->nthreads], 0, batch, t);
+	if (got) {
+		pthread_mutex_lock(&wp->mtx);
+		wp->queued--;
+		pthread_mutex_unlock(&wp->mtx);
+	}
+
+	return got;
+}
+
+/***********************************************************************/
+
+static void _execute(workpool_t wp, int id, const task_t *t){
+	/* runs t, the last task of a batch wakes the waiting callers */
+
+	(*t->fn)(t->arg, id);
+
+	pthread_mutex_lock(&wp->mtx);
+	if (--t->batch->pending == 0) pthread_cond_broadcast(&wp->done);
+	pthread_mutex_unlock(&wp->mtx);
+}
+
+/***********************************************************************/
+
+static void *_worker(void *arg){
+	/* main loop of worker thread */
+
+	workpool_t wp = _self_wp;
+	int id = _self_id;
+	task_t t;
+
+	for (;;) {
+		if (_take(wp, id, NULL, &t)) {
+			_execute(wp, id, &t);
+			continue;
+		}
+		pthread_mutex_lock(&wp->mtx);
+		while (wp->queued == 0 && !wp->quit)
+			pthread_cond_wait(&wp->work, &wp->mtx);
+		if (wp->queued == 0 && wp->quit) {
+			pthread_mutex_unlock(&wp->mtx);
+			break;
+		}
+		pthread_mutex_unlock(&wp->mtx);
+	}
+
+	return NULL;
+}
+
+/* starts _worker() as thread id of wp */
+typedef struct {
+	workpool_t wp;
+	int id;
+} start_t;
+
+static void *_start(void *arg){
+	start_t st = *(start_t *)arg;
+
+	free(arg);
+	_self_wp = st.wp;
+	_self_id = st.id;
+	return _worker(NULL);
+}
+
+/***********************************************************************/
+
+static void _stop(workpool_t wp, int started){
+	/* stops the first started worker threads of wp and frees it */
+
+	int i;
+
+	pthread_mutex_lock(&wp->mtx);
+	wp->quit = 1;
+	pthread_cond_broadcast(&wp->work);
+	pthread_mutex_unlock(&wp->mtx);
+	for (i = 0; i < started; i++)
+		pthread_join(wp->tid[i], NULL);
+
+	for (i = 0; i < wp->nthreads; i++) {
+		pthread_mutex_destroy(&wp->dq[i].mtx);
+		free(wp->dq[i].buf);
+	}
+	pthread_cond_destroy(&wp->done);
+	pthread_cond_destroy(&wp->work);
+	pthread_mutex_destroy(&wp->mtx);
+	free(wp->dq);
+	free(wp->tid);
+	free(wp);
+}
+
+/***********************************************************************/
+
+workpool_t workpool_create  (int nthreads){
+	/* Creates a pool of nthreads worker threads, nthreads may be 0,
+	 * then workpool_run() runs all tasks in the calling thread.
+	 * Returns the pool or NULL on error. */
+
+	workpool_t wp;
+	start_t *st;
+	int i;
+
+	if (nthreads < 0) nthreads = 0;
+	if ((wp = (workpool_t) calloc(1, sizeof(*wp))) == NULL ||
+	    (wp->tid = (pthread_t *) calloc(nthreads + 1, sizeof(*wp->tid))) == NULL ||
+	    (wp->dq = (deque_t *) calloc(nthreads + 1, sizeof(*wp->dq))) == NULL) {
+		fprintf(stderr, " *** Not enough memory for thread pool!\n");
+		if (wp) free(wp->tid);
+		free(wp);
+		return NULL;
+	}
+	pthread_mutex_init(&wp->mtx, NULL);
+	pthread_cond_init(&wp->work, NULL);
+	pthread_cond_init(&wp->done, NULL);
+	for (i = 0; i < nthreads; i++)
+		pthread_mutex_init(&wp->dq[i].mtx, NULL);
+
+	/* workers steal from all deques, so they are set up before */
+	wp->nthreads = nthreads;
+	for (i = 0; i < nthreads; i++) {
+		if ((st = (start_t *) malloc(sizeof(*st))) == NULL) break;
+		st->wp = wp;
+		st->id = i;
+		if (pthread_create(&wp->tid[i], NULL, &_start, st) != 0) {
+			free(st);
+			break;
+		}
+	}
+	if (i < nthreads) {
+		fprintf(stderr, " *** Can't start worker thread %d!\n", i);
+		_stop(wp, i);
+		return NULL;
+	}
+
+	return wp;
+}
+
+/***********************************************************************/
+
+void workpool_destroy  (workpool_t wp){
+	/* Waits for the worker threads to run out of tasks, stops them and
+	 * frees the pool. */
+
+	if (wp != NULL) _stop(wp, wp->nthreads);
+}
+
+/***********************************************************************/
+
+int  workpool_size  (workpool_t wp){
+	/* Returns the number of distinct worker indices passed to tasks:
+	 * the worker threads plus an outside thread calling workpool_run(). */
+
+	return wp ? wp->nthreads + 1 : 1;
+}
+
+/***********************************************************************/
+
+void workpool_run  (workpool_t wp, work_ft *fn, void *args, size_t argsize,
+		    unsigned long n){
+	/* Runs fn on the n arguments args[0..n-1] of size argsize each, on
+	 * the workers of wp and the calling thread, and returns when all
+	 * are done. The tasks are dealt out to the workers in contiguous
+	 * blocks, neighbouring arguments tend to run on the same thread.
+	 * If wp is NULL, the tasks run in order in the calling thread. */
+
+	batch_t batch;
+	task_t t;
+	unsigned long i;
+	int id;
+
+	if (wp == NULL || wp->nthreads == 0) {
+		for (i = 0; i < n; i++) (*fn)((char *)args + i * argsize, 0);
+		return;
+	}
+	id = _self_wp == wp ? _self_id : wp->nthreads;
+
+	batch.pending = n;
+	t.fn = fn;
+	t.batch = &batch;
+	for (i = 0; i < n; i++) {
+		t.arg = (char *)args + i * argsize;
+		if (_push(&wp->dq[i * wp->nthreads / n], &t) != 0) {
+			_execute(wp, id, &t);	/* out of memory: run it now */
+			continue;
+		}
+		pthread_mutex_lock(&wp->mtx);
+		wp->queued++;
+		pthread_cond_signal(&wp->work);
+		pthread_mutex_unlock(&wp->mtx);
+	}
+
+	/* help out until the batch is done */
+	for (;;) {
+		if (_take(wp, id, &batch, &t)) {
+			_execute(wp, id, &t);
+			continue;
+		}
+		pthread_mutex_lock(&wp->mtx);
+		if (batch.pending == 0) {
+			pthread_mutex_unlock(&wp->mtx);
+			break;
+		}
+		pthread_cond_wait(&wp->done, &wp->mtx);
+		pthread_mutex_unlock(&wp->mtx);
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef _WORKPOOL_H_
+#define _WORKPOOL_H_
+/***********************************************************************
+ * header-file of
+ * work-stealing thread pool for the tree generator and renderer
+ *
+ ***********************************************************************/
+
+#include <stddef.h>
+
+/* abstract data type of a pool of worker threads */
+typedef struct workpool *workpool_t;
+
+/* a task: processes arg, worker is the index of the executing thread,
+ * 0..workpool_size(wp)-1, unique among the threads running tasks of
+ * the same workpool_run() call, e.g. to index per-worker buffers */
+typedef void work_ft(void *arg, int worker);
+
+/* prototypes of pool functions */
+workpool_t workpool_create  (int nthreads);
+void workpool_destroy  (workpool_t wp);
+int  workpool_size  (workpool_t wp);
+void workpool_run  (workpool_t wp, work_ft *fn, void *args, size_t argsize,
+		    unsigned long n);
+
+#endif